@@ -0,0 +1,132 @@
+#ifndef __ARENA_H
+#define __ARENA_H
+
+#include <stdlib.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+   bump allocator for per-assembly memory.
+
+   allocations are carved sequentially out of a chain of blocks and are
+   never freed individually. arena_reset releases everything at once in
+   O(1) by rewinding to the first block; the blocks themselves are kept and
+   reused by the next assembly, so a long-running process that assembles
+   many files stops allocating once its blocks cover the largest file.
+*/
+
+#define ARENA_ALIGN 16
+#define ARENA_DEFAULT_BLOCK (256 * 1024)
+
+typedef struct arena_block_type
+{
+  struct arena_block_type *next;
+  size_t size;
+  size_t used;
+  /* keep data aligned to ARENA_ALIGN */
+  size_t pad;
+  char data[];
+} arena_block_t;
+
+typedef struct
+{
+  arena_block_t *first;
+  arena_block_t *current;
+  size_t block_size;
+} arena_t;
+
+/*
+   initializes an empty arena
+
+   parameters:
+   arena : arena to initialize
+   block_size : size of each block, or 0 for ARENA_DEFAULT_BLOCK
+*/
+static inline void arena_init(arena_t *arena, size_t block_size)
+{
+  arena->first = NULL;
+  arena->current = NULL;
+  arena->block_size = (block_size > 0) ? block_size : ARENA_DEFAULT_BLOCK;
+}
+
+static inline arena_block_t *arena_new_block(size_t size)
+{
+  arena_block_t *block = (arena_block_t *) malloc(sizeof(arena_block_t) + size);
+  if (block == NULL) return(NULL);
+
+  block->next = NULL;
+  block->size = size;
+  block->used = 0;
+  return(block);
+}
+
+/*
+   allocates size bytes aligned to ARENA_ALIGN
+
+   returns: pointer to the memory or NULL on failure
+*/
+static inline void *arena_alloc(arena_t *arena, size_t size)
+{
+  arena_block_t *block = arena->current;
+  size = (size + ARENA_ALIGN - 1) & ~((size_t) ARENA_ALIGN - 1);
+
+  if ((block != NULL) && (block->size - block->used >= size))
+    {
+      void *ptr = block->data + block->used;
+      block->used += size;
+      return(ptr);
+    }
+
+  /* reuse the next block in the chain if it is big enough, otherwise
+     link in a new one after the current block */
+  if ((block != NULL) && (block->next != NULL) && (block->next->size >= size))
+    {
+      block = block->next;
+      block->used = 0;
+    }
+  else
+    {
+      arena_block_t *new_block = arena_new_block((size > arena->block_size) ? size : arena->block_size);
+      if (new_block == NULL) return(NULL);
+
+      if (block == NULL)
+	{
+	  new_block->next = arena->first;
+	  arena->first = new_block;
+	}
+      else
+	{
+	  new_block->next = block->next;
+	  block->next = new_block;
+	}
+      block = new_block;
+    }
+
+  arena->current = block;
+  block->used = size;
+  return(block->data);
+}
+
+/* releases every allocation in O(1), keeping the blocks for reuse */
+static inline void arena_reset(arena_t *arena)
+{
+  arena->current = arena->first;
+  if (arena->first != NULL) arena->first->used = 0;
+}
+
+/* frees all blocks */
+static inline void arena_destroy(arena_t *arena)
+{
+  arena_block_t *block = arena->first, *next;
+
+  while (block != NULL)
+    {
+      next = block->next;
+      free(block);
+      block = next;
+    }
+  arena->first = NULL;
+  arena->current = NULL;
+}
+
+#endif
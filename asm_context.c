@@ -0,0 +1,86 @@
+/*
+ * asm_context.c
+ *
+ * Lifetime of the per-assembly state.
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include "asm_context.h"
+
+int asm_context_init(asm_context_t *ctx) {
+
+	arena_init(&ctx->arena, 0);
+	output_init(&ctx->output);
+	program_init(&ctx->program);
+	fixups_init(&ctx->fixups);
+	ctx->symbols = NULL;
+	ctx->labels = NULL;
+	ctx->pool = NULL;
+	trace_init(&ctx->trace);
+
+	return asm_context_reset(ctx);
+}
+
+// Release everything the previous assembly allocated, in O(1)
+// The arena blocks, record and fixup arrays and output buffers are kept for the next file
+int asm_context_reset(asm_context_t *ctx) {
+
+	arena_reset(&ctx->arena);
+	program_clear(&ctx->program);
+	fixups_clear(&ctx->fixups);
+	ctx->output.text.count = 0;
+	ctx->output.data.count = 0;
+	ctx->failed = 0;
+	ctx->error[0] = '\0';
+	ctx->labels = NULL;
+	stats_clear(&ctx->stats, ctx->pool != NULL);
+	trace_clear(&ctx->trace);
+
+	ctx->symbols = symtab_create_arena(&ctx->arena, ASM_INITIAL_SYMBOLS);
+	return (ctx->symbols != NULL) ? 0 : -1;
+}
+
+void asm_context_free(asm_context_t *ctx) {
+
+	arena_destroy(&ctx->arena);
+	output_free(&ctx->output);
+	program_free(&ctx->program);
+	fixups_free(&ctx->fixups);
+	trace_free(&ctx->trace);
+	ctx->symbols = NULL;
+	ctx->labels = NULL;
+}
+
+/*
+ * Freeze the labels of a finished assembly into ctx->labels, the first time
+ * they are asked for. Assemblies nobody looks the labels up in never pay for
+ * the perfect hash. Returns -1 with the error recorded in ctx.
+ */
+int asm_context_labels(asm_context_t *ctx) {
+
+	if (ctx->labels != NULL)
+		return 0;
+
+	int no_hash;
+	ctx->labels = symtab_freeze(ctx->symbols, &ctx->arena, &no_hash);
+	if (ctx->labels == NULL)
+		return asm_error(ctx, no_hash ? "Labels could not be given a perfect hash." : "Out of memory");
+
+	return 0;
+}
+
+// Record an error, keeping the first one, and return -1
+int asm_error(asm_context_t *ctx, const char *format, ...) {
+
+	if (!ctx->failed) {
+		va_list args;
+		va_start(args, format);
+		vsnprintf(ctx->error, ASM_ERROR_LENGTH, format, args);
+		va_end(args);
+		ctx->failed = 1;
+		TRACE(&ctx->trace, TRACE_ERROR, "error: %s", ctx->error);
+	}
+
+	return -1;
+}
@@ -0,0 +1,49 @@
+/*
+ * asm_context.h
+ *
+ * State owned by one assembly: the arena that per-file allocations come
+ * from, the symbol table and its frozen copy, the decoded program, the
+ * pending forward references of single-pass mode, the encoded output and
+ * the stats of the assembly. A context can be reset and reused for the next
+ * file without returning memory to the system.
+ */
+
+#ifndef ASM_CONTEXT_H_
+#define ASM_CONTEXT_H_
+
+#include "arena.h"
+#include "symtab.h"
+#include "frozen_symtab.h"
+#include "output.h"
+#include "ir.h"
+#include "thread_pool.h"
+#include "stats.h"
+#include "trace.h"
+
+// Symbols to make room for before the symbol table first grows
+#define ASM_INITIAL_SYMBOLS 128
+
+// Longest error message kept by a context
+#define ASM_ERROR_LENGTH 256
+
+typedef struct {
+	arena_t arena;
+	symtab_t *symbols;
+	frozen_symtab_t *labels;	// Read-only copy of the defined symbols, once asm_context_labels() made it
+	asm_program_t program;
+	asm_fixups_t fixups;
+	output_t output;
+	thread_pool_t *pool;	// Shared workers for the passes, not owned; NULL runs serially
+	trace_t trace;			// Debug messages, printed or kept for an error
+	asm_stats_t stats;		// Counters and phase times of the current file
+	int failed;
+	char error[ASM_ERROR_LENGTH];	// First error of the assembly
+} asm_context_t;
+
+int asm_context_init(asm_context_t *ctx);
+int asm_context_reset(asm_context_t *ctx);
+void asm_context_free(asm_context_t *ctx);
+int asm_context_labels(asm_context_t *ctx);
+int asm_error(asm_context_t *ctx, const char *format, ...);
+
+#endif /* ASM_CONTEXT_H_ */
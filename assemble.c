@@ -0,0 +1,241 @@
+/*
+ * assemble.c
+ *
+ * Runs the passes over one file and writes the output.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "assemble.h"
+#include "file_parser.h"
+#include "source.h"
+
+// Assemble in two passes over the input loaded into memory, which is only read
+int assemble_source(asm_context_t *ctx, const source_t *src) {
+
+	stats_begin(&ctx->stats);
+	int status = parse_file(src, 1, ctx);
+	stats_end(&ctx->stats, STATS_PASS1);
+	if (status != 0)
+		return -1;
+
+	stats_begin(&ctx->stats);
+	status = parse_file(src, 2, ctx);
+	stats_end(&ctx->stats, STATS_PASS2);
+	return status;
+}
+
+/*
+ * Write the output of a miss to Out and store it as the entry for key. An
+ * output file is copied into the cache once written; stdout cannot be read
+ * back, so its output is serialized to memory and written to both. Returns
+ * -1 if Out could not be written; failing to store is not an error.
+ */
+static int write_and_store(asm_context_t *ctx, const asm_options_t *options, const char *key, const char *out_path,
+		FILE *Out) {
+
+	if (Out != stdout) {
+		if (output_write(&ctx->output, options->format, options->big_endian, Out) != 0 || fflush(Out) != 0)
+			return -1;
+		int fd = open(out_path, O_RDONLY | O_CLOEXEC);
+		if (fd >= 0) {
+			output_cache_store_file(options->output_cache, key, fd, &ctx->stats.cache_evictions);
+			close(fd);
+		}
+		return 0;
+	}
+
+	char *data = NULL;
+	size_t size = 0;
+	FILE *Memory = open_memstream(&data, &size);
+	if (Memory == NULL)
+		return output_write(&ctx->output, options->format, options->big_endian, Out);
+
+	int status = output_write(&ctx->output, options->format, options->big_endian, Memory);
+	if (fclose(Memory) != 0 || status != 0) {
+		free(data);
+		return output_write(&ctx->output, options->format, options->big_endian, Out);
+	}
+
+	if (fwrite(data, 1, size, Out) != size)
+		status = -1;
+	else
+		output_cache_store(options->output_cache, key, data, size, &ctx->stats.cache_evictions);
+	free(data);
+	return status;
+}
+
+/*
+ * Assemble in two passes, reusing what the previous run left in the cache
+ * sidecar at cache_path. A missing or stale sidecar only means that every
+ * block is lexed and encoded again. The cache for the next run is built in
+ * cache.
+ */
+static int assemble_incremental(asm_context_t *ctx, const source_t *src, const char *cache_path,
+		block_cache_t *previous, block_cache_t *cache) {
+
+	stats_begin(&ctx->stats);
+	if (block_cache_load(previous, cache_path) != 0)
+		TRACE(&ctx->trace, TRACE_INFO, "incremental: no usable cache in %s", cache_path);
+	int status = parse_incremental(src, 1, previous, cache, ctx);
+	stats_end(&ctx->stats, STATS_PASS1);
+	if (status != 0)
+		return -1;
+
+	stats_begin(&ctx->stats);
+	status = parse_incremental(src, 2, previous, cache, ctx);
+	stats_end(&ctx->stats, STATS_PASS2);
+	return status;
+}
+
+/*
+ * Assemble in_path into out_path. An input of "-" is read from stdin and an
+ * output of "-" written to stdout. An assembly error is written to the
+ * output file, as a serial run always did; in the pipelined mode it follows
+ * whatever was already written. Returns ASM_ERROR_IN_OUTPUT if the
+ * assembly failed and -1 for any other error, with the error recorded in
+ * ctx either way.
+ */
+int assemble_file(asm_context_t *ctx, const char *in_path, const char *out_path, const asm_options_t *options) {
+
+	if (asm_context_reset(ctx) != 0)
+		return asm_error(ctx, "Out of memory");
+
+	// Open the input first, so that a missing input leaves no output behind
+	source_t src = { NULL, 0, 0 };
+	FILE *In = NULL;
+
+	int streamed = options->single_pass || options->pipelined;
+
+	// The incremental mode keeps its cache next to the output unless told otherwise
+	char *cache_path = NULL;
+	if (options->incremental) {
+		if (options->cache_path == NULL && strcmp(out_path, "-") == 0)
+			return asm_error(ctx, "--incremental needs a cache path to write to stdout.");
+		const char *path = (options->cache_path != NULL) ? options->cache_path : out_path;
+		cache_path = malloc(strlen(path) + sizeof(".cache"));
+		if (cache_path == NULL)
+			return asm_error(ctx, "Out of memory");
+		strcpy(cache_path, path);
+		if (options->cache_path == NULL)
+			strcat(cache_path, ".cache");
+	}
+
+	stats_begin(&ctx->stats);
+	if (streamed)
+		In = (strcmp(in_path, "-") == 0) ? stdin : fopen(in_path, "r");
+	if (streamed ? In == NULL : source_open(&src, in_path) != 0) {
+		free(cache_path);
+		return asm_error(ctx, "Input file could not be opened.");
+	}
+	stats_end(&ctx->stats, STATS_READ);
+	ctx->stats.files = 1;
+	ctx->stats.bytes_in = src.len;
+
+	FILE *Out = (strcmp(out_path, "-") == 0) ? stdout : fopen(out_path, options->format == FORMAT_TEXT ? "w" : "wb");
+	if (Out == NULL) {
+		if (In != NULL && In != stdin)
+			fclose(In);
+		source_close(&src);
+		free(cache_path);
+		return asm_error(ctx, "Output file could not opened.");
+	}
+
+	block_cache_t previous, cache;
+	block_cache_init(&previous);
+	block_cache_init(&cache);
+
+	// A source assembled before to the same format is copied from the output
+	// cache without being parsed. A hit cannot write a symbol map.
+	int use_cache = options->output_cache != NULL && !streamed && options->map_path == NULL;
+	char key[OUTPUT_CACHE_KEY_LENGTH + 1];
+	int cached = 0;
+	if (use_cache) {
+		uint64_t size = 0;
+		stats_begin(&ctx->stats);
+		output_cache_key(key, &src, options->format, options->big_endian);
+		cached = output_cache_fetch(options->output_cache, key, Out, &size);
+		stats_end(&ctx->stats, STATS_WRITE);
+		ctx->stats.bytes_out = size;
+	}
+
+	// The streamed modes read as they assemble, so all of their time counts as pass 1
+	int status;
+	if (cached != 0)
+		status = (cached > 0) ? 0 : asm_error(ctx, "Output file could not be written.");
+	else if (options->pipelined) {
+		stats_begin(&ctx->stats);
+		status = parse_pipeline(In, Out, options->format, options->big_endian, ctx);
+		stats_end(&ctx->stats, STATS_PASS1);
+	}
+	else if (options->single_pass) {
+		stats_begin(&ctx->stats);
+		status = parse_stream(In, ctx);
+		stats_end(&ctx->stats, STATS_PASS1);
+	}
+	else if (options->incremental)
+		status = assemble_incremental(ctx, &src, cache_path, &previous, &cache);
+	else
+		status = assemble_source(ctx, &src);
+	stats_symbols(&ctx->stats, ctx->symbols);
+
+	stats_begin(&ctx->stats);
+	int in_output = (status != 0 && cached == 0);
+	if (status != 0)
+		fprintf(Out, "%s\n", ctx->error);
+
+	// A miss is serialized once and copied into the output cache from what was written
+	else if (use_cache && !cached) {
+		ctx->stats.cache_misses++;
+		if (write_and_store(ctx, options, key, out_path, Out) != 0)
+			status = asm_error(ctx, "Output file could not be written.");
+	}
+
+	// Serialize the encoded words in the chosen format; the pipeline has written them already
+	else if (!options->pipelined && !cached && output_write(&ctx->output, options->format, options->big_endian, Out) != 0)
+		status = asm_error(ctx, "Output file could not be written.");
+
+	if (cached > 0)
+		ctx->stats.cache_hits++;
+
+	long written = ftell(Out);
+	if (written > 0)
+		ctx->stats.bytes_out = written;
+	if ((Out == stdout ? fflush(Out) : fclose(Out)) != 0) {
+		status = asm_error(ctx, "Output file could not be written.");
+		in_output = 0;
+	}
+
+	// The symbol map lists every label by address; only it needs the labels frozen
+	if (status == 0 && options->map_path != NULL)
+		status = asm_context_labels(ctx);
+	if (status == 0 && options->map_path != NULL) {
+		FILE *Map = fopen(options->map_path, "w");
+		if (Map == NULL)
+			status = asm_error(ctx, "Symbol map could not be opened.");
+		else {
+			if (!frozen_symtab_write(ctx->labels, Map))
+				status = asm_error(ctx, "Symbol map could not be written.");
+			if (fclose(Map) != 0 && status == 0)
+				status = asm_error(ctx, "Symbol map could not be written.");
+		}
+	}
+
+	// Only a successful assembly leaves a cache; the words in it must all be valid.
+	// An output cache hit parsed nothing, so the sidecar of the last parse is kept.
+	if (status == 0 && options->incremental && !cached && block_cache_save(&cache, cache_path, &ctx->output) != 0)
+		status = asm_error(ctx, "Cache file could not be written.");
+
+	stats_end(&ctx->stats, STATS_WRITE);
+	block_cache_free(&previous);
+	block_cache_free(&cache);
+	free(cache_path);
+
+	if (In != NULL && In != stdin)
+		fclose(In);
+	source_close(&src);
+
+	return (status != 0 && in_output) ? ASM_ERROR_IN_OUTPUT : status;
+}
@@ -0,0 +1,37 @@
+/*
+ * assemble.h
+ *
+ * Assembles one input file into one output file, reusing a context that
+ * may have assembled other files before.
+ */
+
+#ifndef ASSEMBLE_H_
+#define ASSEMBLE_H_
+
+#include "asm_context.h"
+#include "output.h"
+#include "output_cache.h"
+#include "source.h"
+
+// Changes whenever a source may assemble to different output; part of the output cache key
+#define ASSEMBLER_VERSION "1.1"
+
+// Returned by assemble_file() when the error of a failed assembly went to the output file
+#define ASM_ERROR_IN_OUTPUT 1
+
+// How a file is assembled and written
+typedef struct {
+	output_format_t format;
+	int big_endian;
+	int single_pass;	// Read the input as a stream and assemble it in one pass
+	int pipelined;		// Read, lex, encode and write the stream on separate threads
+	int incremental;	// Reuse the blocks of the cache sidecar that did not change
+	const char *cache_path;	// Sidecar of the incremental mode, or NULL for the output path plus ".cache"
+	const char *map_path;	// Where to write the symbol map, or NULL
+	output_cache_t *output_cache;	// Whole-output cache shared by the files of the run, or NULL
+} asm_options_t;
+
+int assemble_source(asm_context_t *ctx, const source_t *src);
+int assemble_file(asm_context_t *ctx, const char *in_path, const char *out_path, const asm_options_t *options);
+
+#endif /* ASSEMBLE_H_ */
@@ -7,103 +7,351 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
-#include "file_parser.h"
-#include "hash_table.h"
-
-int search(char *instruction);
-
-// Array that holds the supported instructions
-char *instructions[] = {
-		"la",	// 0
-		"lui",	// 1
-		"lw",	// 2
-		"sw",	// 3
-		"add",	// 4
-		"sub",	// 5
-		"addi",	// 6
-		"or",	// 7
-		"and",	// 8
-		"ori",	// 9
-		"andi",	// 10
-		"slt",	// 11
-		"slti",	// 12
-		"sll",	// 13
-		"srl",	// 14
-		"beq",	// 15
-		"j",	// 16
-		"jr",	// 17
-		"jal"	// 18
-	};
-
-// Size of array
-size_t inst_len = sizeof(instructions)/sizeof(char *);
-
-int search(char *instruction) {
-
-	int found = 0;
-
-	for (int i = 0; i < inst_len; i++) {
-
-		if (strcmp(instruction, instructions[i]) == 0) {
-			found = 1;
-			return i;
-		}
-	}
+#include <ctype.h>
+#include <errno.h>
+#include <limits.h>
+#include <stdint.h>
+#include <unistd.h>
+#include "asm_context.h"
+#include "assemble.h"
+#include "batch.h"
+#include "output.h"
+#include "output_cache.h"
+#include "serve.h"
+#include "thread_pool.h"
+#include "trace.h"
+
+// How --stats reports the counters of a run, on stderr
+enum { STATS_OFF, STATS_TEXT, STATS_JSON };
+
+static void print_stats(const asm_stats_t *stats, int report) {
+
+	fflush(stdout);
+	if (report == STATS_TEXT)
+		stats_print(stats, stderr);
+	else if (report == STATS_JSON)
+		stats_print_json(stats, stderr);
+}
+
+// Parse a count that must be all digits, from 1 to max. Returns -1 for anything else.
+static int parse_count(const char *text, uint64_t max, uint64_t *value) {
 
-	if (found == 0)
+	if (!isdigit((unsigned char)text[0]))
 		return -1;
+
+	char *end;
+	errno = 0;
+	unsigned long long n = strtoull(text, &end, 10);
+	if (*end != '\0' || errno != 0 || n < 1 || n > max)
+		return -1;
+
+	*value = n;
+	return 0;
 }
 
-// Quick Sort String Comparison Function
-int string_comp(const void *a, const void *b) {
-	return strcmp(*(char **)a, *(char **)b);
+// Assemble the pairs of a batch on jobs workers and report each file
+static int run_batch(batch_t *batch, int jobs, const asm_options_t *options, int report) {
+
+	size_t failed = batch_run(batch, jobs, options);
+	asm_stats_t total;
+	stats_clear(&total, 0);
+
+	for (size_t i = 0; i < batch->count; i++) {
+		const batch_job_t *job = &batch->jobs[i];
+		if (job->status == 0)
+			printf("%s: ok\n", job->in_path);
+		else
+			printf("%s: %s\n", job->in_path, job->error ? job->error : "Out of memory");
+		stats_add(&total, &job->stats);
+	}
+	printf("%zu files, %zu failed\n", batch->count, failed);
+
+	// Phase times are summed over the files, so they can exceed the run's wall time
+	print_stats(&total, report);
+
+	return (failed == 0) ? 0 : 1;
 }
 
 int main (int argc, char *argv[]) {
 
-	// Make sure correct number of arguments input
-	if (argc != 3) {
-		printf("Incorrect number of arguments");
+	// Options, then the input and output file names
+	asm_options_t options = { .format = FORMAT_TEXT, .big_endian = 1 };
+	int jobs = 0;		// Not given; a run is serial and a daemon has a worker per CPU
+	int report = STATS_OFF;
+	int trace_level = TRACE_OFF;
+	size_t trace_buffer = 0;
+	const char *cache_dir = NULL;
+	uint64_t cache_size = OUTPUT_CACHE_DEFAULT_SIZE;
+	char *files[2];
+	int file_count = 0;
+
+	// --serve runs the daemon; --connect has one assemble what would have run here
+	const char *serve_path = NULL;
+	const char *connect_path = NULL;
+	int server_stats = 0;
+
+	// --batch and in:out arguments assemble many files in one run
+	batch_t batch;
+	batch_init(&batch);
+	const char *manifest = NULL;
+	int pair_count = 0;
+
+	// Files and pairs are told apart once all the arguments are seen
+	char **args = malloc(argc * sizeof(char *));
+	int arg_count = 0;
+	if (args == NULL) {
+		printf("Out of memory");
+		exit(1);
 	}
 
-	else {
+	for (int i = 1; i < argc; i++) {
+
+		if (strncmp(argv[i], "--format=", 9) == 0) {
+			if (output_parse_format(argv[i] + 9, &options.format) != 0) {
+				printf("Unknown output format %s", argv[i] + 9);
+				exit(1);
+			}
+		}
+		else if (strcmp(argv[i], "--endian=big") == 0)
+			options.big_endian = 1;
+		else if (strcmp(argv[i], "--endian=little") == 0)
+			options.big_endian = 0;
+		else if (strcmp(argv[i], "--single-pass") == 0)
+			options.single_pass = 1;
+		else if (strcmp(argv[i], "--stream") == 0)
+			options.pipelined = 1;
+		else if (strcmp(argv[i], "--incremental") == 0)
+			options.incremental = 1;
+		else if (strncmp(argv[i], "--incremental=", 14) == 0) {
+			options.incremental = 1;
+			options.cache_path = argv[i] + 14;
+		}
+		else if (strncmp(argv[i], "--cache-dir=", 12) == 0)
+			cache_dir = argv[i] + 12;
+		else if (strncmp(argv[i], "--cache-size=", 13) == 0) {
+			if (parse_count(argv[i] + 13, UINT64_MAX, &cache_size) != 0) {
+				printf("Invalid cache size %s", argv[i] + 13);
+				exit(1);
+			}
+		}
+		else if (strncmp(argv[i], "--map=", 6) == 0)
+			options.map_path = argv[i] + 6;
+		else if (strcmp(argv[i], "--stats") == 0 || strcmp(argv[i], "--stats=text") == 0)
+			report = STATS_TEXT;
+		else if (strcmp(argv[i], "--stats=json") == 0)
+			report = STATS_JSON;
+		else if (strncmp(argv[i], "--trace=", 8) == 0) {
+			if (trace_parse_level(argv[i] + 8, &trace_level) != 0) {
+				printf("Unknown trace level %s", argv[i] + 8);
+				exit(1);
+			}
+		}
+		else if (strncmp(argv[i], "--trace-buffer=", 15) == 0) {
+			uint64_t n;
+			if (parse_count(argv[i] + 15, TRACE_MAX_BUFFER, &n) != 0) {
+				printf("Invalid trace buffer size %s", argv[i] + 15);
+				exit(1);
+			}
+			trace_buffer = (size_t)n;
+		}
+		else if (strcmp(argv[i], "--batch") == 0 && i + 1 < argc)
+			manifest = argv[++i];
+		else if (strcmp(argv[i], "--serve") == 0 && i + 1 < argc)
+			serve_path = argv[++i];
+		else if (strcmp(argv[i], "--connect") == 0 && i + 1 < argc)
+			connect_path = argv[++i];
+		else if (strcmp(argv[i], "--server-stats") == 0)
+			server_stats = 1;
+		else if (strcmp(argv[i], "-j") == 0 || (argv[i][0] == '-' && argv[i][1] == 'j' && isdigit((unsigned char)argv[i][2]))) {
+			const char *count = (argv[i][2] != '\0') ? argv[i] + 2 : (i + 1 < argc) ? argv[++i] : "";
+			uint64_t n;
+			if (parse_count(count, INT_MAX, &n) != 0) {
+				printf("Invalid job count %s", count);
+				exit(1);
+			}
+			jobs = (int)n;
+		}
+		else
+			args[arg_count++] = argv[i];
+	}
 
-		// Open I/O files
-		// Check that files opened properly
-		FILE *In;
-		In = fopen(argv[1], "r");
-		if (In == NULL) {
-			printf("Input file could not be opened.");
+	// Two arguments are an input and an output file, which may hold a colon, unless both are pairs
+	int pairs = arg_count != 2 || (strchr(args[0], ':') != NULL && strchr(args[1], ':') != NULL);
+	for (int a = 0; a < arg_count; a++) {
+		if (pairs && strchr(args[a], ':') != NULL) {
+			if (batch_add(&batch, args[a]) != 0) {
+				printf("Invalid input:output pair %s", args[a]);
+				exit(1);
+			}
+			pair_count++;
+		}
+		else if (file_count < 2)
+			files[file_count++] = args[a];
+		else
+			file_count++;
+	}
+	free(args);
+
+	// An ELF header holds the section sizes, which a stream only knows at its end
+	if (options.pipelined && options.format == FORMAT_ELF) {
+		printf("--stream cannot write the elf format");
+		exit(1);
+	}
+
+	// The cache holds the records of pass 1, which the streamed modes do not keep
+	if (options.incremental && (options.single_pass || options.pipelined)) {
+		printf("--incremental cannot be combined with --single-pass or --stream");
+		exit(1);
+	}
+
+	// The client only carries the output format to the daemon, which holds the rest of the configuration
+	if (connect_path != NULL) {
+
+		if (options.single_pass || options.pipelined || options.incremental || options.map_path != NULL
+				|| cache_dir != NULL || manifest != NULL || pair_count > 0 || serve_path != NULL
+				|| jobs != 0 || report != STATS_OFF || trace_level != TRACE_OFF || trace_buffer != 0) {
+			printf("--connect takes only --format, --endian and --server-stats");
+			exit(1);
+		}
+		if (file_count != (server_stats ? 0 : 2)) {
+			printf("Incorrect number of arguments");
 			exit(1);
 		}
 
-		FILE *Out;
-		Out = fopen(argv[2], "w");
-		if (Out == NULL) {
-			printf("Output file could not opened.");
+		char error[ASM_ERROR_LENGTH];
+		int status = server_stats ? serve_request_stats(connect_path, stdout, error)
+				: serve_request_file(connect_path, files[0], files[1], &options, error);
+		if (status < 0)
+			printf("%s", error);
+		return (status == 0) ? 0 : 1;
+	}
+
+	if (server_stats) {
+		printf("--server-stats needs --connect");
+		exit(1);
+	}
+
+	// Finished outputs are kept in a cache directory shared by every file of the run
+	output_cache_t output_cache;
+	if (cache_dir != NULL) {
+		if (options.single_pass || options.pipelined) {
+			printf("--cache-dir cannot be combined with --single-pass or --stream");
+			exit(1);
+		}
+		if (output_cache_open(&output_cache, cache_dir, cache_size) != 0) {
+			printf("Cache directory %s could not be used.", cache_dir);
+			exit(1);
+		}
+		options.output_cache = &output_cache;
+	}
+
+	// Each request names its own output format; the daemon supplies the output cache and the workers
+	if (serve_path != NULL) {
+
+		if (options.single_pass || options.pipelined || options.incremental || options.map_path != NULL
+				|| manifest != NULL || pair_count > 0 || file_count != 0 || trace_level != TRACE_OFF || trace_buffer != 0) {
+			printf("--serve takes only -j, --cache-dir and --cache-size");
+			exit(1);
+		}
+
+		char error[ASM_ERROR_LENGTH];
+		int workers = (jobs != 0) ? jobs : (int)sysconf(_SC_NPROCESSORS_ONLN);
+		int status = serve_run(serve_path, (workers > 0) ? workers : 1, &options, error);
+		if (status != 0)
+			printf("%s", error);
+		if (options.output_cache != NULL)
+			output_cache_close(options.output_cache);
+		return (status == 0) ? 0 : 1;
+	}
+
+	if (manifest != NULL || pair_count > 0) {
+
+		if (file_count != 0) {
+			printf("Incorrect number of arguments");
+			exit(1);
+		}
+
+		// Every file would write the same map
+		if (options.map_path != NULL) {
+			printf("--map needs a single input file");
 			exit(1);
 		}
 
-		// Sort the array using qsort for faster search
-		qsort(instructions, inst_len, sizeof(char *), string_comp);
+		// Every file needs a cache of its own, which defaults to one next to its output
+		if (options.cache_path != NULL) {
+			printf("--incremental=FILE needs a single input file");
+			exit(1);
+		}
+
+		if (manifest != NULL) {
+			int status = batch_read_manifest(&batch, manifest);
+			if (status < 0) {
+				printf("Manifest file could not be read.");
+				exit(1);
+			}
+			if (status > 0) {
+				printf("%s: line %d: expected input:output\n", manifest, status);
+				exit(1);
+			}
+		}
 
-		// Create a hash table of size 127
-		hash_table_t *hash_table = create_hash_table(127);
+		int status = run_batch(&batch, jobs, &options, report);
+		batch_free(&batch);
+		if (options.output_cache != NULL)
+			output_cache_close(options.output_cache);
+		return status;
+	}
 
-		// Parse in passes
+	// Make sure correct number of arguments input
+	if (file_count != 2) {
+		printf("Incorrect number of arguments");
+	}
 
-		int passNumber = 1;
-		parse_file(In, passNumber, instructions, inst_len, hash_table, Out);
+	else {
 
-		// Rewind input file & start pass 2
-		rewind(In);
-		passNumber = 2;
-		parse_file(In, passNumber, instructions, inst_len, hash_table, Out);
+		// Create the assembly context: symbol table, output words and the
+		// arena their memory comes from
+		asm_context_t ctx;
+		if (asm_context_init(&ctx) != 0) {
+			printf("Out of memory");
+			exit(1);
+		}
+
+		// --trace prints messages as they happen; --trace-buffer keeps the
+		// most recent ones of every compiled-in level to dump on an error
+		if (trace_enable(&ctx.trace, trace_level, TRACE_LEVEL, trace_buffer) != 0) {
+			printf("Out of memory");
+			exit(1);
+		}
+
+		// The passes run on -j worker threads; the incremental mode runs serially
+		thread_pool_t *pool = NULL;
+		if (jobs > 1 && !options.single_pass && !options.pipelined && !options.incremental) {
+			pool = thread_pool_create(jobs);
+			if (pool == NULL) {
+				printf("Worker threads could not be started.");
+				exit(1);
+			}
+			ctx.pool = pool;
+		}
+
+		// An input of "-" is read from stdin. Assembly errors go to the
+		// output file only; errors opening or writing the files are printed.
+		int status = assemble_file(&ctx, files[0], files[1], &options);
+		if (status < 0)
+			printf("%s", ctx.error);
+		if (status != 0) {
+			fflush(stdout);
+			trace_dump(&ctx.trace, stderr);
+		}
+		print_stats(&ctx.stats, report);
 
-		// Close files
-		fclose(In);
-		fclose(Out);
+		asm_context_free(&ctx);
+		if (pool != NULL)
+			thread_pool_destroy(pool);
+		if (options.output_cache != NULL)
+			output_cache_close(options.output_cache);
 
-		return 0;
+		return (status == 0) ? 0 : 1;
 	}
 }
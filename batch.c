@@ -0,0 +1,269 @@
+/*
+ * batch.c
+ *
+ * Work-stealing scheduler for batch assembly.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include "batch.h"
+
+// Jobs owned by one worker, largest first
+typedef struct {
+	pthread_mutex_t lock;
+	size_t *items;		// Indices into the batch
+	size_t head;		// The owner takes from the head
+	size_t tail;		// Thieves take from the tail
+} batch_queue_t;
+
+typedef struct {
+	batch_t *batch;
+	const asm_options_t *options;
+	batch_queue_t *queues;
+	int worker_count;
+} batch_run_t;
+
+typedef struct {
+	batch_run_t *run;
+	int id;
+	int started;		// A thread was created for the worker
+	pthread_t thread;
+} batch_worker_t;
+
+// A job index with the size it is sorted by
+typedef struct {
+	size_t size;
+	size_t index;
+} batch_order_t;
+
+void batch_init(batch_t *batch) {
+
+	batch->jobs = NULL;
+	batch->count = 0;
+	batch->capacity = 0;
+}
+
+void batch_free(batch_t *batch) {
+
+	for (size_t i = 0; i < batch->count; i++) {
+		free(batch->jobs[i].in_path);
+		free(batch->jobs[i].error);
+	}
+	free(batch->jobs);
+	batch_init(batch);
+}
+
+// Add an "input:output" pair, returning -1 if it is malformed or memory ran out
+int batch_add(batch_t *batch, const char *pair) {
+
+	const char *colon = strchr(pair, ':');
+	if (colon == NULL || colon == pair || colon[1] == '\0')
+		return -1;
+
+	if (batch->count == batch->capacity) {
+		size_t capacity = batch->capacity ? batch->capacity * 2 : 64;
+		batch_job_t *jobs = realloc(batch->jobs, capacity * sizeof(batch_job_t));
+		if (jobs == NULL)
+			return -1;
+		batch->jobs = jobs;
+		batch->capacity = capacity;
+	}
+
+	// Both paths share one allocation, split where the colon was
+	char *paths = strdup(pair);
+	if (paths == NULL)
+		return -1;
+	paths[colon - pair] = '\0';
+
+	batch_job_t *job = &batch->jobs[batch->count++];
+	job->in_path = paths;
+	job->out_path = paths + (colon - pair) + 1;
+	job->size = 0;
+	job->status = 0;
+	job->error = NULL;
+	stats_clear(&job->stats, 0);
+	return 0;
+}
+
+/*
+ * Add the pairs listed in a manifest, one "input:output" per line. Blank
+ * lines and lines starting with '#' are skipped. Returns the line number of a
+ * malformed line, -1 if the manifest could not be read, or 0.
+ */
+int batch_read_manifest(batch_t *batch, const char *path) {
+
+	FILE *manifest = fopen(path, "r");
+	if (manifest == NULL)
+		return -1;
+
+	char *line = NULL;
+	size_t line_capacity = 0;
+	ssize_t len;
+	int line_num = 0;
+	int status = 0;
+
+	while (status == 0 && (len = getline(&line, &line_capacity, manifest)) != -1) {
+
+		line_num++;
+		while (len > 0 && (line[len - 1] == '\n' || line[len - 1] == '\r' || line[len - 1] == ' '))
+			line[--len] = '\0';
+
+		char *pair = line;
+		while (*pair == ' ' || *pair == '\t')
+			pair++;
+
+		if (*pair != '\0' && *pair != '#' && batch_add(batch, pair) != 0)
+			status = line_num;
+	}
+
+	if (status == 0 && ferror(manifest))
+		status = -1;
+
+	free(line);
+	fclose(manifest);
+	return status;
+}
+
+// Next job for a worker: its own largest, or else the smallest of another worker
+static int batch_next(batch_run_t *run, int id, size_t *job) {
+
+	batch_queue_t *own = &run->queues[id];
+
+	pthread_mutex_lock(&own->lock);
+	int found = own->head < own->tail;
+	if (found)
+		*job = own->items[own->head++];
+	pthread_mutex_unlock(&own->lock);
+
+	for (int i = 1; !found && i < run->worker_count; i++) {
+
+		batch_queue_t *victim = &run->queues[(id + i) % run->worker_count];
+
+		pthread_mutex_lock(&victim->lock);
+		found = victim->head < victim->tail;
+		if (found)
+			*job = victim->items[--victim->tail];
+		pthread_mutex_unlock(&victim->lock);
+	}
+
+	return found;
+}
+
+static void *batch_worker(void *arg) {
+
+	batch_worker_t *worker = arg;
+	batch_run_t *run = worker->run;
+	size_t index;
+
+	asm_context_t ctx;
+	int ready = (asm_context_init(&ctx) == 0);
+
+	while (batch_next(run, worker->id, &index)) {
+
+		batch_job_t *job = &run->batch->jobs[index];
+
+		if (!ready || assemble_file(&ctx, job->in_path, job->out_path, run->options) != 0) {
+			job->status = -1;
+			job->error = strdup(ready ? ctx.error : "Out of memory");
+		}
+		if (ready)
+			job->stats = ctx.stats;
+	}
+
+	asm_context_free(&ctx);
+	return NULL;
+}
+
+// Order jobs by decreasing size, then by position in the batch
+static int compare_size(const void *a, const void *b) {
+
+	const batch_order_t *order_a = a, *order_b = b;
+
+	if (order_a->size != order_b->size)
+		return (order_a->size > order_b->size) ? -1 : 1;
+	return (order_a->index < order_b->index) ? -1 : 1;
+}
+
+/*
+ * Assemble every job of the batch on up to threads workers. The jobs are
+ * sorted by size and dealt out round-robin, so every worker starts with a
+ * similar share; a worker that runs dry steals the smallest remaining jobs
+ * of the others. Returns the number of jobs that failed.
+ */
+size_t batch_run(batch_t *batch, int threads, const asm_options_t *options) {
+
+	if (batch->count == 0)
+		return 0;
+
+	int worker_count = (batch->count < (size_t)threads) ? (int)batch->count : threads;
+	if (worker_count < 1)
+		worker_count = 1;
+
+	for (size_t i = 0; i < batch->count; i++) {
+		struct stat st;
+		batch->jobs[i].size = (stat(batch->jobs[i].in_path, &st) == 0) ? (size_t)st.st_size : 0;
+	}
+
+	batch_order_t *order = malloc(batch->count * sizeof(batch_order_t));
+	batch_queue_t *queues = calloc(worker_count, sizeof(batch_queue_t));
+	batch_worker_t *workers = calloc(worker_count, sizeof(batch_worker_t));
+	size_t per_worker = (batch->count + worker_count - 1) / worker_count;
+
+	int ready = (order != NULL && queues != NULL && workers != NULL);
+	for (int w = 0; ready && w < worker_count; w++)
+		ready = ((queues[w].items = malloc(per_worker * sizeof(size_t))) != NULL);
+
+	if (!ready) {
+		for (size_t i = 0; i < batch->count; i++) {
+			batch->jobs[i].status = -1;
+			batch->jobs[i].error = strdup("Out of memory");
+		}
+	}
+
+	else {
+
+		for (size_t i = 0; i < batch->count; i++)
+			order[i] = (batch_order_t){ batch->jobs[i].size, i };
+		qsort(order, batch->count, sizeof(batch_order_t), compare_size);
+
+		for (size_t i = 0; i < batch->count; i++) {
+			batch_queue_t *queue = &queues[i % worker_count];
+			queue->items[queue->tail++] = order[i].index;
+		}
+
+		batch_run_t run = { batch, options, queues, worker_count };
+		for (int w = 0; w < worker_count; w++)
+			pthread_mutex_init(&queues[w].lock, NULL);
+
+		// The calling thread is worker 0. If a thread cannot be started,
+		// the others steal its jobs.
+		for (int w = 0; w < worker_count; w++) {
+			workers[w].run = &run;
+			workers[w].id = w;
+			if (w > 0)
+				workers[w].started = (pthread_create(&workers[w].thread, NULL, batch_worker, &workers[w]) == 0);
+		}
+
+		batch_worker(&workers[0]);
+		for (int w = 1; w < worker_count; w++)
+			if (workers[w].started)
+				pthread_join(workers[w].thread, NULL);
+
+		for (int w = 0; w < worker_count; w++)
+			pthread_mutex_destroy(&queues[w].lock);
+	}
+
+	for (int w = 0; queues != NULL && w < worker_count; w++)
+		free(queues[w].items);
+	free(workers);
+	free(queues);
+	free(order);
+
+	size_t failed = 0;
+	for (size_t i = 0; i < batch->count; i++)
+		if (batch->jobs[i].status != 0)
+			failed++;
+	return failed;
+}
@@ -0,0 +1,37 @@
+/*
+ * batch.h
+ *
+ * Assembles many files in one process. Each worker thread keeps one context
+ * and reuses it for every file it assembles; files are dealt out largest
+ * first and idle workers steal from busy ones.
+ */
+
+#ifndef BATCH_H_
+#define BATCH_H_
+
+#include <stddef.h>
+#include "assemble.h"
+
+// One input and output file of a batch, and how assembling it went
+typedef struct {
+	char *in_path;
+	char *out_path;
+	size_t size;		// Input size in bytes, used to balance the workers
+	int status;			// 0 once assembled, -1 on error
+	char *error;		// Error message when status is -1
+	asm_stats_t stats;	// Counters and phase times of the file
+} batch_job_t;
+
+typedef struct {
+	batch_job_t *jobs;
+	size_t count;
+	size_t capacity;
+} batch_t;
+
+void batch_init(batch_t *batch);
+void batch_free(batch_t *batch);
+int batch_add(batch_t *batch, const char *pair);
+int batch_read_manifest(batch_t *batch, const char *path);
+size_t batch_run(batch_t *batch, int threads, const asm_options_t *options);
+
+#endif /* BATCH_H_ */
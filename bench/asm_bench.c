@@ -0,0 +1,289 @@
+/*
+ * asm_bench.c
+ *
+ * Times the assembler on each input file, phase by phase: loading the
+ * source, parse_file pass 1, pass 2 and writing the output. Every file is
+ * assembled several times in one reused context and the fastest time of
+ * each phase is kept. Throughput is reported as source lines and megabytes
+ * per second.
+ *
+ * The results can be saved as a baseline, and a later run checked against
+ * it: any phase more than the threshold slower than its baseline fails the
+ * run, so performance work can be measured and guarded. Phases that take
+ * under a millisecond are not checked, since their times are mostly noise.
+ * Baselines are only comparable on the same machine with the same inputs.
+ *
+ *     gcc -std=gnu99 -O2 -pthread -I. -o asm_bench bench/asm_bench.c $(ls *.c | grep -v assembler.c)
+ *     ./asm_bench --save=baseline.txt big.asm small.asm
+ *     ./asm_bench --check=baseline.txt --threshold=10 big.asm small.asm
+ *
+ * Options:
+ *     -r N              runs per file (default 5)
+ *     -j N              run the passes on N worker threads
+ *     --format=NAME     output format to time (default text)
+ *     --save=FILE       write the results to FILE as a baseline
+ *     --check=FILE      compare the results to the baseline in FILE
+ *     --threshold=PCT   slowdown that counts as a regression (default 10)
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "asm_context.h"
+#include "file_parser.h"
+#include "output.h"
+#include "source.h"
+#include "thread_pool.h"
+
+enum { PHASE_LOAD, PHASE_PASS1, PHASE_PASS2, PHASE_OUTPUT, PHASE_TOTAL, PHASE_COUNT };
+
+static const char *phase_names[PHASE_COUNT] = { "load", "pass1", "pass2", "output", "total" };
+
+// Longest file name kept in a baseline
+#define BENCH_NAME_LENGTH 256
+
+// Phases faster than this are too noisy to check against a baseline
+#define BENCH_MIN_CHECK_SECONDS 1e-3
+
+typedef struct {
+	int runs;
+	int jobs;
+	output_format_t format;
+	const char *save_path;
+	const char *check_path;
+	double threshold;
+} bench_options_t;
+
+// Fastest time of each phase for one file
+typedef struct {
+	const char *path;
+	size_t bytes;
+	size_t lines;
+	double seconds[PHASE_COUNT];
+} bench_result_t;
+
+static double now(void) {
+
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static double megabytes_per_second(const bench_result_t *result, int phase) {
+
+	return result->bytes / result->seconds[phase] / 1e6;
+}
+
+// Assemble one file runs times, keeping the fastest time of each phase
+static int bench_file(asm_context_t *ctx, FILE *Out, const bench_options_t *options, bench_result_t *result) {
+
+	for (int phase = 0; phase < PHASE_COUNT; phase++)
+		result->seconds[phase] = 1e30;
+
+	for (int run = 0; run < options->runs; run++) {
+
+		double times[PHASE_COUNT + 1];
+		source_t src;
+
+		if (asm_context_reset(ctx) != 0) {
+			printf("Out of memory\n");
+			return -1;
+		}
+
+		times[PHASE_LOAD] = now();
+		if (source_open(&src, result->path) != 0) {
+			printf("%s: could not be opened\n", result->path);
+			return -1;
+		}
+		times[PHASE_PASS1] = now();
+		int status = parse_file(&src, 1, ctx);
+		times[PHASE_PASS2] = now();
+		if (status == 0)
+			status = parse_file(&src, 2, ctx);
+		times[PHASE_OUTPUT] = now();
+		if (status == 0 && output_write(&ctx->output, options->format, 1, Out) != 0)
+			status = asm_error(ctx, "Output could not be written.");
+		fflush(Out);
+		times[PHASE_OUTPUT + 1] = now();
+
+		if (run == 0) {
+			result->bytes = src.len;
+			result->lines = 0;
+			for (const char *ptr = src.data, *end = src.data + src.len; ptr < end; result->lines++) {
+				const char *newline = memchr(ptr, '\n', end - ptr);
+				ptr = (newline != NULL) ? newline + 1 : end;
+			}
+		}
+		source_close(&src);
+
+		if (status != 0) {
+			printf("%s: %s\n", result->path, ctx->error);
+			return -1;
+		}
+
+		for (int phase = PHASE_LOAD; phase <= PHASE_OUTPUT; phase++)
+			if (times[phase + 1] - times[phase] < result->seconds[phase])
+				result->seconds[phase] = times[phase + 1] - times[phase];
+		if (times[PHASE_OUTPUT + 1] - times[PHASE_LOAD] < result->seconds[PHASE_TOTAL])
+			result->seconds[PHASE_TOTAL] = times[PHASE_OUTPUT + 1] - times[PHASE_LOAD];
+	}
+
+	return 0;
+}
+
+static void print_result(const bench_result_t *result) {
+
+	printf("%s: %zu lines, %.1f MB\n", result->path, result->lines, result->bytes / 1e6);
+	for (int phase = 0; phase < PHASE_COUNT; phase++)
+		printf("  %-7s %10.3f ms %14.0f lines/s %10.1f MB/s\n", phase_names[phase],
+				result->seconds[phase] * 1e3, result->lines / result->seconds[phase],
+				megabytes_per_second(result, phase));
+}
+
+static int save_baseline(const char *path, const bench_result_t *results, int count) {
+
+	FILE *Baseline = fopen(path, "w");
+	if (Baseline == NULL)
+		return -1;
+
+	for (int i = 0; i < count; i++)
+		for (int phase = 0; phase < PHASE_COUNT; phase++)
+			fprintf(Baseline, "%s %s %.3f\n", results[i].path, phase_names[phase],
+					megabytes_per_second(&results[i], phase));
+
+	return (fclose(Baseline) == 0) ? 0 : -1;
+}
+
+/*
+ * Compare the results to a saved baseline. Returns the number of
+ * regressions, or -1 if the baseline could not be read.
+ */
+static int check_baseline(const char *path, const bench_result_t *results, int count, double threshold) {
+
+	FILE *Baseline = fopen(path, "r");
+	if (Baseline == NULL)
+		return -1;
+
+	char name[BENCH_NAME_LENGTH], phase_name[16];
+	double baseline;
+	int regressions = 0;
+
+	while (fscanf(Baseline, "%255s %15s %lf", name, phase_name, &baseline) == 3) {
+
+		for (int i = 0; i < count; i++) {
+			if (strcmp(results[i].path, name) != 0)
+				continue;
+
+			for (int phase = 0; phase < PHASE_COUNT; phase++) {
+				if (strcmp(phase_names[phase], phase_name) != 0
+						|| results[i].seconds[phase] < BENCH_MIN_CHECK_SECONDS)
+					continue;
+
+				double current = megabytes_per_second(&results[i], phase);
+				double change = (current - baseline) / baseline * 100;
+				if (change < -threshold) {
+					printf("REGRESSION %s %s: %.1f MB/s, baseline %.1f MB/s (%+.1f%%)\n",
+							name, phase_name, current, baseline, change);
+					regressions++;
+				}
+			}
+		}
+	}
+
+	fclose(Baseline);
+	return regressions;
+}
+
+int main (int argc, char *argv[]) {
+
+	bench_options_t options = { 5, 1, FORMAT_TEXT, NULL, NULL, 10 };
+	const char **files = malloc(argc * sizeof(char *));
+	int file_count = 0;
+
+	if (files == NULL) {
+		printf("Out of memory\n");
+		exit(1);
+	}
+
+	for (int i = 1; i < argc; i++) {
+
+		if (strcmp(argv[i], "-r") == 0 && i + 1 < argc)
+			options.runs = atoi(argv[++i]);
+		else if (strcmp(argv[i], "-j") == 0 && i + 1 < argc)
+			options.jobs = atoi(argv[++i]);
+		else if (strncmp(argv[i], "--format=", 9) == 0) {
+			if (output_parse_format(argv[i] + 9, &options.format) != 0) {
+				printf("Unknown output format %s\n", argv[i] + 9);
+				exit(1);
+			}
+		}
+		else if (strncmp(argv[i], "--save=", 7) == 0)
+			options.save_path = argv[i] + 7;
+		else if (strncmp(argv[i], "--check=", 8) == 0)
+			options.check_path = argv[i] + 8;
+		else if (strncmp(argv[i], "--threshold=", 12) == 0)
+			options.threshold = atof(argv[i] + 12);
+		else if (argv[i][0] == '-') {
+			printf("Unknown option %s\n", argv[i]);
+			exit(1);
+		}
+		else
+			files[file_count++] = argv[i];
+	}
+
+	if (file_count == 0 || options.runs < 1 || options.jobs < 1) {
+		printf("usage: asm_bench [-r runs] [-j threads] [--format=name] [--save=file | --check=file [--threshold=pct]] file.asm...\n");
+		exit(1);
+	}
+
+	asm_context_t ctx;
+	thread_pool_t *pool = NULL;
+	FILE *Out = fopen("/dev/null", "w");
+	bench_result_t *results = calloc(file_count, sizeof(bench_result_t));
+
+	if (Out == NULL || results == NULL || asm_context_init(&ctx) != 0) {
+		printf("Out of memory\n");
+		exit(1);
+	}
+
+	if (options.jobs > 1) {
+		pool = thread_pool_create(options.jobs);
+		if (pool == NULL) {
+			printf("Worker threads could not be started.\n");
+			exit(1);
+		}
+		ctx.pool = pool;
+	}
+
+	int status = 0;
+	for (int i = 0; i < file_count && status == 0; i++) {
+		results[i].path = files[i];
+		status = bench_file(&ctx, Out, &options, &results[i]);
+		if (status == 0)
+			print_result(&results[i]);
+	}
+
+	if (status == 0 && options.save_path != NULL && save_baseline(options.save_path, results, file_count) != 0) {
+		printf("Baseline %s could not be written.\n", options.save_path);
+		status = -1;
+	}
+
+	if (status == 0 && options.check_path != NULL) {
+		int regressions = check_baseline(options.check_path, results, file_count, options.threshold);
+		if (regressions < 0)
+			printf("Baseline %s could not be read.\n", options.check_path);
+		else if (regressions == 0)
+			printf("No regressions beyond %.0f%%\n", options.threshold);
+		if (regressions != 0)
+			status = -1;
+	}
+
+	asm_context_free(&ctx);
+	if (pool != NULL)
+		thread_pool_destroy(pool);
+	fclose(Out);
+	free(results);
+	free(files);
+
+	return (status == 0) ? 0 : 1;
+}
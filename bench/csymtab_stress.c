@@ -0,0 +1,255 @@
+/*
+ * csymtab_stress.c
+ *
+ * Stress test of the concurrent symbol table. Threads released together
+ * intern the same names in different orders into a table that starts small,
+ * so inserts race each other and the index grows many times under them.
+ * While interning, they find names other threads may be inserting and
+ * define most names with priorities that interleave across the threads.
+ * Once they are joined, every name must have exactly one live entry, every
+ * id any thread got for it must be that entry, and its value must come
+ * from the definer with the lowest priority. The exit status is 1 on any
+ * mismatch.
+ *
+ *     gcc -std=gnu99 -O2 -pthread -I. -o csymtab_stress bench/csymtab_stress.c
+ *     ./csymtab_stress --threads=16 --names=200000 --rounds=50
+ *
+ * Build with -fsanitize=thread to have the memory orderings checked too.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <time.h>
+#include "csymtab.h"
+
+// Names the threads work on together
+#define STRESS_WINDOW 64
+
+// One name in STRESS_UNDEFINED is interned but never defined
+#define STRESS_UNDEFINED 7
+
+typedef struct {
+	char **names;
+	uint32_t *lens;
+	uint32_t name_count;
+	int thread_count;
+	csymtab_t *csymtab;
+	pthread_barrier_t start;
+} stress_run_t;
+
+typedef struct {
+	stress_run_t *run;
+	int id;
+	uint32_t *ids;		// Id the thread got for each name
+	uint32_t *found;	// Id it found for each name while others were inserting, or CSYMTAB_NONE
+	uint32_t failures;	// Lookups that missed a name the thread had already interned
+	pthread_t thread;
+} stress_thread_t;
+
+// Priority of a definition; a bijection of (name, thread), so no two definitions tie
+static uint32_t stress_priority(const stress_run_t *run, uint32_t name, int thread) {
+
+	return (name * (uint32_t)run->thread_count + thread) * 0x9e3779b1u;
+}
+
+// Whether a thread defines a name; every defined name has several definers
+static int stress_defines(uint32_t name, int thread) {
+
+	return name % STRESS_UNDEFINED != 0 && (name + thread) % 3 != 0;
+}
+
+static void *stress_worker(void *arg) {
+
+	stress_thread_t *worker = arg;
+	stress_run_t *run = worker->run;
+	uint32_t count = run->name_count;
+
+	pthread_barrier_wait(&run->start);
+
+	// Every thread visits every name. The threads walk the same windows in
+	// the same order, each through a window in its own order, so they keep
+	// meeting on the same few names.
+	for (uint32_t i = 0; i < count; i++) {
+
+		uint32_t window = i - i % STRESS_WINDOW;
+		uint32_t width = (count - window < STRESS_WINDOW) ? count - window : STRESS_WINDOW;
+		uint32_t step = (i % STRESS_WINDOW + (uint32_t)worker->id * 5) % width;
+		uint32_t name = window + ((worker->id % 2 == 0) ? step : width - 1 - step);
+
+		uint32_t id = csymtab_intern(run->csymtab, run->names[name], run->lens[name]);
+		worker->ids[name] = id;
+		if (id == CSYMTAB_NONE)
+			continue;
+
+		if (csymtab_find(run->csymtab, run->names[name], run->lens[name]) != id)
+			worker->failures++;
+
+		if (stress_defines(name, worker->id))
+			csymtab_define(run->csymtab, id, worker->id, stress_priority(run, name, worker->id));
+
+		// A name in the next window, which other threads may be inserting right now
+		uint32_t other = (name + STRESS_WINDOW) % count;
+		worker->found[other] = csymtab_find(run->csymtab, run->names[other], run->lens[other]);
+	}
+
+	return NULL;
+}
+
+// Check the table after the threads are joined; returns the number of errors
+static uint32_t stress_check(const stress_run_t *run, stress_thread_t *workers) {
+
+	const csymtab_t *csymtab = run->csymtab;
+	uint32_t errors = 0;
+
+	for (uint32_t name = 0; name < run->name_count; name++) {
+
+		uint32_t id = csymtab_find(csymtab, run->names[name], run->lens[name]);
+		if (id == CSYMTAB_NONE) {
+			errors++;
+			continue;
+		}
+
+		for (int t = 0; t < run->thread_count; t++)
+			if (workers[t].ids[name] != id || (workers[t].found[name] != CSYMTAB_NONE && workers[t].found[name] != id))
+				errors++;
+
+		// The lowest priority definition wins, whatever order they came in
+		int definer = -1;
+		for (int t = 0; t < run->thread_count; t++)
+			if (stress_defines(name, t) && (definer < 0
+					|| stress_priority(run, name, t) < stress_priority(run, name, definer)))
+				definer = t;
+
+		uint32_t value;
+		int defined = csymtab_value(csymtab, id, &value);
+		if (definer < 0 ? defined : (!defined || value != (uint32_t)definer))
+			errors++;
+	}
+
+	// Entries that lost a race are dead; exactly one live entry remains per name
+	uint32_t live = 0;
+	for (uint32_t id = 0; id < csymtab_count(csymtab); id++) {
+		const csymtab_entry_t *entry = csymtab_entry(csymtab, id);
+		if (!entry->live)
+			continue;
+		live++;
+		if (csymtab_find(csymtab, entry->key, entry->key_len) != id)
+			errors++;
+	}
+	if (live != run->name_count)
+		errors++;
+
+	for (int t = 0; t < run->thread_count; t++)
+		errors += workers[t].failures;
+	return errors;
+}
+
+int main (int argc, char *argv[]) {
+
+	int thread_count = 8;
+	uint32_t name_count = 100000;
+	int rounds = 20;
+
+	for (int i = 1; i < argc; i++) {
+		if (strncmp(argv[i], "--threads=", 10) == 0)
+			thread_count = atoi(argv[i] + 10);
+		else if (strncmp(argv[i], "--names=", 8) == 0)
+			name_count = strtoul(argv[i] + 8, NULL, 10);
+		else if (strncmp(argv[i], "--rounds=", 9) == 0)
+			rounds = atoi(argv[i] + 9);
+		else {
+			printf("Unknown option %s\n", argv[i]);
+			exit(1);
+		}
+	}
+
+	if (thread_count < 2 || name_count == 0 || rounds < 1) {
+		printf("Needs at least 2 threads, 1 name and 1 round\n");
+		exit(1);
+	}
+
+	stress_run_t run;
+	run.name_count = name_count;
+	run.thread_count = thread_count;
+	run.names = malloc(name_count * sizeof(char *));
+	run.lens = malloc(name_count * sizeof(uint32_t));
+	stress_thread_t *workers = calloc(thread_count, sizeof(stress_thread_t));
+	if (run.names == NULL || run.lens == NULL || workers == NULL) {
+		printf("Out of memory\n");
+		exit(1);
+	}
+
+	// Names shaped like compiler labels; keys are not copied, so they live for the whole run
+	for (uint32_t i = 0; i < name_count; i++) {
+		char name[32];
+		run.lens[i] = snprintf(name, sizeof(name), "L%s_%u", (i % 2) ? "oop" : "bb", i);
+		run.names[i] = strdup(name);
+		if (run.names[i] == NULL) {
+			printf("Out of memory\n");
+			exit(1);
+		}
+	}
+
+	for (int t = 0; t < thread_count; t++) {
+		workers[t].run = &run;
+		workers[t].id = t;
+		workers[t].ids = malloc(name_count * sizeof(uint32_t));
+		workers[t].found = malloc(name_count * sizeof(uint32_t));
+		if (workers[t].ids == NULL || workers[t].found == NULL) {
+			printf("Out of memory\n");
+			exit(1);
+		}
+	}
+
+	struct timespec begin, end;
+	clock_gettime(CLOCK_MONOTONIC, &begin);
+	uint32_t errors = 0;
+
+	for (int round = 0; round < rounds; round++) {
+
+		// Room for 16 names, so the index grows about log2(names / 16) times during the round
+		run.csymtab = csymtab_create(16);
+		if (run.csymtab == NULL) {
+			printf("Out of memory\n");
+			exit(1);
+		}
+		pthread_barrier_init(&run.start, NULL, thread_count);
+
+		for (int t = 0; t < thread_count; t++) {
+			memset(workers[t].found, 0xff, name_count * sizeof(uint32_t));
+			workers[t].failures = 0;
+			if (pthread_create(&workers[t].thread, NULL, stress_worker, &workers[t]) != 0) {
+				printf("Thread could not be started\n");
+				exit(1);
+			}
+		}
+		for (int t = 0; t < thread_count; t++)
+			pthread_join(workers[t].thread, NULL);
+
+		uint32_t round_errors = stress_check(&run, workers);
+		if (round_errors != 0)
+			printf("round %d: %u errors\n", round, round_errors);
+		errors += round_errors;
+
+		pthread_barrier_destroy(&run.start);
+		csymtab_destroy(run.csymtab);
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	double seconds = (end.tv_sec - begin.tv_sec) + (end.tv_nsec - begin.tv_nsec) * 1e-9;
+	printf("%d rounds of %d threads x %u names: %s, %.1f M interns/s\n", rounds, thread_count, name_count,
+			(errors == 0) ? "ok" : "FAILED", (double)rounds * thread_count * name_count / seconds / 1e6);
+
+	for (int t = 0; t < thread_count; t++) {
+		free(workers[t].ids);
+		free(workers[t].found);
+	}
+	for (uint32_t i = 0; i < name_count; i++)
+		free(run.names[i]);
+	free(run.names);
+	free(run.lens);
+	free(workers);
+	return (errors == 0) ? 0 : 1;
+}
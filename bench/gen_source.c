@@ -0,0 +1,331 @@
+/*
+ * gen_source.c
+ *
+ * Writes a synthetic assembly program for benchmarking: a text section with
+ * a configurable mix of the supported mnemonics, labels, and branches that
+ * jump back to recent labels or forward to ones further down, followed by a
+ * data section of .word values, .word arrays and .asciiz strings. The same
+ * options and seed always give the same program.
+ *
+ *     gcc -std=gnu99 -O2 -o gen_source bench/gen_source.c
+ *     ./gen_source --size=64M --seed=3 -o big.asm
+ *
+ * Options:
+ *     --size=N[K|M|G]   approximate size of the program in bytes (default 1M)
+ *     --seed=N          random seed (default 1)
+ *     --mix=op:w,...    relative weight of each mnemonic; unlisted ones keep the default
+ *     --labels=P        chance that an instruction is preceded by a label (default 0.05)
+ *     --forward=P       share of branches and jumps to a label further down (default 0.5)
+ *     --data=P          share of the program spent on the data section (default 0.1)
+ *     --strings=P       share of data items that are .asciiz strings (default 0.3)
+ *     --arrays=P        share of .word items that are arrays (default 0.3)
+ *     -o FILE           write to FILE instead of stdout
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+// Labels a branch may reach back or forward over
+#define LABEL_WINDOW 16
+
+// Average size of a data item, used to size the set of data labels
+#define DATA_ITEM_BYTES 24
+
+typedef struct {
+	const char *name;
+	double weight;
+} mnemonic_t;
+
+// Roughly the mix of compiled integer code: loads, stores and adds dominate
+static mnemonic_t mnemonics[] = {
+	{ "lw", 14 }, { "sw", 10 }, { "addi", 12 }, { "add", 8 }, { "sub", 3 },
+	{ "and", 2 }, { "or", 3 }, { "andi", 2 }, { "ori", 3 }, { "slt", 3 },
+	{ "slti", 2 }, { "sll", 4 }, { "srl", 2 }, { "lui", 3 }, { "la", 4 },
+	{ "beq", 8 }, { "j", 4 }, { "jal", 4 }, { "jr", 3 }, { "nop", 2 },
+};
+#define MNEMONIC_COUNT (sizeof(mnemonics) / sizeof(mnemonics[0]))
+
+static const char *registers[] = {
+	"$zero", "$at", "$v0", "$v1", "$a0", "$a1", "$a2", "$a3", "$t0", "$t1", "$t2", "$t3",
+	"$t4", "$t5", "$t6", "$t7", "$s0", "$s1", "$s2", "$s3", "$s4", "$s5", "$s6", "$s7",
+	"$t8", "$t9", "$gp", "$sp", "$fp", "$ra", "$8", "$31",
+};
+#define REGISTER_COUNT (sizeof(registers) / sizeof(registers[0]))
+
+typedef struct {
+	uint64_t size;
+	uint64_t seed;
+	double labels;
+	double forward;
+	double data;
+	double strings;
+	double arrays;
+	const char *out_path;
+} gen_options_t;
+
+static uint64_t random_state;
+
+// xorshift64*
+static uint64_t next_random(void) {
+
+	random_state ^= random_state >> 12;
+	random_state ^= random_state << 25;
+	random_state ^= random_state >> 27;
+	return random_state * 0x2545f4914f6cdd1dull;
+}
+
+static uint32_t random_below(uint32_t n) {
+
+	return (uint32_t)(((next_random() >> 32) * n) >> 32);
+}
+
+static double random_unit(void) {
+
+	return (next_random() >> 11) * (1.0 / 9007199254740992.0);
+}
+
+static const char *random_register(void) {
+
+	return registers[random_below(REGISTER_COUNT)];
+}
+
+// Parse a size with an optional K, M or G suffix
+static int parse_size(const char *text, uint64_t *size) {
+
+	char *end;
+	unsigned long long value = strtoull(text, &end, 10);
+
+	switch (*end) {
+	case 'K': case 'k': value <<= 10; end++; break;
+	case 'M': case 'm': value <<= 20; end++; break;
+	case 'G': case 'g': value <<= 30; end++; break;
+	}
+
+	if (end == text || *end != '\0' || value == 0)
+		return -1;
+	*size = value;
+	return 0;
+}
+
+// Parse op:weight pairs separated by commas
+static int parse_mix(const char *text) {
+
+	while (*text != '\0') {
+
+		const char *colon = strchr(text, ':');
+		if (colon == NULL)
+			return -1;
+
+		size_t i;
+		for (i = 0; i < MNEMONIC_COUNT; i++)
+			if (strlen(mnemonics[i].name) == (size_t)(colon - text) && strncmp(mnemonics[i].name, text, colon - text) == 0)
+				break;
+		if (i == MNEMONIC_COUNT)
+			return -1;
+
+		char *end;
+		mnemonics[i].weight = strtod(colon + 1, &end);
+		if (end == colon + 1 || mnemonics[i].weight < 0)
+			return -1;
+
+		text = (*end == ',') ? end + 1 : end;
+		if (*end != ',' && *end != '\0')
+			return -1;
+	}
+
+	return 0;
+}
+
+static int parse_fraction(const char *text, double *value) {
+
+	char *end;
+	*value = strtod(text, &end);
+	return (end == text || *end != '\0' || *value < 0 || *value > 1) ? -1 : 0;
+}
+
+static int parse_options(int argc, char *argv[], gen_options_t *options) {
+
+	for (int i = 1; i < argc; i++) {
+
+		const char *arg = argv[i];
+		int status = 0;
+
+		if (strncmp(arg, "--size=", 7) == 0)
+			status = parse_size(arg + 7, &options->size);
+		else if (strncmp(arg, "--seed=", 7) == 0)
+			options->seed = strtoull(arg + 7, NULL, 10);
+		else if (strncmp(arg, "--mix=", 6) == 0)
+			status = parse_mix(arg + 6);
+		else if (strncmp(arg, "--labels=", 9) == 0)
+			status = parse_fraction(arg + 9, &options->labels);
+		else if (strncmp(arg, "--forward=", 10) == 0)
+			status = parse_fraction(arg + 10, &options->forward);
+		else if (strncmp(arg, "--data=", 7) == 0)
+			status = parse_fraction(arg + 7, &options->data);
+		else if (strncmp(arg, "--strings=", 10) == 0)
+			status = parse_fraction(arg + 10, &options->strings);
+		else if (strncmp(arg, "--arrays=", 9) == 0)
+			status = parse_fraction(arg + 9, &options->arrays);
+		else if (strcmp(arg, "-o") == 0 && i + 1 < argc)
+			options->out_path = argv[++i];
+		else
+			status = -1;
+
+		if (status != 0) {
+			printf("Invalid option %s\n", arg);
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+// Pick a mnemonic by weight
+static const char *random_mnemonic(double total) {
+
+	double pick = random_unit() * total;
+	for (size_t i = 0; i < MNEMONIC_COUNT; i++) {
+		if (pick < mnemonics[i].weight)
+			return mnemonics[i].name;
+		pick -= mnemonics[i].weight;
+	}
+	return mnemonics[MNEMONIC_COUNT - 1].name;
+}
+
+/*
+ * Write the target of a branch or jump: a recent label behind it, or one of
+ * the next few labels ahead. Forward targets are remembered so that every
+ * one is defined before the text section ends.
+ */
+static int branch_target(char *dst, size_t size, const gen_options_t *options,
+		uint64_t defined, uint64_t *furthest) {
+
+	uint64_t label;
+
+	if (defined == 0 || random_unit() < options->forward) {
+		label = defined + random_below(LABEL_WINDOW);
+		if (label + 1 > *furthest)
+			*furthest = label + 1;
+	}
+	else
+		label = defined - 1 - random_below(defined < LABEL_WINDOW ? defined : LABEL_WINDOW);
+
+	return snprintf(dst, size, "L%llu", (unsigned long long)label);
+}
+
+static int write_instruction(FILE *Out, const char *op, const gen_options_t *options,
+		uint64_t defined, uint64_t *furthest, uint64_t data_labels) {
+
+	char target[32];
+
+	if (strcmp(op, "add") == 0 || strcmp(op, "sub") == 0 || strcmp(op, "and") == 0
+			|| strcmp(op, "or") == 0 || strcmp(op, "slt") == 0)
+		return fprintf(Out, "\t%s %s, %s, %s", op, random_register(), random_register(), random_register());
+
+	if (strcmp(op, "addi") == 0 || strcmp(op, "slti") == 0)
+		return fprintf(Out, "\t%s %s, %s, %d", op, random_register(), random_register(), (int)random_below(2001) - 1000);
+
+	if (strcmp(op, "andi") == 0 || strcmp(op, "ori") == 0)
+		return fprintf(Out, "\t%s %s, %s, %u", op, random_register(), random_register(), random_below(65536));
+
+	if (strcmp(op, "sll") == 0 || strcmp(op, "srl") == 0)
+		return fprintf(Out, "\t%s %s, %s, %u", op, random_register(), random_register(), random_below(32));
+
+	if (strcmp(op, "lw") == 0 || strcmp(op, "sw") == 0)
+		return fprintf(Out, "\t%s %s, %u(%s)", op, random_register(), random_below(64) * 4, random_register());
+
+	if (strcmp(op, "lui") == 0)
+		return fprintf(Out, "\tlui %s, %u", random_register(), random_below(65536));
+
+	if (strcmp(op, "la") == 0)
+		return fprintf(Out, "\tla %s, d%u", random_register(), random_below(data_labels));
+
+	if (strcmp(op, "jr") == 0)
+		return fprintf(Out, "\tjr %s", random_register());
+
+	if (strcmp(op, "nop") == 0)
+		return fprintf(Out, "\tnop");
+
+	branch_target(target, sizeof(target), options, defined, furthest);
+	if (strcmp(op, "beq") == 0)
+		return fprintf(Out, "\tbeq %s, %s, %s", random_register(), random_register(), target);
+
+	return fprintf(Out, "\t%s %s", op, target);
+}
+
+static int write_data_item(FILE *Out, const gen_options_t *options, uint64_t label) {
+
+	if (random_unit() < options->strings) {
+
+		char text[48];
+		uint32_t len = random_below(sizeof(text) - 1);
+		for (uint32_t i = 0; i < len; i++)
+			text[i] = "abcdefghijklmnopqrstuvwxyz    "[random_below(30)];
+		text[len] = '\0';
+		return fprintf(Out, "d%llu: .asciiz \"%s\"\n", (unsigned long long)label, text);
+	}
+
+	if (random_unit() < options->arrays)
+		return fprintf(Out, "d%llu: .word %d:%u\n", (unsigned long long)label,
+				(int)random_below(2001) - 1000, random_below(16) + 1);
+
+	return fprintf(Out, "d%llu: .word %d\n", (unsigned long long)label, (int)random_below(2001) - 1000);
+}
+
+int main (int argc, char *argv[]) {
+
+	gen_options_t options = { 1 << 20, 1, 0.05, 0.5, 0.1, 0.3, 0.3, NULL };
+
+	if (parse_options(argc, argv, &options) != 0)
+		exit(1);
+
+	double total = 0;
+	for (size_t i = 0; i < MNEMONIC_COUNT; i++)
+		total += mnemonics[i].weight;
+	if (total <= 0) {
+		printf("The mix needs at least one mnemonic\n");
+		exit(1);
+	}
+
+	FILE *Out = (options.out_path != NULL) ? fopen(options.out_path, "w") : stdout;
+	if (Out == NULL) {
+		printf("Output file could not be opened.\n");
+		exit(1);
+	}
+	setvbuf(Out, NULL, _IOFBF, 1 << 20);
+
+	random_state = options.seed * 0x9e3779b97f4a7c15ull + 1;
+
+	uint64_t text_bytes = (uint64_t)(options.size * (1 - options.data));
+	uint64_t data_labels = (options.size - text_bytes) / DATA_ITEM_BYTES + 1;
+	uint64_t written = 0, defined = 0, furthest = 0;
+
+	written += fprintf(Out, ".text\nmain:\n");
+
+	while (written < text_bytes) {
+
+		if (random_unit() < options.labels)
+			written += fprintf(Out, "L%llu:\n", (unsigned long long)defined++);
+
+		written += write_instruction(Out, random_mnemonic(total), &options, defined, &furthest, data_labels);
+		if (random_below(10) == 0)
+			written += fprintf(Out, "  # comment");
+		written += fprintf(Out, "\n");
+	}
+
+	// Define the labels that forward branches still wait for
+	while (defined < furthest)
+		written += fprintf(Out, "L%llu:\n", (unsigned long long)defined++);
+	written += fprintf(Out, "\tjr $ra\n.data\n");
+
+	for (uint64_t label = 0; label < data_labels || written < options.size; label++)
+		written += write_data_item(Out, &options, label);
+
+	if (fclose(Out) != 0) {
+		printf("Output file could not be written.\n");
+		exit(1);
+	}
+
+	return 0;
+}
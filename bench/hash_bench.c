@@ -0,0 +1,262 @@
+/*
+ * hash_bench.c
+ *
+ * Compares the symbol hash functions on label sets: throughput, and how
+ * evenly the hashes spread over a power-of-two table like the one symtab
+ * indexes with the low bits. Labels are read from the assembly files given
+ * on the command line; with none, a synthetic set shaped like compiler
+ * output is used.
+ *
+ *     gcc -std=gnu99 -O2 -I. -o hash_bench bench/hash_bench.c
+ *     ./hash_bench prog1.asm prog2.asm
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <ctype.h>
+#include <time.h>
+#include "hash_function.h"
+
+// Hash every label at least this many times when timing
+#define BENCH_MIN_HASHES 20000000
+
+// Keeps the timed hashes from being optimized away
+static volatile uint32_t sink;
+
+typedef struct {
+	const char *name;
+	hash_function_t function;
+} bench_hash_t;
+
+static const bench_hash_t hashes[] = {
+	{ "lookup2", hash_lookup2 },
+	{ "wyhash", hash_wy },
+};
+
+typedef struct {
+	char **keys;
+	uint32_t *lens;
+	size_t count;
+	size_t capacity;
+	size_t bytes;
+} label_set_t;
+
+static int add_label(label_set_t *set, const char *key, size_t len) {
+
+	if (set->count == set->capacity) {
+		size_t capacity = set->capacity ? set->capacity * 2 : 1024;
+		char **keys = realloc(set->keys, capacity * sizeof(char *));
+		uint32_t *lens = realloc(set->lens, capacity * sizeof(uint32_t));
+		if (keys != NULL)
+			set->keys = keys;
+		if (lens != NULL)
+			set->lens = lens;
+		if (keys == NULL || lens == NULL)
+			return -1;
+		set->capacity = capacity;
+	}
+
+	char *copy = malloc(len);
+	if (copy == NULL)
+		return -1;
+	memcpy(copy, key, len);
+
+	set->keys[set->count] = copy;
+	set->lens[set->count] = len;
+	set->count++;
+	set->bytes += len;
+	return 0;
+}
+
+// Add the label defined at the start of each line of an assembly file
+static int read_labels(label_set_t *set, const char *path) {
+
+	FILE *In = fopen(path, "r");
+	if (In == NULL)
+		return -1;
+
+	char *line = NULL;
+	size_t capacity = 0;
+	ssize_t len;
+
+	while ((len = getline(&line, &capacity, In)) != -1) {
+
+		const char *start = line;
+		while (isspace((unsigned char)*start))
+			start++;
+
+		const char *end = start;
+		while (*end != '\0' && !isspace((unsigned char)*end) && *end != ':')
+			end++;
+
+		if (*end == ':' && end > start && add_label(set, start, end - start) != 0)
+			break;
+	}
+
+	free(line);
+	fclose(In);
+	return 0;
+}
+
+// Labels shaped like compiler output: numbered local labels and longer function names
+static int synthetic_labels(label_set_t *set, size_t count) {
+
+	static const char *words[] = { "parse", "emit", "node", "list", "init", "free", "read", "table" };
+	char key[64];
+
+	for (size_t i = 0; i < count; i++) {
+		int len;
+		if (i % 4 != 0)
+			len = snprintf(key, sizeof(key), ".LBB%zu_%zu", i / 64, i % 64);
+		else
+			len = snprintf(key, sizeof(key), "%s_%s_%zu", words[i % 7], words[(i / 7) % 8], i);
+		if (add_label(set, key, len) != 0)
+			return -1;
+	}
+
+	return 0;
+}
+
+typedef struct {
+	char *key;
+	uint32_t len;
+} label_t;
+
+static int compare_labels(const void *a, const void *b) {
+
+	const label_t *x = a, *y = b;
+	if (x->len != y->len)
+		return (x->len > y->len) - (x->len < y->len);
+	return memcmp(x->key, y->key, x->len);
+}
+
+// Drop repeated labels, which files assembled together often share
+static int unique_labels(label_set_t *set) {
+
+	label_t *labels = malloc(set->count * sizeof(label_t));
+	if (labels == NULL)
+		return -1;
+
+	for (size_t i = 0; i < set->count; i++)
+		labels[i] = (label_t){ set->keys[i], set->lens[i] };
+	qsort(labels, set->count, sizeof(label_t), compare_labels);
+
+	size_t count = 0;
+	set->bytes = 0;
+	for (size_t i = 0; i < set->count; i++) {
+		if (count > 0 && compare_labels(&labels[i], &labels[count - 1]) == 0) {
+			free(labels[i].key);
+			continue;
+		}
+		labels[count++] = labels[i];
+	}
+
+	for (size_t i = 0; i < count; i++) {
+		set->keys[i] = labels[i].key;
+		set->lens[i] = labels[i].len;
+		set->bytes += labels[i].len;
+	}
+	set->count = count;
+
+	free(labels);
+	return 0;
+}
+
+static double now(void) {
+
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static int compare_hashes(const void *a, const void *b) {
+
+	uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+	return (x > y) - (x < y);
+}
+
+static void bench(const bench_hash_t *h, const label_set_t *set, uint32_t *values) {
+
+	// Throughput over enough rounds to time reliably
+	size_t rounds = BENCH_MIN_HASHES / set->count + 1;
+	uint32_t sum = 0;
+	double start = now();
+	for (size_t r = 0; r < rounds; r++)
+		for (size_t i = 0; i < set->count; i++)
+			sum += h->function(set->keys[i], set->lens[i], 7);
+	double elapsed = now() - start;
+	sink = sum;
+
+	// Distribution over a table of the next power of two, indexed by the low bits
+	size_t slots = 16;
+	while (slots < set->count)
+		slots <<= 1;
+	uint32_t *counts = calloc(slots, sizeof(uint32_t));
+	if (counts == NULL)
+		return;
+
+	for (size_t i = 0; i < set->count; i++) {
+		values[i] = h->function(set->keys[i], set->lens[i], 7);
+		counts[values[i] & (slots - 1)]++;
+	}
+
+	double expected = (double)set->count / slots, chi2 = 0;
+	uint32_t longest = 0;
+	for (size_t s = 0; s < slots; s++) {
+		chi2 += (counts[s] - expected) * (counts[s] - expected) / expected;
+		if (counts[s] > longest)
+			longest = counts[s];
+	}
+	free(counts);
+
+	// Full 32-bit collisions, against what a random function would give
+	qsort(values, set->count, sizeof(uint32_t), compare_hashes);
+	size_t collisions = 0;
+	for (size_t i = 1; i < set->count; i++)
+		if (values[i] == values[i - 1])
+			collisions++;
+	double random_collisions = (double)set->count * (set->count - 1) / 2 / 4294967296.0;
+
+	printf("%-8s %8.2f ns/key %8.1f MB/s   chi2/df %6.3f   longest %3u   collisions %zu (random %.1f)\n",
+			h->name, elapsed * 1e9 / (rounds * set->count), rounds * set->bytes / elapsed / 1e6,
+			chi2 / (slots - 1), longest, collisions, random_collisions);
+}
+
+int main (int argc, char *argv[]) {
+
+	label_set_t set = { NULL, NULL, 0, 0, 0 };
+
+	for (int i = 1; i < argc; i++)
+		if (read_labels(&set, argv[i]) != 0) {
+			printf("%s could not be read\n", argv[i]);
+			exit(1);
+		}
+
+	if ((argc == 1 && synthetic_labels(&set, 100000) != 0) || unique_labels(&set) != 0) {
+		printf("Out of memory\n");
+		exit(1);
+	}
+
+	if (set.count == 0) {
+		printf("No labels found\n");
+		exit(1);
+	}
+
+	uint32_t *values = malloc(set.count * sizeof(uint32_t));
+	if (values == NULL) {
+		printf("Out of memory\n");
+		exit(1);
+	}
+
+	printf("%zu labels, %.1f bytes on average\n", set.count, (double)set.bytes / set.count);
+	for (size_t h = 0; h < sizeof(hashes) / sizeof(hashes[0]); h++)
+		bench(&hashes[h], &set, values);
+
+	free(values);
+	for (size_t i = 0; i < set.count; i++)
+		free(set.keys[i]);
+	free(set.keys);
+	free(set.lens);
+	return 0;
+}
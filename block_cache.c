@@ -0,0 +1,364 @@
+/*
+ * block_cache.c
+ *
+ * Loading, building and saving the cache sidecar of the incremental mode.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "block_cache.h"
+
+// Start of a sidecar; the arrays follow in this order, then the name pool
+typedef struct {
+	char magic[8];
+	uint32_t version;
+	uint32_t op_count;		// Opcodes of the instruction set the records were lexed with
+	uint32_t record_size;
+	uint32_t hash_check;	// symtab_hash() of the magic, which changes with HASH_DEFAULT
+	uint64_t block_count;
+	uint64_t record_count;
+	uint64_t symbol_count;
+	uint64_t text_count;
+	uint64_t data_count;
+	uint64_t name_len;
+} cache_header_t;
+
+void block_cache_init(block_cache_t *cache) {
+
+	memset(cache, 0, sizeof(*cache));
+}
+
+void block_cache_free(block_cache_t *cache) {
+
+	// A loaded cache points into its file
+	if (cache->file.data == NULL) {
+		free(cache->blocks);
+		free(cache->records);
+		free(cache->symbols);
+		free(cache->names);
+	}
+	source_close(&cache->file);
+	free(cache->origins);
+	free(cache->symbol_map);
+	free(cache->index);
+	block_cache_init(cache);
+}
+
+// Make room for count items of size bytes in *items, returning -1 if the array could not grow
+static int cache_reserve(void **items, size_t *capacity, size_t count, size_t size) {
+
+	if (count <= *capacity)
+		return 0;
+
+	size_t grown = *capacity ? *capacity : 256;
+	while (grown < count)
+		grown *= 2;
+
+	void *resized = realloc(*items, grown * size);
+	if (resized == NULL)
+		return -1;
+	*items = resized;
+	*capacity = grown;
+	return 0;
+}
+
+// Make room for one more block and count more records, symbols and name bytes
+static int cache_reserve_block(block_cache_t *cache, size_t records, size_t symbols, size_t names) {
+
+	size_t block_capacity = cache->block_capacity;
+	size_t symbol_capacity = cache->symbol_capacity;
+
+	if (cache_reserve((void **)&cache->blocks, &cache->block_capacity, cache->block_count + 1, sizeof(cache_block_t)) != 0
+			|| cache_reserve((void **)&cache->records, &cache->record_capacity, cache->record_count + records, sizeof(asm_inst_t)) != 0
+			|| cache_reserve((void **)&cache->symbols, &cache->symbol_capacity, cache->symbol_count + symbols, sizeof(cache_symbol_t)) != 0
+			|| cache_reserve((void **)&cache->names, &cache->name_capacity, cache->name_len + names, 1) != 0)
+		return -1;
+
+	// The per-run arrays follow the blocks and symbols
+	if (cache->block_capacity != block_capacity || cache->origins == NULL) {
+		uint32_t *origins = realloc(cache->origins, cache->block_capacity * sizeof(uint32_t));
+		if (origins == NULL)
+			return -1;
+		cache->origins = origins;
+	}
+	if (cache->symbol_capacity != symbol_capacity || cache->symbol_map == NULL) {
+		uint32_t *symbol_map = realloc(cache->symbol_map, cache->symbol_capacity * sizeof(uint32_t));
+		if (symbol_map == NULL)
+			return -1;
+		cache->symbol_map = symbol_map;
+	}
+
+	return 0;
+}
+
+// Check that every block, record and symbol of a loaded cache stays inside its arrays
+static int cache_valid(const block_cache_t *cache, size_t text_count, size_t data_count) {
+
+	for (size_t b = 0; b < cache->block_count; b++) {
+
+		const cache_block_t *block = &cache->blocks[b];
+		if ((uint64_t)block->first_record + block->record_count > cache->record_count
+				|| (uint64_t)block->first_symbol + block->symbol_count > cache->symbol_count
+				|| (uint64_t)block->first_text + block->text_count > text_count
+				|| (uint64_t)block->first_data + block->data_count > data_count)
+			return -1;
+
+		for (uint32_t i = 0; i < block->record_count; i++) {
+			const asm_inst_t *rec = &cache->records[block->first_record + i];
+			if (rec->op > IR_ASCIIZ || (rec->sym != IR_NO_SYMBOL && rec->sym >= block->symbol_count))
+				return -1;
+			if (rec->op == IR_ASCIIZ && ((uint64_t)(uint32_t)rec->imm + rec->count > block->len))
+				return -1;
+		}
+	}
+
+	for (size_t s = 0; s < cache->symbol_count; s++)
+		if ((uint64_t)cache->symbols[s].name + cache->symbols[s].name_len > cache->name_len)
+			return -1;
+
+	return 0;
+}
+
+// Index the blocks of a loaded cache by hash
+static int cache_index(block_cache_t *cache) {
+
+	size_t slots = 16;
+	while (slots < cache->block_count * 2)
+		slots *= 2;
+
+	cache->index = malloc(slots * sizeof(uint32_t));
+	if (cache->index == NULL)
+		return -1;
+	for (size_t i = 0; i < slots; i++)
+		cache->index[i] = BLOCK_NONE;
+	cache->index_mask = slots - 1;
+
+	for (size_t b = 0; b < cache->block_count; b++) {
+		size_t slot = cache->blocks[b].hash & cache->index_mask;
+		while (cache->index[slot] != BLOCK_NONE)
+			slot = (slot + 1) & cache->index_mask;
+		cache->index[slot] = b;
+	}
+
+	return 0;
+}
+
+/*
+ * Map the sidecar at path. Returns -1, leaving the cache empty, if there is
+ * no sidecar or it was written by another build or is damaged; the
+ * assembly then starts from scratch.
+ */
+int block_cache_load(block_cache_t *cache, const char *path) {
+
+	block_cache_init(cache);
+	if (source_open(&cache->file, path) != 0)
+		return -1;
+
+	cache_header_t header;
+	const char *data = cache->file.data;
+	size_t len = cache->file.len;
+
+	if (len < sizeof(header) || cache->file.mapped_len == 0)
+		goto invalid;
+	memcpy(&header, data, sizeof(header));
+
+	if (memcmp(header.magic, BLOCK_CACHE_MAGIC, 8) != 0 || header.version != BLOCK_CACHE_VERSION
+			|| header.op_count != OP_COUNT || header.record_size != sizeof(asm_inst_t)
+			|| header.hash_check != symtab_hash(BLOCK_CACHE_MAGIC, 8))
+		goto invalid;
+
+	// Sizes well below the length cannot overflow the sum
+	if (header.block_count > len || header.record_count > len || header.symbol_count > len
+			|| header.text_count > len || header.data_count > len || header.name_len > len)
+		goto invalid;
+	if (sizeof(header) + header.block_count * sizeof(cache_block_t) + header.record_count * sizeof(asm_inst_t)
+			+ header.symbol_count * sizeof(cache_symbol_t) + (header.text_count + header.data_count) * sizeof(uint32_t)
+			+ header.name_len != len)
+		goto invalid;
+
+	data += sizeof(header);
+	cache->blocks = (cache_block_t *)data;
+	cache->block_count = header.block_count;
+	data += header.block_count * sizeof(cache_block_t);
+	cache->records = (asm_inst_t *)data;
+	cache->record_count = header.record_count;
+	data += header.record_count * sizeof(asm_inst_t);
+	cache->symbols = (cache_symbol_t *)data;
+	cache->symbol_count = header.symbol_count;
+	data += header.symbol_count * sizeof(cache_symbol_t);
+	cache->text = (const uint32_t *)data;
+	data += header.text_count * sizeof(uint32_t);
+	cache->data = (const uint32_t *)data;
+	data += header.data_count * sizeof(uint32_t);
+	cache->names = (char *)data;
+	cache->name_len = header.name_len;
+
+	if (cache_valid(cache, header.text_count, header.data_count) != 0 || cache_index(cache) != 0)
+		goto invalid;
+
+	return 0;
+
+invalid:
+	block_cache_free(cache);
+	return -1;
+}
+
+/*
+ * Write the cache and the words of output to path. The file is written
+ * under a temporary name and renamed over path, so a reader sees either
+ * the old sidecar or the new one.
+ */
+int block_cache_save(const block_cache_t *cache, const char *path, const output_t *output) {
+
+	cache_header_t header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, BLOCK_CACHE_MAGIC, 8);
+	header.version = BLOCK_CACHE_VERSION;
+	header.op_count = OP_COUNT;
+	header.record_size = sizeof(asm_inst_t);
+	header.hash_check = symtab_hash(BLOCK_CACHE_MAGIC, 8);
+	header.block_count = cache->block_count;
+	header.record_count = cache->record_count;
+	header.symbol_count = cache->symbol_count;
+	header.text_count = output->text.count;
+	header.data_count = output->data.count;
+	header.name_len = cache->name_len;
+
+	size_t tmp_len = strlen(path) + 32;
+	char *tmp_path = malloc(tmp_len);
+	if (tmp_path == NULL)
+		return -1;
+	snprintf(tmp_path, tmp_len, "%s.%ld.tmp", path, (long)getpid());
+
+	FILE *Out = fopen(tmp_path, "wb");
+	if (Out == NULL) {
+		free(tmp_path);
+		return -1;
+	}
+
+	int status = 0;
+	if (fwrite(&header, sizeof(header), 1, Out) != 1
+			|| fwrite(cache->blocks, sizeof(cache_block_t), cache->block_count, Out) != cache->block_count
+			|| fwrite(cache->records, sizeof(asm_inst_t), cache->record_count, Out) != cache->record_count
+			|| fwrite(cache->symbols, sizeof(cache_symbol_t), cache->symbol_count, Out) != cache->symbol_count
+			|| fwrite(output->text.words, sizeof(uint32_t), output->text.count, Out) != output->text.count
+			|| fwrite(output->data.words, sizeof(uint32_t), output->data.count, Out) != output->data.count
+			|| fwrite(cache->names, 1, cache->name_len, Out) != cache->name_len)
+		status = -1;
+
+	if (fclose(Out) != 0)
+		status = -1;
+	if (status == 0 && rename(tmp_path, path) != 0)
+		status = -1;
+	if (status != 0)
+		remove(tmp_path);
+
+	free(tmp_path);
+	return status;
+}
+
+/*
+ * Find a block with the given bytes that was lexed from the same entry
+ * state: the same section, and for a block holding .data the same location
+ * counter. Returns its index, or BLOCK_NONE.
+ */
+uint32_t block_cache_find(const block_cache_t *cache, uint64_t hash, uint32_t len, int data_entry, uint32_t entry) {
+
+	if (cache->index == NULL)
+		return BLOCK_NONE;
+
+	for (size_t slot = hash & cache->index_mask; cache->index[slot] != BLOCK_NONE; slot = (slot + 1) & cache->index_mask) {
+
+		const cache_block_t *block = &cache->blocks[cache->index[slot]];
+		if (block->hash != hash || block->len != len || !(block->flags & BLOCK_DATA_ENTRY) != !data_entry)
+			continue;
+		if ((block->flags & BLOCK_ABSOLUTE) && block->entry != entry)
+			continue;
+		return cache->index[slot];
+	}
+
+	return BLOCK_NONE;
+}
+
+// Append block index of from, returning its index in cache or BLOCK_NONE if the arrays could not grow
+uint32_t block_cache_copy(block_cache_t *cache, const block_cache_t *from, uint32_t index) {
+
+	const cache_block_t *block = &from->blocks[index];
+	const cache_symbol_t *symbols = &from->symbols[block->first_symbol];
+
+	size_t names = 0;
+	for (uint32_t s = 0; s < block->symbol_count; s++)
+		names += symbols[s].name_len;
+
+	if (cache_reserve_block(cache, block->record_count, block->symbol_count, names) != 0)
+		return BLOCK_NONE;
+
+	cache_block_t *copy = &cache->blocks[cache->block_count];
+	*copy = *block;
+	copy->first_record = cache->record_count;
+	copy->first_symbol = cache->symbol_count;
+
+	memcpy(&cache->records[cache->record_count], &from->records[block->first_record], block->record_count * sizeof(asm_inst_t));
+	cache->record_count += block->record_count;
+
+	for (uint32_t s = 0; s < block->symbol_count; s++) {
+		cache_symbol_t *symbol = &cache->symbols[cache->symbol_count++];
+		*symbol = symbols[s];
+		symbol->name = cache->name_len;
+		memcpy(cache->names + cache->name_len, from->names + symbols[s].name, symbols[s].name_len);
+		cache->name_len += symbols[s].name_len;
+	}
+
+	cache->origins[cache->block_count] = index;
+	return cache->block_count++;
+}
+
+/*
+ * Append a block lexed into program and symbols, whose records carry lines
+ * counted from line_base. Returns its index, or BLOCK_NONE if the arrays
+ * could not grow.
+ */
+uint32_t block_cache_add(block_cache_t *cache, const cache_block_t *block, const asm_program_t *program,
+		const symtab_t *symbols, uint32_t line_base) {
+
+	size_t names = 0;
+	for (uint32_t id = 0; id < symbols->count; id++)
+		names += symbols->entries[id].key_len;
+
+	if (cache_reserve_block(cache, program->count, symbols->count, names) != 0)
+		return BLOCK_NONE;
+
+	cache_block_t *added = &cache->blocks[cache->block_count];
+	*added = *block;
+	added->first_record = cache->record_count;
+	added->record_count = program->count;
+	added->first_symbol = cache->symbol_count;
+	added->symbol_count = symbols->count;
+	added->first_text = 0;
+	added->text_count = 0;
+	added->first_data = 0;
+	added->data_count = 0;
+
+	for (size_t i = 0; i < program->count; i++) {
+		asm_inst_t *rec = &cache->records[cache->record_count++];
+		*rec = program->insts[i];
+		rec->line -= line_base;
+	}
+
+	for (uint32_t id = 0; id < symbols->count; id++) {
+		const symtab_entry_t *entry = &symbols->entries[id];
+		cache_symbol_t *symbol = &cache->symbols[cache->symbol_count++];
+		symbol->name = cache->name_len;
+		symbol->name_len = entry->key_len;
+		symbol->hash = entry->hash;
+		symbol->flags = entry->flags & SYMTAB_DEFINED;
+		symbol->value = entry->value;
+		symbol->label = 0;
+		memcpy(cache->names + cache->name_len, symtab_key(entry), entry->key_len);
+		cache->name_len += entry->key_len;
+	}
+
+	cache->origins[cache->block_count] = BLOCK_NONE;
+	return cache->block_count++;
+}
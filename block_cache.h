@@ -0,0 +1,113 @@
+/*
+ * block_cache.h
+ *
+ * Cache sidecar of the incremental mode. The source is cut into blocks of
+ * whole lines at points chosen by the content of the lines, so an edit only
+ * moves the cuts next to it. Each block is kept in the relocatable form
+ * pass 1 lexes it into, keyed by a hash of its bytes: its records with
+ * addresses, lines and string offsets relative to the start of the block,
+ * and its own small symbol table. Along with them go the words pass 2
+ * encoded for the block and the label addresses it encoded them with, so
+ * the next run can tell which words are still valid.
+ */
+
+#ifndef BLOCK_CACHE_H_
+#define BLOCK_CACHE_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include "ir.h"
+#include "symtab.h"
+#include "output.h"
+#include "source.h"
+
+// Format of the sidecar; a file with another magic or version is ignored
+#define BLOCK_CACHE_MAGIC "MIPSBLKC"
+#define BLOCK_CACHE_VERSION 1
+
+// A block ends after a line whose hash has the BLOCK_CUT_MASK bits clear,
+// once it has BLOCK_MIN_LINES lines, and always at BLOCK_MAX_LINES lines
+#define BLOCK_CUT_MASK 0xff
+#define BLOCK_MIN_LINES 32
+#define BLOCK_MAX_LINES 4096
+
+// Not a block of the cache
+#define BLOCK_NONE 0xffffffffu
+
+// Flags of a block
+#define BLOCK_DATA_ENTRY 1	// Lexed in the .data section
+#define BLOCK_ABSOLUTE 2	// Holds .data, so it was lexed from its true location counter
+#define BLOCK_DATA_EXIT 4	// The .data section has been reached at its end
+
+typedef struct {
+	uint64_t hash;			// Hash of the bytes of the block
+	uint32_t len;			// Bytes of source
+	uint32_t lines;
+	uint32_t flags;
+	uint32_t entry;			// Location counter at the start of the block
+	uint32_t exit;			// Location counter at its end, relative unless BLOCK_ABSOLUTE
+	uint32_t tokens;		// Tokens lexed, for the stats
+	uint32_t first_record;	// Records, symbols and words of the block in the cache arrays
+	uint32_t record_count;
+	uint32_t first_symbol;
+	uint32_t symbol_count;
+	uint32_t first_text;
+	uint32_t text_count;
+	uint32_t first_data;
+	uint32_t data_count;
+} cache_block_t;
+
+// A symbol of a block; records of the block refer to it by its index within the block
+typedef struct {
+	uint32_t name;			// Offset of the name in the name pool
+	uint32_t name_len;
+	uint32_t hash;			// symtab_hash() of the name
+	uint32_t flags;			// SYMTAB_DEFINED if the block defines it
+	uint32_t value;			// Address it is defined at, relative like the records
+	uint32_t label;			// Address the words of the block were encoded with
+} cache_symbol_t;
+
+/*
+ * A cache loaded from a sidecar points into the mapped file. A cache being
+ * built for the next run owns growable arrays, and its words are those of
+ * the output once pass 2 is done. origins and symbol_map only live while
+ * assembling.
+ */
+typedef struct {
+	cache_block_t *blocks;
+	size_t block_count;
+	size_t block_capacity;
+	asm_inst_t *records;
+	size_t record_count;
+	size_t record_capacity;
+	cache_symbol_t *symbols;
+	size_t symbol_count;
+	size_t symbol_capacity;
+	char *names;
+	size_t name_len;
+	size_t name_capacity;
+	const uint32_t *text;
+	const uint32_t *data;
+	uint32_t *origins;		// Block of the previous cache each block was copied from, or BLOCK_NONE
+	uint32_t *symbol_map;	// Symbol id in the assembly of each symbol of the cache
+	uint32_t *index;		// Blocks by hash, for lookups in a loaded cache
+	size_t index_mask;
+	source_t file;
+} block_cache_t;
+
+void block_cache_init(block_cache_t *cache);
+void block_cache_free(block_cache_t *cache);
+int block_cache_load(block_cache_t *cache, const char *path);
+int block_cache_save(const block_cache_t *cache, const char *path, const output_t *output);
+uint32_t block_cache_find(const block_cache_t *cache, uint64_t hash, uint32_t len, int data_entry, uint32_t entry);
+uint32_t block_cache_copy(block_cache_t *cache, const block_cache_t *from, uint32_t index);
+uint32_t block_cache_add(block_cache_t *cache, const cache_block_t *block, const asm_program_t *program,
+		const symtab_t *symbols, uint32_t line_base);
+
+// Hash of the bytes of a block or of one line
+static inline uint64_t block_cache_hash(const char *data, size_t len) {
+
+	return hash_wy64(data, (uint32_t)len, 0x6d697073);
+}
+
+#endif /* BLOCK_CACHE_H_ */
@@ -0,0 +1,376 @@
+#ifndef __CSYMTAB_H
+#define __CSYMTAB_H
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "symtab.h"
+
+/*
+   concurrent symbol table.
+
+   any number of threads may intern, define and find symbols at the same
+   time without locks. lookups are wait-free and inserts are lock-free: a
+   new entry is filled in first and then published into an index slot with
+   a single compare-and-swap, so a reader that sees the slot sees the whole
+   entry.
+
+   entries get dense ids like symtab_t, and keep them for the life of the
+   table. they live in segments of doubling size that are allocated on
+   demand, so an entry never moves. hashes are the same as symtab_hash, so
+   a finished table can be copied into a symtab_t without hashing again.
+
+   the index is open addressing with linear probing. when it gets too full,
+   a table twice the size is chained after it and the old one is frozen:
+   every empty slot is swapped for CSYMTAB_FROZEN, so no insert can land
+   there any more. an insert that meets a frozen slot moves on to the next
+   table, and lookups scan the tables from oldest to newest. any thread that
+   finds a table full helps freeze it, so no thread ever waits for another.
+   old tables are only freed by csymtab_destroy.
+
+   keys are not copied and must outlive the table.
+*/
+
+#define CSYMTAB_NONE 0xffffffffu
+#define CSYMTAB_UNDEFINED UINT64_MAX
+#define CSYMTAB_FROZEN UINT64_MAX
+
+/* ids held by the first segment; segment k holds CSYMTAB_SEGMENT << k */
+#define CSYMTAB_SEGMENT 256
+#define CSYMTAB_SEGMENTS 24
+
+typedef struct
+{
+  uint32_t hash;
+  uint32_t key_len;
+  const char *key;
+  uint64_t state;  /* (priority << 32) | value, or CSYMTAB_UNDEFINED */
+  uint32_t live;   /* 0 if another thread published the key first */
+} csymtab_entry_t;
+
+typedef struct csymtab_index_type
+{
+  uint64_t *slots; /* (hash << 32) | (id + 1), 0 if empty, or CSYMTAB_FROZEN */
+  uint32_t slot_mask;
+  uint32_t used;
+  struct csymtab_index_type *next;
+} csymtab_index_t;
+
+typedef struct
+{
+  csymtab_index_t *first;
+  uint32_t count;  /* ids handed out, including entries that lost a race */
+  csymtab_entry_t *segments[CSYMTAB_SEGMENTS];
+} csymtab_t;
+
+static inline csymtab_index_t *csymtab_index_create(uint32_t slot_count)
+{
+  csymtab_index_t *index = (csymtab_index_t *) malloc(sizeof(csymtab_index_t));
+  if (index == NULL) return(NULL);
+
+  index->slots = (uint64_t *) calloc(slot_count, sizeof(uint64_t));
+  if (index->slots == NULL)
+    {
+      free(index);
+      return(NULL);
+    }
+
+  index->slot_mask = slot_count - 1;
+  index->used = 0;
+  index->next = NULL;
+  return(index);
+}
+
+/*
+   creates a concurrent symbol table and returns a pointer to it
+
+   parameters:
+   initial_size : number of symbols to make room for before the index first grows
+
+   returns: pointer to created table or NULL on failure
+*/
+static inline csymtab_t *csymtab_create(uint32_t initial_size)
+{
+  uint32_t slot_count = 16;
+  csymtab_t *csymtab;
+
+  /* keep the index at most 3/4 full */
+  while (slot_count - (slot_count >> 2) < initial_size) slot_count <<= 1;
+
+  csymtab = (csymtab_t *) calloc(1, sizeof(csymtab_t));
+  if (csymtab == NULL) return(NULL);
+
+  csymtab->first = csymtab_index_create(slot_count);
+  if (csymtab->first == NULL)
+    {
+      free(csymtab);
+      return(NULL);
+    }
+  return(csymtab);
+}
+
+/* segment and position of an id */
+static inline uint32_t csymtab_segment(uint32_t id, uint32_t *offset)
+{
+  uint32_t k = 31 - __builtin_clz(id / CSYMTAB_SEGMENT + 1);
+  *offset = id - CSYMTAB_SEGMENT * ((1u << k) - 1);
+  return(k);
+}
+
+/* returns the entry of an id that has been handed out */
+static inline csymtab_entry_t *csymtab_entry(const csymtab_t *csymtab, uint32_t id)
+{
+  uint32_t offset, k = csymtab_segment(id, &offset);
+  return(&__atomic_load_n(&csymtab->segments[k], __ATOMIC_ACQUIRE)[offset]);
+}
+
+/* hands out a new id, allocating its segment if this is the first one
+   there. the id is claimed only once its segment exists, so a failure
+   leaves the count as it was. returns CSYMTAB_NONE on failure */
+static inline uint32_t csymtab_new_entry(csymtab_t *csymtab)
+{
+  uint32_t id = __atomic_load_n(&csymtab->count, __ATOMIC_RELAXED);
+
+  for (;;)
+    {
+      uint32_t offset, k = csymtab_segment(id, &offset);
+      csymtab_entry_t *segment, *expected = NULL;
+
+      if (k >= CSYMTAB_SEGMENTS) return(CSYMTAB_NONE);
+      if (__atomic_load_n(&csymtab->segments[k], __ATOMIC_ACQUIRE) == NULL)
+	{
+	  segment = (csymtab_entry_t *) malloc(sizeof(csymtab_entry_t) * (CSYMTAB_SEGMENT << k));
+	  if (segment == NULL) return(CSYMTAB_NONE);
+
+	  /* another thread may have allocated the segment meanwhile */
+	  if (!__atomic_compare_exchange_n(&csymtab->segments[k], &expected, segment, 0,
+					   __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+	    free(segment);
+	}
+
+      /* on failure id is reloaded with the count another thread left */
+      if (__atomic_compare_exchange_n(&csymtab->count, &id, id + 1, 1,
+				      __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+	return(id);
+    }
+}
+
+/* chains a table twice the size after index, unless there is one already,
+   and freezes index. returns FALSE if the new table could not be allocated */
+static inline int csymtab_grow(csymtab_index_t *index)
+{
+  uint32_t t;
+
+  if (__atomic_load_n(&index->next, __ATOMIC_ACQUIRE) == NULL)
+    {
+      csymtab_index_t *next = csymtab_index_create((index->slot_mask + 1) * 2), *expected = NULL;
+      if (next == NULL) return(FALSE);
+
+      if (!__atomic_compare_exchange_n(&index->next, &expected, next, 0,
+				       __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+	{
+	  free(next->slots);
+	  free(next);
+	}
+    }
+
+  for (t = 0; t <= index->slot_mask; t++)
+    {
+      uint64_t empty = 0;
+      __atomic_compare_exchange_n(&index->slots[t], &empty, CSYMTAB_FROZEN, 0,
+				  __ATOMIC_ACQ_REL, __ATOMIC_RELAXED);
+    }
+  return(TRUE);
+}
+
+static inline int csymtab_slot_matches(const csymtab_t *csymtab, uint64_t slot, uint32_t hash,
+				       const void *key, uint32_t key_len)
+{
+  const csymtab_entry_t *entry;
+
+  if ((uint32_t) (slot >> 32) != hash) return(FALSE);
+  entry = csymtab_entry(csymtab, (uint32_t) slot - 1);
+  return((entry->key_len == key_len) && (memcmp(entry->key, key, key_len) == 0));
+}
+
+/*
+   finds the id of key. wait-free.
+
+   returns: the id, or CSYMTAB_NONE if the key is not present
+*/
+static inline uint32_t csymtab_find(const csymtab_t *csymtab, const void *key, uint32_t key_len)
+{
+  uint32_t hash = symtab_hash(key, key_len);
+  const csymtab_index_t *index;
+
+  for (index = csymtab->first; index != NULL; index = __atomic_load_n(&index->next, __ATOMIC_ACQUIRE))
+    {
+      uint32_t pos = hash & index->slot_mask, probes;
+
+      for (probes = 0; probes <= index->slot_mask; probes++)
+	{
+	  uint64_t slot = __atomic_load_n(&index->slots[pos], __ATOMIC_ACQUIRE);
+
+	  /* slots are only ever filled once, so an insert of the key that
+	     went on to a newer table froze this slot first */
+	  if (slot == 0) return(CSYMTAB_NONE);
+	  if (slot == CSYMTAB_FROZEN) break;
+	  if (csymtab_slot_matches(csymtab, slot, hash, key, key_len)) return((uint32_t) slot - 1);
+	  pos = (pos + 1) & index->slot_mask;
+	}
+    }
+  return(CSYMTAB_NONE);
+}
+
+/*
+   returns the id of the symbol named key, adding an undefined entry for it
+   if it is not in the table yet. lock-free; when several threads intern the
+   same key at once, all of them get the same id.
+
+   parameters:
+   hash : symtab_hash of the key, which a symtab_entry_t already caches
+
+   returns: the id, or CSYMTAB_NONE if the entry could not be added
+*/
+static inline uint32_t csymtab_intern_hash(csymtab_t *csymtab, const void *key, uint32_t key_len, uint32_t hash)
+{
+  uint32_t id = CSYMTAB_NONE;
+  csymtab_index_t *index = csymtab->first;
+  csymtab_entry_t *entry = NULL;
+
+  while (1)
+    {
+      uint32_t pos = hash & index->slot_mask, probes = 0;
+      csymtab_index_t *next = NULL;
+
+      while (next == NULL)
+	{
+	  uint64_t slot = __atomic_load_n(&index->slots[pos], __ATOMIC_ACQUIRE);
+
+	  if (slot == CSYMTAB_FROZEN)
+	    {
+	      next = __atomic_load_n(&index->next, __ATOMIC_ACQUIRE);
+	      continue;
+	    }
+
+	  if (slot != 0)
+	    {
+	      if (csymtab_slot_matches(csymtab, slot, hash, key, key_len))
+		{
+		  /* someone else published the key first */
+		  if (entry != NULL) __atomic_store_n(&entry->live, 0, __ATOMIC_RELEASE);
+		  return((uint32_t) slot - 1);
+		}
+	      pos = (pos + 1) & index->slot_mask;
+	      if (++probes <= index->slot_mask) continue;
+	    }
+
+	  /* every slot is taken and none of them is the key */
+	  if (slot != 0)
+	    {
+	      if (!csymtab_grow(index)) return(CSYMTAB_NONE);
+	      next = __atomic_load_n(&index->next, __ATOMIC_ACQUIRE);
+	      continue;
+	    }
+
+	  /* too full: freeze this table and look again, which now ends
+	     either at the key or at a frozen slot */
+	  if (__atomic_load_n(&index->used, __ATOMIC_RELAXED) + 1
+	      > (index->slot_mask + 1) - ((index->slot_mask + 1) >> 2))
+	    {
+	      if (!csymtab_grow(index)) return(CSYMTAB_NONE);
+	      pos = hash & index->slot_mask;
+	      probes = 0;
+	      continue;
+	    }
+
+	  /* fill in the entry once, before it can be seen */
+	  if (entry == NULL)
+	    {
+	      id = csymtab_new_entry(csymtab);
+	      if (id == CSYMTAB_NONE) return(CSYMTAB_NONE);
+	      entry = csymtab_entry(csymtab, id);
+	      entry->hash = hash;
+	      entry->key_len = key_len;
+	      entry->key = (const char *) key;
+	      entry->state = CSYMTAB_UNDEFINED;
+	      entry->live = 1;
+	    }
+
+	  if (__atomic_compare_exchange_n(&index->slots[pos], &slot, ((uint64_t) hash << 32) | (id + 1), 0,
+					  __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+	    {
+	      __atomic_fetch_add(&index->used, 1, __ATOMIC_RELAXED);
+	      return(id);
+	    }
+	  /* lost the slot: look at what is there now */
+	}
+      index = next;
+    }
+}
+
+static inline uint32_t csymtab_intern(csymtab_t *csymtab, const void *key, uint32_t key_len)
+{
+  return(csymtab_intern_hash(csymtab, key, key_len, symtab_hash(key, key_len)));
+}
+
+/*
+   gives a symbol its value. of all the values defined for it, the one with
+   the lowest priority is kept, whatever order the threads get here in.
+*/
+static inline void csymtab_define(csymtab_t *csymtab, uint32_t id, uint32_t value, uint32_t priority)
+{
+  csymtab_entry_t *entry = csymtab_entry(csymtab, id);
+  uint64_t state = ((uint64_t) priority << 32) | value;
+  uint64_t current = __atomic_load_n(&entry->state, __ATOMIC_ACQUIRE);
+
+  while (state < current)
+    if (__atomic_compare_exchange_n(&entry->state, &current, state, 1,
+				    __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+      break;
+}
+
+/*
+  finds the value kept for a symbol
+
+  returns:
+  TRUE and the value in *value if the symbol is defined
+  FALSE if it is not
+*/
+static inline int csymtab_value(const csymtab_t *csymtab, uint32_t id, uint32_t *value)
+{
+  uint64_t state = __atomic_load_n(&csymtab_entry(csymtab, id)->state, __ATOMIC_ACQUIRE);
+
+  if (state == CSYMTAB_UNDEFINED) return(FALSE);
+  *value = (uint32_t) state;
+  return(TRUE);
+}
+
+/* number of ids handed out so far, including entries that lost a race */
+static inline uint32_t csymtab_count(const csymtab_t *csymtab)
+{
+  return(__atomic_load_n(&csymtab->count, __ATOMIC_ACQUIRE));
+}
+
+/*
+  destroys the table. no other thread may be using it.
+*/
+static inline void csymtab_destroy(csymtab_t *csymtab)
+{
+  csymtab_index_t *index = csymtab->first, *next;
+  uint32_t k;
+
+  while (index != NULL)
+    {
+      next = index->next;
+      free(index->slots);
+      free(index);
+      index = next;
+    }
+
+  for (k = 0; k < CSYMTAB_SEGMENTS; k++)
+    free(csymtab->segments[k]);
+  free(csymtab);
+}
+
+#endif
@@ -1,3 +1,4 @@
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
@@ -6,1092 +7,1807 @@
 #include <unistd.h>
 #include "file_parser.h"
 #include "tokenizer.h"
+#include "csymtab.h"
+#include "spsc_ring.h"
+
+// Value of a .word directive: the integer following the first word in [ptr, end)
+static int parse_word_value(const char *ptr, const char *end) {
+
+	while (ptr < end && isspace((unsigned char)*ptr))
+		ptr++;
+	while (ptr < end && !isspace((unsigned char)*ptr))
+		ptr++;
+
+	return parse_int(ptr, end);
+}
+
+// Reserve the next decoded record
+static asm_inst_t *new_record(asm_context_t *ctx, uint8_t op, uint32_t addr, int32_t line_num) {
+
+	asm_inst_t *rec = program_append(&ctx->program);
+	if (rec == NULL) {
+		asm_error(ctx, "Out of memory");
+		return NULL;
+	}
+
+	rec->op = op;
+	rec->rs = 0;
+	rec->rt = 0;
+	rec->rd = 0;
+	rec->imm = 0;
+	rec->sym = IR_NO_SYMBOL;
+	rec->addr = addr;
+	rec->count = 0;
+	rec->line = line_num;
+	return rec;
+}
+
+// Position of the lexer in the source, carried from one line to the next
+typedef struct {
+	int32_t line_num;
+	int32_t instruction_count;
+	int data_reached;
+	int data_seen;		// A .data directive was lexed
+	int label_records;	// Pass definitions on as IR_LABEL records instead of patching fixups
+} lex_state_t;
 
 /*
- * The structs below map a character to an integer.
- * They are used in order to map a specific instruciton/register to its binary format in ASCII
+ * Fill in the label field of every word waiting for symbol sym. The .text
+ * buffer holds the words from first_word on.
  */
+static void patch_fixups(asm_context_t *ctx, uint32_t sym, uint32_t value, size_t first_word) {
 
-// Struct that stores registers and their respective binary reference
-struct {
-	const char *name;
-	char *address;
-} registerMap[] = {
-		{ "zero", "00000" },
-		{ "at", "00001" },
-		{ "v0", "00010" },
-		{ "v1", "00011" },
-		{ "a0", "00100" },
-		{ "a1", "00101" },
-		{ "a2", "00110" },
-		{ "a3", "00111" },
-		{ "t0", "01000" },
-		{ "t1", "01001" },
-		{ "t2", "01010" },
-		{ "t3", "01011" },
-		{ "t4", "01100" },
-		{ "t5", "01101" },
-		{ "t6", "01110" },
-		{ "t7", "01111" },
-		{ "s0", "10000" },
-		{ "s1", "10001" },
-		{ "s2", "10010" },
-		{ "s3", "10011" },
-		{ "s4", "10100" },
-		{ "s5", "10101" },
-		{ "s6", "10110" },
-		{ "s7", "10111" },
-		{ "t8", "11000" },
-		{ "t9", "11001" },
-		{ NULL, 0 } };
-
-// Struct for R-Type instructions mapping for the 'function' field in the instruction
-struct {
-	const char *name;
-	char *function;
-} rMap[] = {
-		{ "add", "100000" },
-		{ "sub", "100001" },
-		{ "and", "100100" },
-		{ "or",  "100101" },
-		{ "sll", "000000" },
-		{ "slt", "101010" },
-		{ "srl", "000010" },
-		{ "jr",  "001000" },
-		{ NULL, 0 } };
-
-// Struct for I-Type instructions
-struct {
-	const char *name;
-	char *address;
-} iMap[] = {
-		{ "lw",   "100011" },
-		{ "sw",   "101011" },
-		{ "andi", "001100" },
-		{ "ori",  "001101" },
-		{ "lui",  "001111" },
-		{ "beq",  "000100" },
-		{ "slti", "001010" },
-		{ "addi", "001000" },
-		{ NULL, 0 } };
-
-// Struct for J-Type instructions
-struct {
-	const char *name;
-	char *address;
-} jMap[] = {
-		{ "j", "000010" },
-		{ "jal", "000011" },
-		{ NULL, 0 } };
-
-void parse_file(FILE *fptr, int pass, char *instructions[], size_t inst_len, hash_table_t *hash_table, FILE *Out) {
-
-	char line[MAX_LINE_LENGTH + 1];
-	char *tok_ptr, *ret, *token = NULL;
-	int32_t line_num = 1;
-	int32_t instruction_count = 0x00000000;
-	int data_reached = 0;
-	//FILE *fptr;
-
-	/*fptr = fopen(src_file, "r");
-	if (fptr == NULL) {
-		fprintf(Out, "unable to open file %s. aborting ...\n", src_file);
-		exit(-1);
-	}*/
-
-	while (1) {
-		if ((ret = fgets(line, MAX_LINE_LENGTH, fptr)) == NULL)
+	asm_fixups_t *fixups = &ctx->fixups;
+	uint32_t *text = ctx->output.text.words;
+
+	for (uint32_t i = fixups_head(fixups, sym); i != FIXUP_NONE; i = fixups->items[i].next) {
+
+		const asm_fixup_t *fixup = &fixups->items[i];
+		size_t word = fixup->word - first_word;
+		switch (fixup->op) {
+
+		// lui holds the upper half, the following ori the lower half
+		case OP_LA:
+			text[word] |= value >> 16;
+			text[word + 1] |= value & 0xffff;
 			break;
-		line[MAX_LINE_LENGTH] = 0;
 
-		tok_ptr = line;
-		if (strlen(line) == MAX_LINE_LENGTH) {
-			fprintf(Out,
-					"line %d: line is too long. ignoring line ...\n", line_num);
-			line_num++;
-			continue;
+		// The placeholder offset was encoded with a label address of 0
+		case OP_BEQ:
+			text[word] = (text[word] & ~0xffffu) | ((value + fixup->addr) & 0xffff);
+			break;
+
+		default:
+			text[word] |= value & 0x03ffffff;
+			break;
 		}
+	}
+
+	if (sym < fixups->head_count)
+		fixups->heads[sym] = FIXUP_NONE;
+}
+
+// Strip the trailing ':' from a label token and record its address
+static int add_label(asm_context_t *ctx, const lex_state_t *state, token_view_t label, int32_t address) {
+
+	symtab_t *symbols = ctx->symbols;
+	uint32_t id = symtab_intern(symbols, label.ptr, label.len - 1);
 
-		/* parse the tokens within a line */
-		while (1) {
+	if (id == SYMTAB_EMPTY)
+		return asm_error(ctx, "Error inserting into symbol table");
 
-			token = parse_token(tok_ptr, " \n\t$,", &tok_ptr, NULL);
+	// The first definition of a label is the one that counts
+	if (symbols->entries[id].flags & SYMTAB_DEFINED)
+		return 0;
 
-			/* blank line or comment begins here. go to the next line */
-			if (token == NULL || *token == '#') {
-				line_num++;
-				free(token);
+	symtab_define(symbols, id, address);
+
+	// The encoder of the pipelined mode keeps its own copy of the addresses
+	if (state->label_records) {
+		asm_inst_t *rec = new_record(ctx, IR_LABEL, address, state->line_num);
+		if (rec == NULL)
+			return -1;
+		rec->sym = id;
+		return 0;
+	}
+
+	patch_fixups(ctx, id, address, 0);
+	return 0;
+}
+
+// Return the symbol id of a label operand, which may not be defined yet
+static uint32_t reference_label(asm_context_t *ctx, token_view_t label) {
+
+	uint32_t id = symtab_intern(ctx->symbols, label.ptr, label.len);
+	if (id == SYMTAB_EMPTY)
+		asm_error(ctx, "Error inserting into symbol table");
+
+	return id;
+}
+
+/*
+ * Address of the label a record refers to. A label that is not defined yet
+ * reads as 0 and the word about to be emitted into .text is queued to be
+ * patched when the label appears.
+ */
+static int32_t label_operand(asm_context_t *ctx, const asm_inst_t *rec) {
+
+	const symtab_entry_t *entry = &ctx->symbols->entries[rec->sym];
+	if (entry->flags & SYMTAB_DEFINED)
+		return entry->value;
+
+	asm_fixup_t *fixup = fixups_add(&ctx->fixups, rec->sym);
+	if (fixup == NULL)
+		return asm_error(ctx, "Out of memory");
+
+	fixup->word = ctx->output.text.count;
+	fixup->addr = rec->addr;
+	fixup->line = rec->line;
+	fixup->op = rec->op;
+	return 0;
+}
+
+// Record an undefined label error
+static int undefined_label(asm_context_t *ctx, uint32_t sym, uint32_t line) {
+
+	const symtab_entry_t *entry = &ctx->symbols->entries[sym];
+	return asm_error(ctx, "line %u: undefined label %.*s", line, (int)entry->key_len, symtab_key(entry));
+}
+
+// Report the first reference to a label that was never defined
+static int check_fixups(asm_context_t *ctx) {
+
+	for (size_t i = 0; i < ctx->fixups.count; i++) {
+
+		const asm_fixup_t *fixup = &ctx->fixups.items[i];
+		if (!(ctx->symbols->entries[fixup->sym].flags & SYMTAB_DEFINED))
+			return undefined_label(ctx, fixup->sym, fixup->line);
+	}
+
+	return 0;
+}
+
+// Decode the operands of an instruction in [ptr, end) into rec, returning the number of operand tokens
+static int lex_operands(asm_context_t *ctx, const inst_desc_t *inst, const char *ptr, const char *end,
+		asm_inst_t *rec) {
+
+	token_view_t operands[MAX_OPERANDS] = { { NULL, 0 } };
+	int32_t line_num = rec->line;
+	int count = 0;
+
+	switch (inst->shape) {
+
+	// R-Type with $rd, $rs, $rt format
+	case SHAPE_RD_RS_RT:
+		count = parse_tokens(&ptr, end, " $,\n\t", operands, 3);
+		rec->rd = register_address(ctx, operands[0], line_num);
+		rec->rs = register_address(ctx, operands[1], line_num);
+		rec->rt = register_address(ctx, operands[2], line_num);
+		break;
+
+	// R-Type with $rd, $rt, shamt format
+	case SHAPE_RD_RT_SHAMT:
+		count = parse_tokens(&ptr, end, " $,\n\t", operands, 3);
+		rec->rd = register_address(ctx, operands[0], line_num);
+		rec->rt = register_address(ctx, operands[1], line_num);
+		rec->imm = parse_int(operands[2].ptr, operands[2].ptr + operands[2].len);
+		break;
+
+	// R-Type $rs
+	case SHAPE_RS:
+		count = parse_tokens(&ptr, end, " $,\n\t", operands, 1);
+		rec->rs = register_address(ctx, operands[0], line_num);
+		break;
+
+	// la $rt, label
+	case SHAPE_RT_LABEL:
+		count = parse_tokens(&ptr, end, " $,\n\t", operands, 2);
+		rec->rt = register_address(ctx, operands[0], line_num);
+		rec->sym = reference_label(ctx, operands[1]);
+		break;
+
+	// I-Type $rt, i($rs)
+	case SHAPE_RT_OFFSET_RS:
+		count = parse_tokens(&ptr, end, " $,\n\t()", operands, 3);
+		rec->rt = register_address(ctx, operands[0], line_num);
+		rec->imm = parse_int(operands[1].ptr, operands[1].ptr + operands[1].len);
+		rec->rs = register_address(ctx, operands[2], line_num);
+		break;
+
+	// I-Type rt, rs, im
+	case SHAPE_RT_RS_IMM:
+		count = parse_tokens(&ptr, end, " $,\n\t", operands, 3);
+		rec->rt = register_address(ctx, operands[0], line_num);
+		rec->rs = register_address(ctx, operands[1], line_num);
+		rec->imm = parse_int(operands[2].ptr, operands[2].ptr + operands[2].len);
+		break;
+
+	// I-Type $rt, immediate
+	case SHAPE_RT_IMM:
+		count = parse_tokens(&ptr, end, " $,\n\t", operands, 2);
+		rec->rt = register_address(ctx, operands[0], line_num);
+		rec->imm = parse_int(operands[1].ptr, operands[1].ptr + operands[1].len);
+		break;
+
+	// I-Type $rs, $rt, label
+	case SHAPE_RS_RT_LABEL:
+		count = parse_tokens(&ptr, end, " $,\n\t", operands, 3);
+		rec->rs = register_address(ctx, operands[0], line_num);
+		rec->rt = register_address(ctx, operands[1], line_num);
+		rec->sym = reference_label(ctx, operands[2]);
+		break;
+
+	// J-Type label
+	case SHAPE_LABEL:
+		count = parse_tokens(&ptr, end, " $,\n\t", operands, 1);
+		rec->sym = reference_label(ctx, operands[0]);
+		break;
+
+	case SHAPE_NONE:
+		break;
+	}
+
+	return count;
+}
+
+/*
+ * Assign addresses to the labels of one line and decode its instruction or
+ * data directive into the record array of the context. .asciiz records hold
+ * the offset of the string from base. Returns -1 after recording an error in
+ * the context.
+ */
+static int lex_line(asm_context_t *ctx, lex_state_t *state, const char *line, const char *line_end,
+		const char *base) {
+
+	asm_program_t *program = &ctx->program;
+	asm_inst_t *rec;
+
+	const char *tok_ptr = line;
+	token_view_t token;
+	int32_t line_num = ++state->line_num;
+	int32_t instruction_count = state->instruction_count;
+	int data_reached = state->data_reached;
+	int tokens = 0;
+
+	/* parse the tokens within a line; blank lines and comments end it */
+	while (parse_token(&tok_ptr, line_end, " \n\t$,", &token, NULL) && *token.ptr != '#') {
+		tokens++;
+		TRACE(&ctx->trace, TRACE_DEBUG, "line %d: token %.*s", line_num, (int)token.len, token.ptr);
+
+		/*
+		 * If token is a supported instruction, increment by the size it assembles to:
+		 * 8 for "la", 4 otherwise.
+		 */
+		const inst_desc_t *inst = lookup_instruction(token.ptr, token.len);
+		if (inst != NULL) {
+			instruction_count = instruction_count + inst->size;
+		}
+
+		// If token is ".data", reset instruction to .data starting address
+		else if (token_equals(token, ".data")) {
+			instruction_count = DATA_BASE_ADDRESS;
+			data_reached = 1;
+			state->data_seen = 1;
+		}
+
+		TRACE(&ctx->trace, TRACE_DEBUG, "line %d: PC 0x%08x", line_num, instruction_count);
+
+		// In the .text section, tokens are labels or instructions
+		if (data_reached == 0) {
+
+			// if token has ':', then it is a label so add it to the symbol table
+			if (memchr(token.ptr, ':', token.len)) {
+
+				TRACE(&ctx->trace, TRACE_DEBUG, "line %d: label", line_num);
+				if (add_label(ctx, state, token, instruction_count) != 0)
+					break;
+			}
+
+			// The rest of the line holds the operands
+			else if (inst != NULL) {
+
+				if ((rec = new_record(ctx, inst->op, instruction_count, line_num)) == NULL)
+					break;
+				tokens += lex_operands(ctx, inst, tok_ptr, line_end, rec);
+				program->text_words += inst->size / 4;
+				ctx->stats.instructions++;
 				break;
 			}
 
-			printf("token: %s\n", token);
-
-			/*
-			 * If token is "la", increment by 8, otherwise if it exists in instructions[],
-			 * increment by 4.
-			 */
-			int x = search(token);
-			//int x = (binarySearch(instructions, 0, inst_len, token));
-			if (x >= 0) {
-				if (strcmp(token, "la") == 0)
-					instruction_count = instruction_count + 8;
-				else
-					instruction_count = instruction_count + 4;
+			continue;
+		}
+
+		// If .data has been reached, increment instruction count accordingly
+		// and store to the symbol table
+		const char *var_tok_ptr = tok_ptr;
+		size_t rest_len = line_end - tok_ptr;
+		token_view_t var_tok = { line_end, 0 };
+
+		// If variable is .word
+		if (memmem(tok_ptr, rest_len, ".word", 5)) {
+
+			TRACE(&ctx->trace, TRACE_DEBUG, "line %d: .word", line_num);
+
+			int freq = 1;
+			int var_value;
+
+			// Variable is array
+			if (memchr(var_tok_ptr, ':', rest_len)) {
+
+				TRACE(&ctx->trace, TRACE_DEBUG, "line %d: array", line_num);
+
+				// Store the number in var_tok and the occurance in var_tok_ptr
+				parse_token(&var_tok_ptr, line_end, ":", &var_tok, NULL);
+
+				// Extract array size, or variable frequency
+				freq = parse_int(var_tok_ptr, line_end);
+
+				// Extract variable value, which follows the .word directive
+				var_value = parse_word_value(var_tok.ptr, var_tok.ptr + var_tok.len);
 			}
 
-			// If token is ".data", reset instruction to .data starting address
-			else if (strcmp(token, ".data") == 0) {
-				instruction_count = 0x00002000;
-				data_reached = 1;
+			// Variable is a single variable
+			else {
+
+				var_value = parse_word_value(var_tok_ptr, line_end);
 			}
 
-			printf("PC Count: %d\n", instruction_count);
+			// Increment instruction count by freq
+			instruction_count = instruction_count + (freq * 4);
+			if (add_label(ctx, state, token, instruction_count) != 0)
+				break;
 
-			// If first pass, then add labels to hash table
-			if (pass == 1) {
+			if ((rec = new_record(ctx, IR_WORD, instruction_count, line_num)) == NULL)
+				break;
+			rec->imm = var_value;
+			rec->count = (freq > 0) ? freq : 0;
+			program->data_words += rec->count;
+			break;
+		}
 
-				printf("First pass\n");
+		// Variable is a string
+		else if (memmem(tok_ptr, rest_len, ".asciiz", 7)) {
 
-				// if token has ':', then it is a label so add it to hash table
-				if (strstr(token, ":") && data_reached == 0) {
+			// Store the ascii in var_tok
+			var_tok.ptr = line_end;
+			var_tok.len = 0;
+			if (rest_len > 8) {
+				var_tok_ptr += 8;
+				parse_token(&var_tok_ptr, line_end, "\"", &var_tok, NULL);
+			}
 
-					printf("Label\n");
+			// Increment instruction count by string length
+			instruction_count = instruction_count + var_tok.len;
+			if (add_label(ctx, state, token, instruction_count) != 0)
+				break;
 
-					// Strip out ':'
-					//printf("Label: %s at %d with address %d: \n", token, line_num, instruction_count);
-					size_t token_len = strlen(token);
-					token[token_len - 1] = '\0';
+			// Only a directive written as '.asciiz "...' is emitted
+			if (rest_len >= 9 && strncmp(".asciiz ", tok_ptr, 8) == 0) {
+				if ((rec = new_record(ctx, IR_ASCIIZ, instruction_count, line_num)) == NULL)
+					break;
+				rec->imm = var_tok.ptr - base;
+				rec->count = var_tok.len;
+				program->data_words += var_tok.len / 4 + 1;
+			}
+			break;
+		}
+	}
 
-					// Insert variable to hash table
-					uint32_t *inst_count;
-					inst_count = (uint32_t *)malloc(sizeof(uint32_t));
-					*inst_count = instruction_count;
-					int32_t insert = hash_insert(hash_table, token, strlen(token)+1, inst_count);
+	state->instruction_count = instruction_count;
+	state->data_reached = data_reached;
+	ctx->stats.lines++;
+	ctx->stats.tokens += tokens;
+	return ctx->failed ? -1 : 0;
+}
 
-					if (insert != 1) {
-						fprintf(Out, "Error inserting into hash table\n");
-						exit(1);
-					}
-				}
+// Lex the whole lines in [line, end), returning -1 after recording an error
+static int lex_lines(asm_context_t *ctx, lex_state_t *state, const char *line, const char *end, const char *base) {
 
-				// If .data has been reached, increment instruction count accordingly
-				// and store to hash table
-				else {
+	while (line < end) {
 
-					char *var_tok = NULL;
-					char *var_tok_ptr = tok_ptr;
+		const char *newline = memchr(line, '\n', end - line);
+		const char *line_end = (newline != NULL) ? newline : end;
 
-					// If variable is .word
-					if (strstr(tok_ptr, ".word")) {
+		if (lex_line(ctx, state, line, line_end, base) != 0)
+			return -1;
+		line = line_end + 1;
+	}
 
-						printf(".word\n");
+	return 0;
+}
 
-						// Variable is array
-						if (strstr(var_tok_ptr, ":")) {
+/*
+ * Pass 1: assign addresses to labels and decode every instruction and data
+ * directive into the record array of the context.
+ */
+static int lex_file(const source_t *src, asm_context_t *ctx) {
 
-							printf("array\n");
+	lex_state_t state = { .line_num = 0, .instruction_count = 0x00000000 };
+	line_view_t view;
+	size_t src_pos = 0;
 
-							// Store the number in var_tok and the occurance in var_tok_ptr
-							var_tok = parse_token(var_tok_ptr, ":", &var_tok_ptr, NULL);
+	while (source_next_line(src, &src_pos, &view))
+		if (lex_line(ctx, &state, view.ptr, view.ptr + view.len, src->data) != 0)
+			return -1;
 
-							// Convert char* to int
-							int freq = atoi(var_tok_ptr);
+	return 0;
+}
 
-							int num;
-							sscanf(var_tok, "%*s %d", &num);
+// Bytes of source per chunk below which pass 1 is not worth splitting
+#define LEX_CHUNK_MIN (256 * 1024)
+
+// A run of whole source lines lexed on its own in pass 1
+typedef struct {
+	const source_t *src;
+	const char *start;
+	const char *end;
+	asm_context_t ctx;		// Symbols and records local to the chunk
+	lex_state_t entry;		// State the chunk is lexed from
+	lex_state_t exit;		// State after its last line
+	int absolute;			// entry is the true state, so nothing needs relocating
+	uint32_t base;			// Added to the chunk's addresses once it is placed
+	uint32_t *symbol_map;	// Global id of each local symbol
+	csymtab_t *labels;		// Table the labels of every chunk are merged into
+	uint32_t index;			// Position of the chunk in the source
+	asm_program_t *program;	// The program the chunk's records are copied into
+	size_t first_record;	// Where they go in it
+} lex_chunk_t;
+
+// Count the lines of a chunk into entry.line_num
+static void count_chunk_lines(void *arg) {
+
+	lex_chunk_t *chunk = arg;
+	const char *ptr = chunk->start;
+	int32_t lines = 0;
+
+	while (ptr < chunk->end && (ptr = memchr(ptr, '\n', chunk->end - ptr)) != NULL) {
+		ptr++;
+		lines++;
+	}
 
-							// Increment instruction count by freq
-							instruction_count = instruction_count + (freq * 4);
+	chunk->entry.line_num = lines;
+}
 
-							// Strip out ':' from token
-							size_t token_len = strlen(token);
-							token[token_len - 1] = '\0';
+// Lex the lines of a chunk from its entry state into its own context
+static void lex_chunk(void *arg) {
 
-							//printf("Key: '%s', len: %zd\n", token, strlen(token));
+	lex_chunk_t *chunk = arg;
+	lex_state_t state = chunk->entry;
 
-							// Insert variable to hash table
-							uint32_t *inst_count;
-							inst_count = (uint32_t *)malloc(sizeof(uint32_t));
-							*inst_count = instruction_count;
-							int32_t insert = hash_insert(hash_table, token, strlen(token)+1, inst_count);
+	asm_context_reset(&chunk->ctx);
+	state.data_seen = 0;
 
-							if (insert == 0) {
-								fprintf(Out, "Error in hash table insertion\n");
-								exit(1);
-							}
+	lex_lines(&chunk->ctx, &state, chunk->start, chunk->end, chunk->src->data);
+	chunk->exit = state;
+}
 
-							printf("End array\n");
-						}
+// Copy the records of a chunk into the program, relocated and with global symbol ids
+static void place_chunk(void *arg) {
 
-						// Variable is a single variable
-						else {
+	lex_chunk_t *chunk = arg;
+	const asm_program_t *local = &chunk->ctx.program;
+	asm_inst_t *rec = &chunk->program->insts[chunk->first_record];
 
-							instruction_count = instruction_count + 4;
+	for (size_t i = 0; i < local->count; i++, rec++) {
+		*rec = local->insts[i];
+		rec->addr += chunk->base;
+		if (rec->sym != IR_NO_SYMBOL)
+			rec->sym = chunk->symbol_map[rec->sym];
+	}
+}
 
-							// Strip out ':' from token
-							size_t token_len = strlen(token);
-							token[token_len - 1] = '\0';
+/*
+ * Lex the chunks and place them in order, tracking the true state between
+ * them. Returns the number of records, or -1 after recording an error.
+ */
+static ssize_t lex_chunks(asm_context_t *ctx, lex_chunk_t *chunks, size_t chunk_count) {
+
+	thread_pool_t *pool = ctx->pool;
+	asm_program_t *program = &ctx->program;
+
+	// Number the lines of each chunk from the lines before it
+	for (size_t c = 0; c < chunk_count; c++)
+		if (thread_pool_submit(pool, count_chunk_lines, &chunks[c]) != 0)
+			count_chunk_lines(&chunks[c]);
+	thread_pool_wait(pool);
+
+	int32_t lines = 0;
+	for (size_t c = 0; c < chunk_count; c++) {
+		int32_t chunk_lines = chunks[c].entry.line_num;
+		chunks[c].entry = (lex_state_t){ .line_num = lines, .instruction_count = 0x00000000 };
+		lines += chunk_lines;
+	}
 
-							// Insert variable to hash table
-							uint32_t *inst_count;
-							inst_count = (uint32_t *)malloc(sizeof(uint32_t));
-							*inst_count = instruction_count;
-							int32_t insert = hash_insert(hash_table, token, strlen(token)+1, inst_count);
+	// Only the first chunk knows where it starts
+	chunks[0].absolute = 1;
+	for (size_t c = 0; c < chunk_count; c++)
+		if (thread_pool_submit(pool, lex_chunk, &chunks[c]) != 0)
+			lex_chunk(&chunks[c]);
+	thread_pool_wait(pool);
 
-							if (insert == 0) {
-								fprintf(Out, "Error in hash table insertion\n");
-								exit(1);
-							}
+	lex_state_t state = { .line_num = 0, .instruction_count = 0x00000000 };
+	size_t record_count = 0;
 
-							printf("end singe var\n");
-						}
-					}
+	for (size_t c = 0; c < chunk_count; c++) {
 
-					// Variable is a string
-					else if (strstr(tok_ptr, ".asciiz")) {
+		lex_chunk_t *chunk = &chunks[c];
 
-						// Store the ascii in var_tok
-						var_tok_ptr+= 8;
-						var_tok = parse_token(var_tok_ptr, "\"", &var_tok_ptr, NULL);
+		// The data section began in an earlier chunk
+		if (!chunk->absolute && chunk->entry.data_reached != state.data_reached) {
+			for (size_t k = c; k < chunk_count; k++) {
+				chunks[k].entry.data_reached = state.data_reached;
+				if (thread_pool_submit(pool, lex_chunk, &chunks[k]) != 0)
+					lex_chunk(&chunks[k]);
+			}
+			thread_pool_wait(pool);
+		}
 
-						// Increment instruction count by string length
-						size_t str_byte_len = strlen(var_tok);
-						instruction_count = instruction_count + str_byte_len;
+		// .data resets the location counter, so its chunk needs the true start
+		if (!chunk->absolute && chunk->exit.data_seen) {
+			chunk->entry.instruction_count = state.instruction_count;
+			chunk->entry.data_reached = state.data_reached;
+			chunk->absolute = 1;
+			lex_chunk(chunk);
+		}
 
-						// Strip out ':' from token
-						size_t token_len = strlen(token);
-						token[token_len - 1] = '\0';
+		if (chunk->ctx.failed)
+			return asm_error(ctx, "%s", chunk->ctx.error);
 
-						// Insert variable to hash table
-						uint32_t *inst_count;
-						inst_count = (uint32_t *)malloc(sizeof(uint32_t));
-						*inst_count = instruction_count;
-						int32_t insert = hash_insert(hash_table, token, strlen(token)+1, inst_count);
+		chunk->base = chunk->absolute ? 0 : state.instruction_count;
+		chunk->first_record = record_count;
+		record_count += chunk->ctx.program.count;
+		program->text_words += chunk->ctx.program.text_words;
+		program->data_words += chunk->ctx.program.data_words;
+		ctx->stats.lines += chunk->ctx.stats.lines;
+		ctx->stats.tokens += chunk->ctx.stats.tokens;
+		ctx->stats.instructions += chunk->ctx.stats.instructions;
 
-						if (insert == 0) {
-							fprintf(Out, "Error in hash table insertion\n");
-							exit(1);
-						}
-					}
-				}
-			}
+		state.instruction_count = chunk->base + chunk->exit.instruction_count;
+		state.data_reached = chunk->exit.data_reached;
+	}
 
-			// If second pass, then interpret
-			else if (pass == 2) {
-
-				printf("############    Pass 2   ##############\n");
-
-				// start interpreting here
-				// if j loop --> then instruction is: 000010 then immediate is insturction count in 26 bits??
-
-				// If in .text section
-				if (data_reached == 0) {
-
-					// Check instruction type
-					int instruction_supported = search(token);
-					char inst_type;
-
-					// If instruction is supported
-					if (instruction_supported != -1) {
-
-						// token contains the instruction
-						// tok_ptr points to the rest of the line
-
-						// Determine instruction type
-						inst_type = instruction_type(token);
-
-						if (inst_type == 'r') {
-
-							// R-Type with $rd, $rs, $rt format
-							if (strcmp(token, "add") == 0 || strcmp(token, "sub") == 0
-									|| strcmp(token, "and") == 0
-									|| strcmp(token, "or") == 0 || strcmp(token, "slt") == 0) {
-
-								// Parse the instructio - get rd, rs, rt registers
-								char *inst_ptr = tok_ptr;
-								char *reg = NULL;
-
-								// Create an array of char* that stores rd, rs, rt respectively
-								char **reg_store;
-								reg_store = malloc(3 * sizeof(char*));
-								if (reg_store == NULL) {
-									fprintf(Out, "Out of memory\n");
-									exit(1);
-								}
-
-								for (int i = 0; i < 3; i++) {
-									reg_store[i] = malloc(2 * sizeof(char));
-									if (reg_store[i] == NULL) {
-										fprintf(Out, "Out of memory\n");
-										exit(1);
-									}
-								}
-
-								// Keeps a reference to which register has been parsed for storage
-								int count = 0;
-								while (1) {
-
-									reg = parse_token(inst_ptr, " $,\n\t", &inst_ptr, NULL);
-
-									if (reg == NULL || *reg == '#') {
-										break;
-									}
-
-									strcpy(reg_store[count], reg);
-									count++;
-									free(reg);
-								}
-
-								// Send reg_store for output
-								// rd is in position 0, rs is in position 1 and rt is in position 2
-								rtype_instruction(token, reg_store[1], reg_store[2], reg_store[0], 0, Out);
-
-								// Dealloc reg_store
-								for (int i = 0; i < 3; i++) {
-									free(reg_store[i]);
-								}
-								free(reg_store);
-							}
-
-							// R-Type with $rd, $rs, shamt format
-							else if (strcmp(token, "sll") == 0 || strcmp(token, "srl") == 0) {
-
-								// Parse the instructio - get rd, rs, rt registers
-								char *inst_ptr = tok_ptr;
-								char *reg = NULL;
-
-								// Create an array of char* that stores rd, rs and shamt
-								char **reg_store;
-								reg_store = malloc(3 * sizeof(char*));
-								if (reg_store == NULL) {
-									fprintf(Out, "Out of memory\n");
-									exit(1);
-								}
-
-								for (int i = 0; i < 3; i++) {
-									reg_store[i] = malloc(2 * sizeof(char));
-									if (reg_store[i] == NULL) {
-										fprintf(Out, "Out of memory\n");
-										exit(1);
-									}
-								}
-
-								// Keeps a reference to which register has been parsed for storage
-								int count = 0;
-								while (1) {
-
-									reg = parse_token(inst_ptr, " $,\n\t", &inst_ptr, NULL);
-
-									if (reg == NULL || *reg == '#') {
-										break;
-									}
-
-									strcpy(reg_store[count], reg);
-									count++;
-									free(reg);
-								}
-
-								// Send reg_store for output
-								// rd is in position 0, rs is in position 1 and shamt is in position 2
-								rtype_instruction(token, "00000", reg_store[1], reg_store[0], atoi(reg_store[2]), Out);
-
-								// Dealloc reg_store
-								for (int i = 0; i < 3; i++) {
-									free(reg_store[i]);
-								}
-								free(reg_store);
-							}
-
-							else if (strcmp(token, "jr") == 0) {
-
-								// Parse the instruction - rs is in tok_ptr
-								char *inst_ptr = tok_ptr;
-								char *reg = NULL;
-								reg = parse_token(inst_ptr, " $,\n\t", &inst_ptr, NULL);
-
-								rtype_instruction(token, reg, "00000", "00000", 0, Out);
-							}
-						}
-
-						// I-Type
-						else if (inst_type == 'i') {
-
-							// la is pseudo instruction for lui and ori
-							// Convert to lui and ori and pass those instructions
-							if (strcmp(token, "la") == 0) {
-
-								// Parse the instruction - get register & immediate
-								char *inst_ptr = tok_ptr;
-								char *reg = NULL;
-
-								// Create an array of char* that stores rd, rs and shamt
-								char **reg_store;
-								reg_store = malloc(2 * sizeof(char*));
-								if (reg_store == NULL) {
-									fprintf(Out, "Out of memory\n");
-									exit(1);
-								}
-
-								for (int i = 0; i < 2; i++) {
-									reg_store[i] = malloc(2 * sizeof(char));
-									if (reg_store[i] == NULL) {
-										fprintf(Out, "Out of memory\n");
-										exit(1);
-									}
-								}
-
-								// Keeps a reference to which register has been parsed for storage
-								int count = 0;
-								while (1) {
-
-									reg = parse_token(inst_ptr, " $,\n\t", &inst_ptr, NULL);
-
-									if (reg == NULL || *reg == '#') {
-										break;
-									}
-
-									strcpy(reg_store[count], reg);
-									count++;
-									free(reg);
-								}
-
-								// Interpret la instruction.
-								// The register is at reg_store[0] and the variable is at reg_store[1]
-
-								// Find address of label in hash table
-								int *address = hash_find(hash_table, reg_store[1], strlen(reg_store[1])+1);
-
-								// Convert address to binary in char*
-								char addressBinary[33];
-								getBin(*address, addressBinary, 32);
-
-								// Get upper and lower bits of address
-								char upperBits[16];
-								char lowerBits[16];
-
-								for (int i = 0; i < 32; i++) {
-									if (i < 16)
-										lowerBits[i] = addressBinary[i];
-									else
-										upperBits[i-16] = addressBinary[i];
-								}
-
-								// Call the lui instruction with: lui $reg, upperBits
-								// Convert upperBits binary to int
-								int immediate = getDec(upperBits);
-								itype_instruction("lui", "00000", reg_store[0], immediate, Out);
-
-								// Call the ori instruction with: ori $reg, $reg, lowerBits
-								// Convert lowerBits binary to int
-								immediate = getDec(lowerBits);
-								itype_instruction("ori", reg_store[0], reg_store[0], immediate, Out);
-
-								// Dealloc reg_store
-								for (int i = 0; i < 2; i++) {
-									free(reg_store[i]);
-								}
-								free(reg_store);
-							}
-
-							// I-Type $rt, i($rs)
-							else if (strcmp(token, "lw") == 0 || strcmp(token, "sw") == 0) {
-
-								// Parse the instructio - rt, immediate and rs
-								char *inst_ptr = tok_ptr;
-								char *reg = NULL;
-								//
-								// Create an array of char* that stores rd, rs, rt respectively
-								char **reg_store;
-								reg_store = malloc(3 * sizeof(char*));
-								if (reg_store == NULL) {
-									fprintf(Out, "Out of memory\n");
-									exit(1);
-								}
-
-								for (int i = 0; i < 3; i++) {
-									reg_store[i] = malloc(2 * sizeof(char));
-									if (reg_store[i] == NULL) {
-										fprintf(Out, "Out of memory\n");
-										exit(1);
-									}
-								}
-
-								// Keeps a reference to which register has been parsed for storage
-								int count = 0;
-								while (1) {
-
-									reg = parse_token(inst_ptr, " $,\n\t()", &inst_ptr, NULL);
-
-									if (reg == NULL || *reg == '#') {
-										break;
-									}
-
-									strcpy(reg_store[count], reg);
-									count++;
-									free(reg);
-								}
-
-								// rt in position 0, immediate in position 1 and rs in position2
-								int immediate = atoi(reg_store[1]);
-								itype_instruction(token, reg_store[2], reg_store[0], immediate, Out);
-
-								// Dealloc reg_store
-								for (int i = 0; i < 3; i++) {
-									free(reg_store[i]);
-								}
-								free(reg_store);
-							}
-
-							// I-Type rt, rs, im
-							else if (strcmp(token, "andi") == 0 || strcmp( token, "ori") == 0
-									|| strcmp(token, "slti") == 0 || strcmp(token, "addi") == 0) {
-
-								// Parse the instruction - rt, rs, immediate
-								char *inst_ptr = tok_ptr;
-								char *reg = NULL;
-
-								// Create an array of char* that stores rt, rs
-								char **reg_store;
-								reg_store = malloc(3 * sizeof(char*));
-								if (reg_store == NULL) {
-									fprintf(Out, "Out of memory\n");
-									exit(1);
-								}
-
-								for (int i = 0; i < 3; i++) {
-									reg_store[i] = malloc(2 * sizeof(char));
-									if (reg_store[i] == NULL) {
-										fprintf(Out, "Out of memory\n");
-										exit(1);
-									}
-								}
-
-								// Keeps a reference to which register has been parsed for storage
-								int count = 0;
-								while (1) {
-
-									reg = parse_token(inst_ptr, " $,\n\t", &inst_ptr, NULL);
-
-									if (reg == NULL || *reg == '#') {
-										break;
-									}
-
-									strcpy(reg_store[count], reg);
-									count++;
-									free(reg);
-								}
-
-								// rt in position 0, rs in position 1 and immediate in position 2
-								int immediate = atoi(reg_store[2]);
-								itype_instruction(token, reg_store[1], reg_store[0], immediate, Out);
-
-								// Dealloc reg_store
-								for (int i = 0; i < 3; i++) {
-									free(reg_store[i]);
-								}
-								free(reg_store);
-							}
-
-							// I-Type $rt, immediate
-							else if (strcmp(token, "lui") == 0) {
-
-								// Parse the insturction,  rt - immediate
-								char *inst_ptr = tok_ptr;
-								char *reg = NULL;
-
-								// Create an array of char* that stores rs, rt
-								char **reg_store;
-								reg_store = malloc(2 * sizeof(char*));
-								if (reg_store == NULL) {
-									fprintf(Out, "Out of memory\n");
-									exit(1);
-								}
-
-								for (int i = 0; i < 2; i++) {
-									reg_store[i] = malloc(2 * sizeof(char));
-									if (reg_store[i] == NULL) {
-										fprintf(Out, "Out of memory\n");
-										exit(1);
-									}
-								}
-
-								// Keeps a reference to which register has been parsed for storage
-								int count = 0;
-								while (1) {
-
-									reg = parse_token(inst_ptr, " $,\n\t", &inst_ptr, NULL);
-
-									if (reg == NULL || *reg == '#') {
-										break;
-									}
-
-									strcpy(reg_store[count], reg);
-									count++;
-									free(reg);
-								}
-
-
-								// rt in position 0, immediate in position 1
-								int immediate = atoi(reg_store[1]);
-								itype_instruction(token, "00000", reg_store[0], immediate, Out);
-
-								// Dealloc reg_store
-								for (int i = 0; i < 3; i++) {
-									free(reg_store[i]);
-								}
-								free(reg_store);
-							}
-
-							// I-Type $rs, $rt, label
-							else if (strcmp(token, "beq") == 0) {
-
-								// Parse the instruction - rs, rt
-								char *inst_ptr = tok_ptr;
-								char *reg = NULL;
-
-								// Create an array of char* that stores rs, rt
-								char **reg_store;
-								reg_store = malloc(2 * sizeof(char*));
-								if (reg_store == NULL) {
-									fprintf(Out, "Out of memory\n");
-									exit(1);
-								}
-
-								for (int i = 0; i < 2; i++) {
-									reg_store[i] = malloc(2 * sizeof(char));
-									if (reg_store[i] == NULL) {
-										fprintf(Out, "Out of memory\n");
-										exit(1);
-									}
-								}
-
-								// Keeps a reference to which register has been parsed for storage
-								int count = 0;
-								while (1) {
-
-									reg = parse_token(inst_ptr, " $,\n\t", &inst_ptr, NULL);
-
-									if (reg == NULL || *reg == '#') {
-										break;
-									}
-
-									strcpy(reg_store[count], reg);
-									count++;
-									free(reg);
-
-									if (count == 2)
-										break;
-								}
-
-								reg = parse_token(inst_ptr, " $,\n\t", &inst_ptr, NULL);
-
-								// Find hash address for a register and put in an immediate
-								int *address = hash_find(hash_table, reg, strlen(reg)+1);
-								
-								int immediate = *address + instruction_count;
-
-								// Send instruction to itype function
-								itype_instruction(token, reg_store[0], reg_store[1], immediate, Out);
-
-								// Dealloc reg_store
-								for (int i = 0; i < 2; i++) {
-									free(reg_store[i]);
-								}
-								free(reg_store);
-							}
-						}
-
-						// J-Type
-						else if (inst_type == 'j') {
-
-							// Parse the instruction - get label
-							char *inst_ptr = tok_ptr;
-
-							// If comment, extract the label alone
-							char *comment = strchr(inst_ptr, '#');
-							if (comment != NULL) {							
-
-								int str_len_count = 0;
-								for (int i = 0; i < strlen(inst_ptr); i++) {
-									if (inst_ptr[i] != ' ')
-										str_len_count++;
-									else
-										break;
-								}
+	return record_count;
+}
 
-								char new_label[str_len_count+1];
-								for (int i = 0; i < str_len_count; i++)
-									new_label[i] = inst_ptr[i];
-								new_label[str_len_count] = '\0';
+// Merge the labels of a chunk into the shared table
+static void merge_chunk(void *arg) {
 
-								strcpy(inst_ptr, new_label);
-							}
-
-							else { printf("NO COMMENT\n");
-								inst_ptr[strlen(inst_ptr)-1] = '\0'; 
-							}
-
-							// Find hash address for a label and put in an immediate
-							int *address = hash_find(hash_table, inst_ptr, strlen(inst_ptr)+1);
-							
-							// Send to jtype function
-							jtype_instruction(token, *address, Out);
-						}
-					}
-
-					if (strcmp(token, "nop") == 0) {
-						fprintf(Out, "00000000000000000000000000000000\n");
-					}
-				}
+	lex_chunk_t *chunk = arg;
+	const symtab_t *local = chunk->ctx.symbols;
 
-				// If .data part reached
-				else {
-
-					char *var_tok = NULL;
-					char *var_tok_ptr = tok_ptr;
-
-					// If variable is .word
-					if (strstr(tok_ptr, ".word")) {
+	for (uint32_t id = 0; id < local->count; id++) {
 
-						int var_value;
+		const symtab_entry_t *entry = &local->entries[id];
+		uint32_t global = csymtab_intern_hash(chunk->labels, symtab_key(entry), entry->key_len, entry->hash);
+		if (global == CSYMTAB_NONE) {
+			asm_error(&chunk->ctx, "Error inserting into symbol table");
+			return;
+		}
 
-						// Variable is array
-						if (strstr(var_tok_ptr, ":")) {
+		// An earlier chunk's definition wins, whichever chunk gets here first
+		if (entry->flags & SYMTAB_DEFINED)
+			csymtab_define(chunk->labels, global, entry->value + chunk->base, chunk->index);
+		chunk->symbol_map[id] = global;
+	}
+}
 
-							// Store the number in var_tok and the occurance in var_tok_ptr
-							var_tok = parse_token(var_tok_ptr, ":", &var_tok_ptr, NULL);
+/*
+ * Merge the labels of the chunks into the global table. The chunks are merged
+ * at once into a concurrent table, which is then copied into the empty global
+ * table in id order so that the ids carry over. Entries that lost a race for
+ * their key keep their id as deleted entries.
+ */
+static int merge_chunk_labels(asm_context_t *ctx, lex_chunk_t *chunks, size_t chunk_count) {
 
-							// Extract array size, or variable frequency
-							int freq = atoi(var_tok_ptr);
+	uint32_t symbol_count = 0;
+	for (size_t c = 0; c < chunk_count; c++)
+		symbol_count += chunks[c].ctx.symbols->count;
 
-							// Extract variable value
-							sscanf(var_tok, "%*s %d", &var_value);
+	csymtab_t *labels = csymtab_create(symbol_count);
+	if (labels == NULL)
+		return asm_error(ctx, "Out of memory");
 
-							// Value var_value is repeated freq times. Send to binary rep function
-							for (int i = 0; i < freq; i++) {
-								word_rep(var_value, Out);
-							}
-						}
+	for (size_t c = 0; c < chunk_count; c++) {
+		chunks[c].symbol_map = malloc((chunks[c].ctx.symbols->count + 1) * sizeof(uint32_t));
+		if (chunks[c].symbol_map == NULL) {
+			csymtab_destroy(labels);
+			return asm_error(ctx, "Out of memory");
+		}
+		chunks[c].labels = labels;
+		chunks[c].index = c;
+	}
 
-						// Variable is a single variable
-						else {
+	for (size_t c = 0; c < chunk_count; c++)
+		if (thread_pool_submit(ctx->pool, merge_chunk, &chunks[c]) != 0)
+			merge_chunk(&chunks[c]);
+	thread_pool_wait(ctx->pool);
 
-							// Extract variable value
-							sscanf(var_tok_ptr, "%*s, %d", &var_value);
+	for (size_t c = 0; c < chunk_count; c++)
+		if (chunks[c].ctx.failed) {
+			csymtab_destroy(labels);
+			return asm_error(ctx, "%s", chunks[c].ctx.error);
+		}
 
-							// Variable is in var_value. Send to binary rep function
-							word_rep(var_value, Out);
-						}
-					}
+	uint32_t count = csymtab_count(labels);
+	for (uint32_t id = 0; id < count && !ctx->failed; id++) {
 
-					// Variable is a string
-					else if (strstr(tok_ptr, ".asciiz")) {
+		const csymtab_entry_t *entry = csymtab_entry(labels, id);
+		uint32_t value = 0, flags = 0;
 
-						printf("tok_ptr '%s'\n", tok_ptr);
+		if (!entry->live)
+			flags = SYMTAB_DELETED;
+		else if (csymtab_value(labels, id, &value))
+			flags = SYMTAB_DEFINED;
 
-						if (strncmp(".asciiz ", var_tok_ptr, 8) == 0) {
+		if (symtab_append(ctx->symbols, entry->key, entry->key_len, entry->hash, value, flags) != id)
+			asm_error(ctx, "Error inserting into symbol table");
+	}
 
-							// Move var_tok_ptr to beginning of string
-							var_tok_ptr = var_tok_ptr + 9;
+	csymtab_destroy(labels);
+	return ctx->failed ? -1 : 0;
+}
 
-							// Strip out quotation at the end
-							// Place string in var_tok
-							var_tok = parse_token(var_tok_ptr, "\"", &var_tok_ptr, NULL);
+/*
+ * Pass 1 on the thread pool. The source is split at line boundaries and every
+ * chunk is lexed at once into its own context, assuming the text section and
+ * a location counter starting at 0. The chunks are then placed in order: a
+ * chunk lexed in the wrong section is lexed again, along with all later
+ * chunks, in the data section; a chunk that contains .data itself is lexed
+ * again from its true location counter. Every other chunk is relocated by the
+ * sum of the sizes before it. The labels of all chunks are merged at once,
+ * and the first definition in source order still wins.
+ */
+static int lex_parallel(const source_t *src, asm_context_t *ctx) {
+
+	thread_pool_t *pool = ctx->pool;
+	asm_program_t *program = &ctx->program;
+	size_t chunk_count = (size_t)pool->thread_count * 2;
+	if (chunk_count > src->len / LEX_CHUNK_MIN)
+		chunk_count = src->len / LEX_CHUNK_MIN;
+
+	lex_chunk_t *chunks = calloc(chunk_count, sizeof(lex_chunk_t));
+	if (chunks == NULL)
+		return asm_error(ctx, "Out of memory");
+
+	// Split after the newline nearest each even share of the source
+	const char *src_end = src->data + src->len;
+	const char *start = src->data;
+	size_t ready = 0;
+
+	for (size_t c = 0; c < chunk_count; c++) {
+
+		const char *end = src_end;
+		if (c + 1 < chunk_count) {
+			end = src->data + src->len * (c + 1) / chunk_count;
+			if (end < start)
+				end = start;
+			const char *newline = memchr(end, '\n', src_end - end);
+			end = (newline != NULL) ? newline + 1 : src_end;
+		}
 
-							ascii_rep(var_tok, Out);
-						}
-					}
-				}
-			}
+		chunks[c].src = src;
+		chunks[c].start = start;
+		chunks[c].end = end;
+		chunks[c].program = program;
+		start = end;
 
-			free(token);
+		if (asm_context_init(&chunks[c].ctx) != 0)
+			break;
+		ready++;
+	}
+
+	ssize_t record_count = -1;
+	if (ready < chunk_count)
+		asm_error(ctx, "Out of memory");
+	else
+		record_count = lex_chunks(ctx, chunks, chunk_count);
+
+	if (record_count >= 0 && merge_chunk_labels(ctx, chunks, chunk_count) == 0) {
+
+		if (program_reserve(program, record_count) != 0)
+			asm_error(ctx, "Out of memory");
+
+		else {
+			for (size_t c = 0; c < chunk_count; c++)
+				if (thread_pool_submit(pool, place_chunk, &chunks[c]) != 0)
+					place_chunk(&chunks[c]);
+			thread_pool_wait(pool);
+			program->count = record_count;
 		}
 	}
+
+	for (size_t c = 0; c < chunk_count; c++) {
+		free(chunks[c].symbol_map);
+		asm_context_free(&chunks[c].ctx);
+	}
+	free(chunks);
+
+	return ctx->failed ? -1 : 0;
 }
 
-// Binary Search the Array
-int binarySearch(char *instructions[], int low, int high, char *string) {
+// Words a record emits into .text
+static inline size_t record_text_words(const asm_inst_t *rec) {
 
-	int mid = low + (high - low) / 2;
-	int comp = strcmp(instructions[mid], string);\
+	return (rec->op < OP_COUNT) ? instruction_set[rec->op].size / 4 : 0;
+}
 
-	if (comp == 0)
-		return mid;
+// Words a record emits into .data
+static inline size_t record_data_words(const asm_inst_t *rec) {
 
-	// Not found
-	if (high <= low)
-		return -1;
+	if (rec->op == IR_WORD)
+		return rec->count;
+	if (rec->op == IR_ASCIIZ)
+		return rec->count / 4 + 1;
+	return 0;
+}
+
+/*
+ * Encode one record whose label operand, if it has one, is at address label.
+ * Its words are stored at text or data, which have room for them. .asciiz
+ * strings are read at their offset from base.
+ */
+static void encode_words(const asm_inst_t *rec, int32_t label, const char *base, uint32_t *text, uint32_t *data) {
+
+	const inst_desc_t *inst = &instruction_set[rec->op < OP_COUNT ? rec->op : 0];
 
-	// If instructions[mid] is less than string
-	else if (comp > 0)
-		return binarySearch(instructions, low, mid - 1, string);
+	switch (rec->op) {
 
-	// If instructions[mid] is larger than string
-	else if (comp < 0)
-		return binarySearch(instructions, mid + 1, high, string);
+	// Data directives
+	case IR_WORD:
+		for (uint32_t k = 0; k < rec->count; k++)
+			data[k] = rec->imm;
+		return;
 
-	// Return position
+	case IR_ASCIIZ:
+		ascii_rep(base + rec->imm, rec->count, data);
+		return;
+
+	// la is pseudo instruction for lui and ori
+	// lui $reg, upper 16 bits followed by ori $reg, $reg, lower 16 bits
+	case OP_LA:
+		text[0] = encode_itype(&instruction_set[OP_LUI], 0, rec->rt, (uint32_t)label >> 16);
+		text[1] = encode_itype(&instruction_set[OP_ORI], rec->rt, rec->rt, label & 0xffff);
+		return;
+
+	// Branch offsets are the label address plus the address of the next instruction
+	case OP_BEQ:
+		text[0] = encode_itype(inst, rec->rs, rec->rt, label + rec->addr);
+		return;
+	}
+
+	if (inst->format == 'r')
+		text[0] = encode_rtype(inst, rec->rs, rec->rt, rec->rd, rec->imm);
+	else if (inst->format == 'i')
+		text[0] = encode_itype(inst, rec->rs, rec->rt, rec->imm);
 	else
-		return mid;
+		text[0] = encode_jtype(inst, label);
+}
+
+// Encode one record at the end of the output sections, deferring forward references
+static int encode_record(asm_context_t *ctx, const asm_inst_t *rec, const char *base) {
 
-	// Error
-	return -2;
+	word_buffer_t *text = &ctx->output.text;
+	word_buffer_t *data = &ctx->output.data;
+	size_t text_words = record_text_words(rec);
+	size_t data_words = record_data_words(rec);
+
+	int32_t label = (rec->sym != IR_NO_SYMBOL) ? label_operand(ctx, rec) : 0;
+	if (ctx->failed)
+		return -1;
+
+	if (word_buffer_reserve(text, text_words) != 0 || word_buffer_reserve(data, data_words) != 0)
+		return asm_error(ctx, "Out of memory");
+
+	encode_words(rec, label, base, text->words + text->count, data->words + data->count);
+	text->count += text_words;
+	data->count += data_words;
+	return 0;
+}
+
+// Records [first, last) of the program, encoded as one unit of pass 2
+typedef struct {
+	const asm_context_t *ctx;
+	const char *base;
+	size_t first;
+	size_t last;
+	size_t text_offset;		// Where the words of the chunk start in each section
+	size_t data_offset;
+	size_t error;			// First record with an undefined label, or last
+} encode_chunk_t;
+
+// Records per chunk below which pass 2 is not worth splitting
+#define ENCODE_CHUNK_MIN 4096
+
+// Count the words a chunk emits into text_offset and data_offset
+static void count_chunk(void *arg) {
+
+	encode_chunk_t *chunk = arg;
+	const asm_inst_t *insts = chunk->ctx->program.insts;
+
+	chunk->text_offset = 0;
+	chunk->data_offset = 0;
+	for (size_t i = chunk->first; i < chunk->last; i++) {
+		chunk->text_offset += record_text_words(&insts[i]);
+		chunk->data_offset += record_data_words(&insts[i]);
+	}
 }
 
-// Determine Instruction Type
-char instruction_type(char *instruction) {
+/*
+ * Encode the records of a chunk at its offsets in the output sections. The
+ * symbol table is only read, so chunks can be encoded concurrently.
+ */
+static void encode_chunk(void *arg) {
+
+	encode_chunk_t *chunk = arg;
+	const asm_context_t *ctx = chunk->ctx;
+	const symtab_entry_t *entries = ctx->symbols->entries;
+	uint32_t *text = ctx->output.text.words + chunk->text_offset;
+	uint32_t *data = ctx->output.data.words + chunk->data_offset;
+
+	chunk->error = chunk->last;
+	for (size_t i = chunk->first; i < chunk->last; i++) {
 
-	if (strcmp(instruction, "add") == 0 || strcmp(instruction, "sub") == 0
-			|| strcmp(instruction, "and") == 0 || strcmp(instruction, "or")
-			== 0 || strcmp(instruction, "sll") == 0 || strcmp(instruction,
-			"slt") == 0 || strcmp(instruction, "srl") == 0 || strcmp(
-			instruction, "jr") == 0) {
+		const asm_inst_t *rec = &ctx->program.insts[i];
+		int32_t label = 0;
 
-		return 'r';
+		if (rec->sym != IR_NO_SYMBOL) {
+			if (!(entries[rec->sym].flags & SYMTAB_DEFINED)) {
+				chunk->error = i;
+				return;
+			}
+			label = entries[rec->sym].value;
+		}
+
+		encode_words(rec, label, chunk->base, text, data);
+		text += record_text_words(rec);
+		data += record_data_words(rec);
 	}
+}
 
-	else if (strcmp(instruction, "lw") == 0 || strcmp(instruction, "sw") == 0
-			|| strcmp(instruction, "andi") == 0 || strcmp(instruction, "ori")
-			== 0 || strcmp(instruction, "lui") == 0 || strcmp(instruction,
-			"beq") == 0 || strcmp(instruction, "slti") == 0 || strcmp(
-			instruction, "addi") == 0 || strcmp(instruction, "la") == 0) {
+/*
+ * Pass 2: resolve label operands and encode every record into the output
+ * sections. With a thread pool in the context the records are split into
+ * chunks; each chunk's words go to a range of the sections found by
+ * counting the chunks first, so the output matches the serial run.
+ */
+static int encode_program(const source_t *src, asm_context_t *ctx) {
+
+	const asm_program_t *program = &ctx->program;
+	output_t *output = &ctx->output;
+	thread_pool_t *pool = ctx->pool;
+
+	TRACE(&ctx->trace, TRACE_INFO, "pass 2: %zu records, %zu text and %zu data words",
+			program->count, program->text_words, program->data_words);
+
+	if (word_buffer_reserve(&output->text, program->text_words) != 0
+			|| word_buffer_reserve(&output->data, program->data_words) != 0)
+		return asm_error(ctx, "Out of memory");
+
+	size_t chunk_count = 1;
+	if (pool != NULL) {
+		chunk_count = (size_t)pool->thread_count * 4;
+		if (chunk_count > program->count / ENCODE_CHUNK_MIN)
+			chunk_count = program->count / ENCODE_CHUNK_MIN;
+		if (chunk_count == 0)
+			chunk_count = 1;
+	}
 
-		return 'i';
+	encode_chunk_t single;
+	encode_chunk_t *chunks = (chunk_count == 1) ? &single : malloc(chunk_count * sizeof(encode_chunk_t));
+	if (chunks == NULL)
+		return asm_error(ctx, "Out of memory");
+
+	for (size_t c = 0; c < chunk_count; c++) {
+		chunks[c].ctx = ctx;
+		chunks[c].base = src->data;
+		chunks[c].first = program->count * c / chunk_count;
+		chunks[c].last = program->count * (c + 1) / chunk_count;
+		chunks[c].text_offset = 0;
+		chunks[c].data_offset = 0;
 	}
 
-	else if (strcmp(instruction, "j") == 0 || strcmp(instruction, "jal") == 0) {
-		return 'j';
+	if (chunk_count == 1)
+		encode_chunk(&single);
+
+	else {
+
+		// Size every chunk, then turn the sizes into starting offsets
+		for (size_t c = 0; c < chunk_count; c++)
+			if (thread_pool_submit(pool, count_chunk, &chunks[c]) != 0)
+				count_chunk(&chunks[c]);
+		thread_pool_wait(pool);
+
+		size_t text_offset = 0, data_offset = 0;
+		for (size_t c = 0; c < chunk_count; c++) {
+			size_t text_words = chunks[c].text_offset, data_words = chunks[c].data_offset;
+			chunks[c].text_offset = text_offset;
+			chunks[c].data_offset = data_offset;
+			text_offset += text_words;
+			data_offset += data_words;
+		}
+
+		for (size_t c = 0; c < chunk_count; c++)
+			if (thread_pool_submit(pool, encode_chunk, &chunks[c]) != 0)
+				encode_chunk(&chunks[c]);
+		thread_pool_wait(pool);
 	}
 
-	// Failsafe return statement
+	// Report the first undefined label in source order
+	for (size_t c = 0; c < chunk_count; c++) {
+		if (chunks[c].error != chunks[c].last) {
+			const asm_inst_t *rec = &program->insts[chunks[c].error];
+			undefined_label(ctx, rec->sym, rec->line);
+			break;
+		}
+	}
+
+	output->text.count = program->text_words;
+	output->data.count = program->data_words;
+
+	if (chunks != &single)
+		free(chunks);
+	return ctx->failed ? -1 : 0;
+}
+
+// Run one pass over src, returning -1 with the error recorded in ctx
+int parse_file(const source_t *src, int pass, asm_context_t *ctx) {
+
+	if (pass == 1) {
+		int status = (ctx->pool != NULL && src->len >= 2 * LEX_CHUNK_MIN) ? lex_parallel(src, ctx) : lex_file(src, ctx);
+		TRACE(&ctx->trace, TRACE_INFO, "pass 1: %zu bytes, %zu records, %u symbols",
+				src->len, ctx->program.count, ctx->symbols->used);
+		return status;
+	}
+	else if (pass == 2)
+		return encode_program(src, ctx);
+
 	return 0;
 }
 
-// Return the binary representation of the register
-char *register_address(char *registerName) {
+// End of the block starting at ptr: see block_cache.h for where blocks are cut
+static const char *block_end(const char *ptr, const char *end) {
 
-	size_t i;
-	for (i = 0; registerMap[i].name != NULL; i++) {
-		if (strcmp(registerName, registerMap[i].name) == 0) {
-			return registerMap[i].address;
-		}
+	int lines = 0;
+	while (ptr < end) {
+
+		const char *newline = memchr(ptr, '\n', end - ptr);
+		const char *line_end = (newline != NULL) ? newline + 1 : end;
+
+		lines++;
+		if (lines >= BLOCK_MAX_LINES
+				|| (lines >= BLOCK_MIN_LINES && (block_cache_hash(ptr, line_end - ptr) & BLOCK_CUT_MASK) == 0))
+			return line_end;
+		ptr = line_end;
 	}
 
-	return NULL;
+	return end;
 }
 
-// Write out the R-Type instruction
-void rtype_instruction(char *instruction, char *rs, char *rt, char *rd, int shamt, FILE *Out) {
+/*
+ * Lex a block the previous run did not have into scratch, as a chunk of
+ * lex_parallel() is lexed, and append it to the cache. Its string offsets
+ * are taken from the start of the block and its lines are counted from 0.
+ * Returns its index in the cache, or BLOCK_NONE after recording an error.
+ */
+static uint32_t lex_block(asm_context_t *ctx, asm_context_t *scratch, const lex_state_t *state,
+		cache_block_t *block, const char *start, const char *end, block_cache_t *cache) {
+
+	lex_state_t entry = { .line_num = state->line_num, .instruction_count = 0x00000000,
+			.data_reached = state->data_reached };
+	lex_state_t exit = entry;
+
+	asm_context_reset(scratch);
+	lex_lines(scratch, &exit, start, end, start);
+
+	// .data resets the location counter, so its block needs the true start
+	if (exit.data_seen && !scratch->failed) {
+		entry.instruction_count = state->instruction_count;
+		exit = entry;
+		asm_context_reset(scratch);
+		lex_lines(scratch, &exit, start, end, start);
+		block->flags |= BLOCK_ABSOLUTE;
+	}
+
+	if (scratch->failed) {
+		asm_error(ctx, "%s", scratch->error);
+		return BLOCK_NONE;
+	}
 
-	// Set the instruction bits
-	char *opcode = "000000";
+	if (entry.data_reached)
+		block->flags |= BLOCK_DATA_ENTRY;
+	if (exit.data_reached)
+		block->flags |= BLOCK_DATA_EXIT;
+	block->lines = exit.line_num - entry.line_num;
+	block->exit = exit.instruction_count;
+	block->tokens = scratch->stats.tokens;
+
+	uint32_t index = block_cache_add(cache, block, &scratch->program, scratch->symbols, entry.line_num);
+	if (index == BLOCK_NONE)
+		asm_error(ctx, "Out of memory");
+	return index;
+}
 
-	char *rdBin = "00000";
-	if (strcmp(rd, "00000") != 0)
-		rdBin = register_address(rd);
+/*
+ * Append block index of the cache to the program, like place_chunk(). Its
+ * symbols are interned in the global table in order, so the ids and the
+ * first definition of each label come out as in a clean build. Advances
+ * state past the block; offset is where the block starts in the source.
+ */
+static int place_block(asm_context_t *ctx, block_cache_t *cache, uint32_t index, lex_state_t *state, size_t offset) {
 
-	char *rsBin = "00000";
-	if (strcmp(rs, "00000") != 0)
-		rsBin = register_address(rs);
+	cache_block_t *block = &cache->blocks[index];
+	const cache_symbol_t *symbols = &cache->symbols[block->first_symbol];
+	uint32_t *symbol_map = &cache->symbol_map[block->first_symbol];
+	asm_program_t *program = &ctx->program;
 
-	char *rtBin = "00000";
-	if (strcmp(rt, "00000") != 0)
-		rtBin = register_address(rt);
+	block->entry = state->instruction_count;
+	uint32_t base = (block->flags & BLOCK_ABSOLUTE) ? 0 : block->entry;
 
-	char *func = NULL;
-	char shamtBin[6];
+	for (uint32_t s = 0; s < block->symbol_count; s++) {
 
-	// Convert shamt to binary and put in shamtBin as a char*
-	getBin(shamt, shamtBin, 5);
+		uint32_t id = symtab_intern_hash(ctx->symbols, cache->names + symbols[s].name, symbols[s].name_len, symbols[s].hash);
+		if (id == SYMTAB_EMPTY)
+			return asm_error(ctx, "Error inserting into symbol table");
 
-	size_t i;
-	for (i = 0; rMap[i].name != NULL; i++) {
-		if (strcmp(instruction, rMap[i].name) == 0) {
-			func = rMap[i].function;
-		}
+		if (symbols[s].flags & SYMTAB_DEFINED)
+			symtab_define(ctx->symbols, id, symbols[s].value + base);
+		symbol_map[s] = id;
 	}
 
-	// Print out the instruction to the file
-	fprintf(Out, "%s%s%s%s%s%s\n", opcode, rsBin, rtBin, rdBin, shamtBin, func);
+	if (program_reserve(program, program->count + block->record_count) != 0)
+		return asm_error(ctx, "Out of memory");
+
+	const asm_inst_t *local = &cache->records[block->first_record];
+	asm_inst_t *rec = &program->insts[program->count];
+
+	for (uint32_t i = 0; i < block->record_count; i++, rec++) {
+		*rec = local[i];
+		rec->addr += base;
+		rec->line += state->line_num;
+		if (rec->op == IR_ASCIIZ)
+			rec->imm += offset;
+		if (rec->sym != IR_NO_SYMBOL)
+			rec->sym = symbol_map[rec->sym];
+
+		program->text_words += record_text_words(rec);
+		program->data_words += record_data_words(rec);
+		if (rec->op < OP_COUNT)
+			ctx->stats.instructions++;
+	}
+	program->count += block->record_count;
+
+	ctx->stats.lines += block->lines;
+	ctx->stats.tokens += block->tokens;
+
+	state->line_num += block->lines;
+	state->instruction_count = base + block->exit;
+	state->data_reached = (block->flags & BLOCK_DATA_EXIT) != 0;
+	return 0;
 }
 
-// Write out the I-Type instruction
-void itype_instruction(char *instruction, char *rs, char *rt, int immediateNum, FILE *Out) {
+/*
+ * Incremental pass 1. The source is cut into blocks and each one is looked
+ * up in the cache of the previous run by its bytes and the state it starts
+ * in; only blocks that are not found are lexed. Every block, found or not,
+ * goes into the cache for the next run and is then placed in the program.
+ */
+static int lex_incremental(const source_t *src, const block_cache_t *previous, block_cache_t *cache, asm_context_t *ctx) {
+
+	asm_context_t scratch;
+	if (asm_context_init(&scratch) != 0) {
+		asm_context_free(&scratch);
+		return asm_error(ctx, "Out of memory");
+	}
 
-	// Set the instruction bits
-	char *rsBin = "00000";
-	if (strcmp(rs, "00000") != 0)
-		rsBin = register_address(rs);
+	lex_state_t state = { .line_num = 0, .instruction_count = 0x00000000 };
+	const char *src_end = src->data + src->len;
+	size_t reused = 0;
 
-	char *rtBin = "00000";
-		if (strcmp(rt, "00000") != 0)
-			rtBin = register_address(rt);
+	for (const char *start = src->data; start < src_end; ) {
 
-	char *opcode = NULL;
-	char immediate[17];
+		const char *end = block_end(start, src_end);
+		cache_block_t block = { .hash = block_cache_hash(start, end - start), .len = end - start };
 
-	size_t i;
-	for (i = 0; iMap[i].name != NULL; i++) {
-		if (strcmp(instruction, iMap[i].name) == 0) {
-			opcode = iMap[i].address;
+		uint32_t index = block_cache_find(previous, block.hash, block.len, state.data_reached, state.instruction_count);
+		if (index != BLOCK_NONE) {
+			index = block_cache_copy(cache, previous, index);
+			if (index == BLOCK_NONE)
+				asm_error(ctx, "Out of memory");
+			reused++;
 		}
-	}
+		else
+			index = lex_block(ctx, &scratch, &state, &block, start, end, cache);
 
-	// Convert immediate to binary
-	getBin(immediateNum, immediate, 16);
+		if (index == BLOCK_NONE || place_block(ctx, cache, index, &state, start - src->data) != 0)
+			break;
+		start = end;
+	}
 
-	// Print out the instruction to the file
-	fprintf(Out, "%s%s%s%s\n", opcode, rsBin, rtBin, immediate);
+	asm_context_free(&scratch);
+	TRACE(&ctx->trace, TRACE_INFO, "incremental pass 1: %zu of %zu blocks reused", reused, cache->block_count);
+	return ctx->failed ? -1 : 0;
 }
 
-// Write out the J-Type instruction
-void jtype_instruction(char *instruction, int immediate, FILE *Out) {
+/*
+ * Incremental pass 2. A block that came from the previous cache keeps the
+ * words it was encoded to, except for records whose label is now at another
+ * address and branches, whose offset depends on their own address, in a
+ * block that moved. Every other record is encoded as by encode_program().
+ * The cache then gets the words' positions and the label addresses they
+ * were encoded with.
+ */
+static int encode_incremental(const source_t *src, const block_cache_t *previous, block_cache_t *cache,
+		asm_context_t *ctx) {
+
+	const asm_program_t *program = &ctx->program;
+	const symtab_entry_t *entries = ctx->symbols->entries;
+	output_t *output = &ctx->output;
+
+	TRACE(&ctx->trace, TRACE_INFO, "pass 2: %zu records, %zu text and %zu data words",
+			program->count, program->text_words, program->data_words);
+
+	if (word_buffer_reserve(&output->text, program->text_words) != 0
+			|| word_buffer_reserve(&output->data, program->data_words) != 0)
+		return asm_error(ctx, "Out of memory");
+
+	uint32_t *text = output->text.words;
+	uint32_t *data = output->data.words;
+	size_t encoded = 0;
+
+	for (size_t b = 0; b < cache->block_count; b++) {
 
-	// Set the instruction bits
-	char *opcode = NULL;
+		cache_block_t *block = &cache->blocks[b];
+		const asm_inst_t *insts = &program->insts[block->first_record];
+		const asm_inst_t *local = &cache->records[block->first_record];
+		cache_symbol_t *symbols = &cache->symbols[block->first_symbol];
+
+		size_t text_count = 0, data_count = 0;
+		for (uint32_t i = 0; i < block->record_count; i++) {
+			text_count += record_text_words(&insts[i]);
+			data_count += record_data_words(&insts[i]);
+		}
+
+		// The words of the previous run, if they line up with the records
+		const cache_block_t *old = (cache->origins[b] != BLOCK_NONE) ? &previous->blocks[cache->origins[b]] : NULL;
+		if (old != NULL && (old->text_count != text_count || old->data_count != data_count))
+			old = NULL;
+		const uint32_t *old_text = (old != NULL) ? previous->text + old->first_text : NULL;
+		const uint32_t *old_data = (old != NULL) ? previous->data + old->first_data : NULL;
+		int moved = old != NULL && !(block->flags & BLOCK_ABSOLUTE) && old->entry != block->entry;
+
+		block->first_text = text - output->text.words;
+		block->first_data = data - output->data.words;
+		block->text_count = text_count;
+		block->data_count = data_count;
+
+		for (uint32_t i = 0; i < block->record_count; i++) {
+
+			const asm_inst_t *rec = &insts[i];
+			size_t text_words = record_text_words(rec);
+			size_t data_words = record_data_words(rec);
+			int32_t label = 0;
+
+			if (rec->sym != IR_NO_SYMBOL) {
+				if (!(entries[rec->sym].flags & SYMTAB_DEFINED))
+					return undefined_label(ctx, rec->sym, rec->line);
+				label = entries[rec->sym].value;
+			}
+
+			if (old != NULL && (rec->sym == IR_NO_SYMBOL || symbols[local[i].sym].label == (uint32_t)label)
+					&& !(rec->op == OP_BEQ && moved)) {
+				memcpy(text, old_text, text_words * sizeof(uint32_t));
+				memcpy(data, old_data, data_words * sizeof(uint32_t));
+			}
+			else {
+				encode_words(rec, label, src->data, text, data);
+				encoded++;
+			}
 
-	// Get opcode bits
-	size_t i;
-	for (i = 0; jMap[i].name != NULL; i++) {
-		if (strcmp(instruction, jMap[i].name) == 0) {
-			opcode = jMap[i].address;
+			text += text_words;
+			data += data_words;
+			if (old != NULL) {
+				old_text += text_words;
+				old_data += data_words;
+			}
 		}
+
+		// The next run compares against the addresses used here
+		for (uint32_t s = 0; s < block->symbol_count; s++)
+			symbols[s].label = entries[cache->symbol_map[block->first_symbol + s]].value;
 	}
 
-	// Convert immediate to binary
-	char immediateStr[27];
-	getBin(immediate, immediateStr, 26);
+	output->text.count = program->text_words;
+	output->data.count = program->data_words;
 
-	// Print out instruction to file
-	fprintf(Out, "%s%s\n", opcode, immediateStr);
+	TRACE(&ctx->trace, TRACE_INFO, "incremental pass 2: %zu of %zu records encoded", encoded, program->count);
+	return 0;
 }
 
-// Write out the variable in binary
-void word_rep(int binary_rep, FILE *Out) {
-
-	for (int k = 31; k >= 0; k--) {
-		fprintf(Out, "%c", (binary_rep & (1 << k)) ? '1' : '0');
+/*
+ * Run one pass over src in the incremental mode, reusing the blocks of the
+ * previous cache and building the cache for the next run. Returns -1 with
+ * the error recorded in ctx.
+ */
+int parse_incremental(const source_t *src, int pass, const block_cache_t *previous, block_cache_t *cache,
+		asm_context_t *ctx) {
+
+	if (pass == 1) {
+		int status = lex_incremental(src, previous, cache, ctx);
+		TRACE(&ctx->trace, TRACE_INFO, "pass 1: %zu bytes, %zu records, %u symbols",
+				src->len, ctx->program.count, ctx->symbols->used);
+		return status;
 	}
+	else if (pass == 2)
+		return encode_incremental(src, previous, cache, ctx);
 
-	fprintf(Out, "\n");
+	return 0;
 }
 
-// Write out the ascii string
-void ascii_rep(char string[], FILE *Out) {
-
-	// Separate the string, and put each four characters in an element of an array of strings
-	size_t str_length = strlen(string);
-	str_length++;
-	int num_strs = str_length / 4;
-	if ((str_length % 4) > 0)
-		num_strs++;
-
-	char *ptr;
-	ptr = &string[0];
-
-	// Create an array of strings which separates each 4-char string
-	char **sep_str;
-	sep_str = malloc(num_strs * sizeof(char*));
-	if (sep_str == NULL) {
-		fprintf(Out, "Out of memory\n");
-		exit(1);
+/*
+ * Single-pass assembly. Each line is read from In, decoded and encoded at
+ * once; references to labels further down are patched when the label is
+ * defined. The input is read sequentially, so pipes work without spooling.
+ */
+int parse_stream(FILE *In, asm_context_t *ctx) {
+
+	lex_state_t state = { .line_num = 0, .instruction_count = 0x00000000 };
+	asm_program_t *program = &ctx->program;
+	char *line = NULL;
+	size_t line_capacity = 0;
+	ssize_t len;
+
+	while ((len = getline(&line, &line_capacity, In)) != -1) {
+
+		ctx->stats.bytes_in += len;
+		if (len > 0 && line[len - 1] == '\n')
+			len--;
+
+		// Only the records of the current line are kept
+		program->count = 0;
+		if (lex_line(ctx, &state, line, line + len, line) != 0)
+			break;
+
+		for (size_t i = 0; i < program->count; i++)
+			if (encode_record(ctx, &program->insts[i], line) != 0)
+				break;
+		if (ctx->failed)
+			break;
 	}
 
-	for (int i = 0; i < num_strs; i++) {
-		sep_str[i] = malloc(4 * sizeof(char));
-		if (sep_str[i] == NULL) {
-			fprintf(Out, "Out of memory\n");
-			exit(1);
+	free(line);
+	program->count = 0;
+	if (ctx->failed)
+		return -1;
+
+	if (ferror(In))
+		return asm_error(ctx, "Input file could not be read.");
+
+	TRACE(&ctx->trace, TRACE_INFO, "single pass: %d lines, %u symbols", state.line_num, ctx->symbols->used);
+
+	// Anything still waiting was never defined
+	if (check_fixups(ctx) != 0)
+		return -1;
+
+	return 0;
+}
+
+// Source bytes per block of the pipelined mode, and blocks in flight between its stages
+#define PIPE_BLOCK_SIZE (1 << 20)
+#define PIPE_BLOCKS 4
+
+// Words per chunk of finished output, and chunks in flight to the writer
+#define PIPE_CHUNK_WORDS (64 * 1024)
+#define PIPE_CHUNKS 4
+
+// Address of a label the encoder has not seen defined
+#define PIPE_UNDEFINED -1
+
+// Whole lines of source, and once lexed the records decoded from them
+typedef struct {
+	char *data;
+	size_t len;
+	size_t capacity;
+	asm_program_t program;
+} pipe_block_t;
+
+// Finished words of one section on their way to the writer
+typedef struct {
+	uint32_t words[PIPE_CHUNK_WORDS];
+	size_t count;
+	int data;
+} pipe_chunk_t;
+
+/*
+ * State shared by the stages. Blocks go from the reader to the lexer to the
+ * encoder and back; chunks go from the encoder to the writer and back. The
+ * lexer alone uses the symbol table and the encoder alone the fixups and
+ * output buffers of the context.
+ */
+typedef struct {
+	asm_context_t *ctx;
+	FILE *In;
+	output_stream_t *out;
+	pipe_block_t blocks[PIPE_BLOCKS];
+	pipe_chunk_t *chunks;
+	spsc_ring_t free_blocks;	// Encoder to reader
+	spsc_ring_t read_blocks;	// Reader to lexer
+	spsc_ring_t lexed_blocks;	// Lexer to encoder
+	spsc_ring_t free_chunks;	// Writer to encoder
+	spsc_ring_t full_chunks;	// Encoder to writer
+	const char *error;			// First error of the reader, encoder or writer
+	int64_t *labels;			// Address of each symbol id, as the encoder has seen them defined
+	size_t label_count;
+	pipe_chunk_t *chunk;		// Chunk the encoder is filling
+	size_t text_base;			// Index in .text of the first word in the output buffer
+	size_t text_sent;			// Words of the buffer passed to the writer
+	size_t oldest;				// Oldest fixup that may still be waiting
+	int text_done;				// The .data section has started
+} pipeline_t;
+
+// Stop every stage, keeping the first error
+static void pipe_fail(pipeline_t *pipeline, const char *error) {
+
+	const char *none = NULL;
+	if (error != NULL)
+		__atomic_compare_exchange_n(&pipeline->error, &none, error, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE);
+
+	spsc_ring_abort(&pipeline->free_blocks);
+	spsc_ring_abort(&pipeline->read_blocks);
+	spsc_ring_abort(&pipeline->lexed_blocks);
+	spsc_ring_abort(&pipeline->free_chunks);
+	spsc_ring_abort(&pipeline->full_chunks);
+}
+
+// Make room for size bytes in a block, keeping its contents
+static int pipe_block_reserve(pipe_block_t *block, size_t size) {
+
+	if (size <= block->capacity)
+		return 0;
+
+	size_t capacity = block->capacity ? block->capacity : PIPE_BLOCK_SIZE;
+	while (capacity < size)
+		capacity *= 2;
+
+	char *data = realloc(block->data, capacity);
+	if (data == NULL)
+		return -1;
+	block->data = data;
+	block->capacity = capacity;
+	return 0;
+}
+
+/*
+ * Reader stage: fill blocks from the input, ending each at a line break.
+ * The partial line after it starts the next block; a block with no line
+ * break at all grows until the line fits.
+ */
+static void *pipe_reader(void *arg) {
+
+	pipeline_t *pipeline = arg;
+	char *carry = NULL;
+	size_t carry_len = 0;
+	pipe_block_t *block;
+	int done = 0;
+
+	while (!done && spsc_ring_pop(&pipeline->free_blocks, (void **)&block)) {
+
+		if (pipe_block_reserve(block, carry_len + 1) != 0) {
+			pipe_fail(pipeline, "Out of memory");
+			break;
 		}
-	}
+		memcpy(block->data, carry, carry_len);
+		block->len = carry_len;
+		carry_len = 0;
 
-	int count = 0;
-	for (int i = 0; i < str_length; i++) {
-		sep_str[i / 4][i % 4] = *ptr;
-		ptr++;
-		count++;
+		for (;;) {
+			size_t read = fread(block->data + block->len, 1, block->capacity - block->len, pipeline->In);
+			pipeline->ctx->stats.bytes_in += read;
+			block->len += read;
+
+			if (block->len < block->capacity) {
+				done = 1;
+				break;
+			}
+
+			const char *newline = memrchr(block->data, '\n', block->len);
+			if (newline != NULL) {
+				carry_len = block->data + block->len - (newline + 1);
+				block->len -= carry_len;
+				break;
+			}
+
+			if (pipe_block_reserve(block, block->capacity * 2) != 0) {
+				pipe_fail(pipeline, "Out of memory");
+				free(carry);
+				return NULL;
+			}
+		}
+
+		if (ferror(pipeline->In)) {
+			pipe_fail(pipeline, "Input file could not be read.");
+			break;
+		}
+
+		// Keep the partial line for the next block
+		if (carry_len > 0) {
+			char *tail = realloc(carry, block->capacity);
+			if (tail == NULL) {
+				pipe_fail(pipeline, "Out of memory");
+				break;
+			}
+			carry = tail;
+			memcpy(carry, block->data + block->len, carry_len);
+		}
+
+		if (block->len > 0 && !spsc_ring_push(&pipeline->read_blocks, block))
+			break;
 	}
 
-	// Reverse each element in the array
-	char temp;
+	free(carry);
+	spsc_ring_close(&pipeline->read_blocks);
+	return NULL;
+}
+
+/*
+ * Lexer stage: decode the lines of each block into its records. Label
+ * definitions become IR_LABEL records, so the encoder never reads the
+ * symbol table while the lexer is adding to it.
+ */
+static void *pipe_lexer(void *arg) {
 
-	for (int i = 0; i < num_strs; i++) {
+	pipeline_t *pipeline = arg;
+	asm_context_t *ctx = pipeline->ctx;
+	lex_state_t state = { .line_num = 0, .instruction_count = 0x00000000, .label_records = 1 };
+	pipe_block_t *block;
 
-		for (int j = 0, k = 3; j < k; j++, k--) {
+	while (spsc_ring_pop(&pipeline->read_blocks, (void **)&block)) {
 
-			temp = sep_str[i][j];
-			sep_str[i][j] = sep_str[i][k];
-			sep_str[i][k] = temp;
+		program_clear(&ctx->program);
+		if (lex_lines(ctx, &state, block->data, block->data + block->len, block->data) != 0) {
+			pipe_fail(pipeline, NULL);
+			break;
 		}
+
+		// The block takes the records; the lexer reuses the block's old array
+		asm_program_t records = block->program;
+		block->program = ctx->program;
+		ctx->program = records;
+
+		if (!spsc_ring_push(&pipeline->lexed_blocks, block))
+			break;
 	}
 
-	// Convert into binary
-	for (int i = 0; i < num_strs; i++) {
+	TRACE(&ctx->trace, TRACE_INFO, "pipeline: %d lines, %u symbols", state.line_num, ctx->symbols->used);
+	spsc_ring_close(&pipeline->lexed_blocks);
+	return NULL;
+}
+
+// The encoder has seen symbol sym defined
+static inline int pipe_defined(const pipeline_t *pipeline, uint32_t sym) {
 
-		for (int j = 0; j < 4; j++) {
-			char c = sep_str[i][j];
-			for (int k = 7; k >= 0; k--) {
-				fprintf(Out, "%c", (c & (1 << k)) ? '1' : '0');
-			}
+	return sym < pipeline->label_count && pipeline->labels[sym] != PIPE_UNDEFINED;
+}
+
+// Pass count words of a section to the writer
+static int pipe_send(pipeline_t *pipeline, int data, const uint32_t *words, size_t count) {
+
+	while (count > 0) {
+
+		pipe_chunk_t *chunk = pipeline->chunk;
+		if (chunk != NULL && (chunk->count == PIPE_CHUNK_WORDS || chunk->data != data)) {
+			if (!spsc_ring_push(&pipeline->full_chunks, chunk))
+				return -1;
+			chunk = pipeline->chunk = NULL;
+		}
+
+		if (chunk == NULL) {
+			if (!spsc_ring_pop(&pipeline->free_chunks, (void **)&chunk))
+				return -1;
+			chunk->count = 0;
+			chunk->data = data;
+			pipeline->chunk = chunk;
 		}
 
-		fprintf(Out, "\n");
+		size_t n = PIPE_CHUNK_WORDS - chunk->count;
+		if (n > count)
+			n = count;
+		memcpy(chunk->words + chunk->count, words, n * sizeof(uint32_t));
+		chunk->count += n;
+		words += n;
+		count -= n;
+	}
+
+	return 0;
+}
+
+/*
+ * Move the fixups from the oldest waiting one on to the start of the array.
+ * Every fixup before it has been patched, and a waiting fixup only links to
+ * older ones of the same label, which are waiting too, so only the links
+ * and list heads of waiting fixups need to move with them.
+ */
+static void pipe_compact_fixups(pipeline_t *pipeline) {
+
+	asm_fixups_t *fixups = &pipeline->ctx->fixups;
+	uint32_t shift = pipeline->oldest;
+
+	for (size_t i = shift; i < fixups->count; i++) {
+		asm_fixup_t *fixup = &fixups->items[i];
+		if (pipe_defined(pipeline, fixup->sym))
+			continue;
+		if (fixups->heads[fixup->sym] == i)
+			fixups->heads[fixup->sym] = i - shift;
+		if (fixup->next != FIXUP_NONE)
+			fixup->next -= shift;
+	}
+
+	memmove(fixups->items, fixups->items + shift, (fixups->count - shift) * sizeof(asm_fixup_t));
+	fixups->count -= shift;
+	pipeline->oldest = 0;
+}
+
+/*
+ * Pass on every word that no fixup can still change: .text up to the word
+ * of the oldest waiting fixup, and .data once all of .text has gone.
+ */
+static int pipe_flush(pipeline_t *pipeline) {
+
+	asm_fixups_t *fixups = &pipeline->ctx->fixups;
+	word_buffer_t *text = &pipeline->ctx->output.text;
+	word_buffer_t *data = &pipeline->ctx->output.data;
+
+	while (pipeline->oldest < fixups->count && pipe_defined(pipeline, fixups->items[pipeline->oldest].sym))
+		pipeline->oldest++;
+
+	// Drop the patched fixups once they are half the array
+	if (pipeline->oldest > 0 && pipeline->oldest * 2 >= fixups->count)
+		pipe_compact_fixups(pipeline);
+
+	size_t ready = (fixups->count > 0) ? fixups->items[pipeline->oldest].word - pipeline->text_base : text->count;
+	if (pipe_send(pipeline, 0, text->words + pipeline->text_sent, ready - pipeline->text_sent) != 0)
+		return -1;
+	pipeline->text_sent = ready;
+
+	// Drop the words sent once they are half the buffer, so the moves stay amortized
+	if (pipeline->text_sent > 0 && pipeline->text_sent * 2 >= text->count) {
+		memmove(text->words, text->words + pipeline->text_sent, (text->count - pipeline->text_sent) * sizeof(uint32_t));
+		text->count -= pipeline->text_sent;
+		pipeline->text_base += pipeline->text_sent;
+		pipeline->text_sent = 0;
 	}
 
-	// Deallocate sep_str
-	for (int i = 0; i < num_strs; i++) {
-		free(sep_str[i]);
+	if (pipeline->text_done && fixups->count == 0 && data->count > 0) {
+		if (pipe_send(pipeline, 1, data->words, data->count) != 0)
+			return -1;
+		data->count = 0;
 	}
-	free(sep_str);
-	sep_str = NULL;
+
+	return 0;
 }
 
-void getBin(int num, char *str, int padding) {
+// Record the address of a label and patch the words waiting for it
+static int pipe_define(pipeline_t *pipeline, uint32_t sym, uint32_t address) {
+
+	if (sym >= pipeline->label_count) {
+		size_t count = pipeline->label_count ? pipeline->label_count : 1024;
+		while (count <= sym)
+			count *= 2;
+		int64_t *labels = realloc(pipeline->labels, count * sizeof(int64_t));
+		if (labels == NULL)
+			return -1;
+		for (size_t i = pipeline->label_count; i < count; i++)
+			labels[i] = PIPE_UNDEFINED;
+		pipeline->labels = labels;
+		pipeline->label_count = count;
+	}
+
+	pipeline->labels[sym] = address;
+	patch_fixups(pipeline->ctx, sym, address, pipeline->text_base);
+	return 0;
+}
 
-	*(str + padding) = '\0';
+// Encode one record after the words waiting in the output buffers
+static int pipe_encode(pipeline_t *pipeline, const asm_inst_t *rec, const char *base) {
+
+	asm_context_t *ctx = pipeline->ctx;
+	word_buffer_t *text = &ctx->output.text;
+	word_buffer_t *data = &ctx->output.data;
+	size_t text_words = record_text_words(rec);
+	size_t data_words = record_data_words(rec);
+	int32_t label = 0;
+
+	if (rec->sym != IR_NO_SYMBOL) {
+		if (pipe_defined(pipeline, rec->sym))
+			label = pipeline->labels[rec->sym];
+		else {
+			asm_fixup_t *fixup = fixups_add(&ctx->fixups, rec->sym);
+			if (fixup == NULL)
+				return -1;
+			fixup->word = pipeline->text_base + text->count;
+			fixup->addr = rec->addr;
+			fixup->line = rec->line;
+			fixup->op = rec->op;
+		}
+	}
 
-	long pos;
-	if (padding == 5)
-		pos = 0x10;
-	else if (padding == 16)
-		pos = 0x8000;
-	else if (padding == 26)
-		pos = 0x2000000;
-	else if (padding == 32)
-		pos = 0x80000000;
+	if (word_buffer_reserve(text, text_words) != 0 || word_buffer_reserve(data, data_words) != 0)
+		return -1;
 
-	long mask = pos << 1;
-	while (mask >>= 1)
-		*str++ = !!(mask & num) + '0';
+	encode_words(rec, label, base, text->words + text->count, data->words + data->count);
+	text->count += text_words;
+	data->count += data_words;
+	if (data_words > 0)
+		pipeline->text_done = 1;
+	return 0;
 }
 
-// Convert a binary string to a decimal value
-int getDec(char *bin) {
+// Encoder stage: encode the records of each block and pass on the finished words
+static void *pipe_encoder(void *arg) {
 
-	int  b, k, m, n;
-	int  len, sum = 0;
+	pipeline_t *pipeline = arg;
+	pipe_block_t *block;
 
-	// Length - 1 to accomodate for null terminator
-	len = strlen(bin) - 1;
+	while (spsc_ring_pop(&pipeline->lexed_blocks, (void **)&block)) {
 
-	// Iterate the string
-	for(k = 0; k <= len; k++) {
+		const asm_program_t *program = &block->program;
+		int status = 0;
 
-		// Convert char to numeric value
-		n = (bin[k] - '0');
+		for (size_t i = 0; i < program->count && status == 0; i++) {
+			const asm_inst_t *rec = &program->insts[i];
+			status = (rec->op == IR_LABEL) ? pipe_define(pipeline, rec->sym, rec->addr) : pipe_encode(pipeline, rec, block->data);
+		}
 
-		// Check the character is binary
-		if ((n > 1) || (n < 0))  {
-			return 0;
+		if (status != 0) {
+			pipe_fail(pipeline, "Out of memory");
+			return NULL;
 		}
 
-		for(b = 1, m = len; m > k; m--)
-			b *= 2;
+		// The records are encoded and the source they point into is no longer needed
+		if (!spsc_ring_push(&pipeline->free_blocks, block) || pipe_flush(pipeline) != 0)
+			return NULL;
+	}
+
+	// Words still waiting for a label are left out; the label is reported as undefined
+	pipeline->text_done = 1;
+	if (pipe_flush(pipeline) == 0 && pipeline->chunk != NULL && spsc_ring_push(&pipeline->full_chunks, pipeline->chunk))
+		pipeline->chunk = NULL;
+	spsc_ring_close(&pipeline->full_chunks);
+	return NULL;
+}
+
+// Writer stage, run by the calling thread
+static void pipe_writer(pipeline_t *pipeline) {
+
+	pipe_chunk_t *chunk;
+
+	while (spsc_ring_pop(&pipeline->full_chunks, (void **)&chunk)) {
+
+		if (output_stream_write(pipeline->out, chunk->data, chunk->words, chunk->count) != 0) {
+			pipe_fail(pipeline, "Output file could not be written.");
+			return;
+		}
 
-		// sum it up
-		sum = sum + n * b;
+		if (!spsc_ring_push(&pipeline->free_chunks, chunk))
+			return;
 	}
+}
+
+/*
+ * Pipelined assembly. A reader thread fills large blocks from In, a lexer
+ * thread decodes them into records, an encoder thread turns those into
+ * words and the calling thread writes them to Out, all at once. The stages
+ * hand blocks and chunks of words to each other through bounded rings and
+ * recycle them, so memory stays the same however long the input is. Only
+ * words waiting for a label further down are held back, so a far forward
+ * reference holds back everything after it. The output format must be one
+ * that can be streamed.
+ */
+int parse_pipeline(FILE *In, FILE *Out, output_format_t format, int big_endian, asm_context_t *ctx) {
+
+	pipeline_t pipeline;
+	output_stream_t out;
+	pthread_t threads[3];
+	void *(*stages[3])(void *) = { pipe_reader, pipe_lexer, pipe_encoder };
+	int started = 0;
+
+	memset(&pipeline, 0, sizeof(pipeline));
+	pipeline.ctx = ctx;
+	pipeline.In = In;
+	pipeline.out = &out;
+
+	if (output_stream_open(&out, format, big_endian, Out) != 0)
+		return asm_error(ctx, (format == FORMAT_ELF) ? "The ELF format cannot be streamed." : "Out of memory");
+
+	pipeline.chunks = malloc(PIPE_CHUNKS * sizeof(pipe_chunk_t));
+	int ready = pipeline.chunks != NULL
+			&& spsc_ring_init(&pipeline.free_blocks, PIPE_BLOCKS) && spsc_ring_init(&pipeline.read_blocks, PIPE_BLOCKS)
+			&& spsc_ring_init(&pipeline.lexed_blocks, PIPE_BLOCKS) && spsc_ring_init(&pipeline.free_chunks, PIPE_CHUNKS)
+			&& spsc_ring_init(&pipeline.full_chunks, PIPE_CHUNKS);
+
+	for (int b = 0; ready && b < PIPE_BLOCKS; b++)
+		ready = (pipe_block_reserve(&pipeline.blocks[b], PIPE_BLOCK_SIZE) == 0);
+
+	if (ready) {
+		for (int b = 0; b < PIPE_BLOCKS; b++)
+			spsc_ring_push(&pipeline.free_blocks, &pipeline.blocks[b]);
+		for (int c = 0; c < PIPE_CHUNKS; c++)
+			spsc_ring_push(&pipeline.free_chunks, &pipeline.chunks[c]);
+
+		for (started = 0; started < 3; started++)
+			if (pthread_create(&threads[started], NULL, stages[started], &pipeline) != 0) {
+				pipe_fail(&pipeline, "Worker threads could not be started.");
+				break;
+			}
 
-	return sum;
+		if (started == 3)
+			pipe_writer(&pipeline);
+		for (int t = 0; t < started; t++)
+			pthread_join(threads[t], NULL);
+	}
+	else
+		pipeline.error = "Out of memory";
+
+	for (int b = 0; b < PIPE_BLOCKS; b++) {
+		free(pipeline.blocks[b].data);
+		program_free(&pipeline.blocks[b].program);
+	}
+	free(pipeline.chunks);
+	free(pipeline.labels);
+	if (pipeline.free_blocks.items != NULL)
+		spsc_ring_destroy(&pipeline.free_blocks);
+	if (pipeline.read_blocks.items != NULL)
+		spsc_ring_destroy(&pipeline.read_blocks);
+	if (pipeline.lexed_blocks.items != NULL)
+		spsc_ring_destroy(&pipeline.lexed_blocks);
+	if (pipeline.free_chunks.items != NULL)
+		spsc_ring_destroy(&pipeline.free_chunks);
+	if (pipeline.full_chunks.items != NULL)
+		spsc_ring_destroy(&pipeline.full_chunks);
+	program_clear(&ctx->program);
+
+	// Anything still waiting was never defined
+	int status = -1;
+	if (!ctx->failed)
+		status = (pipeline.error != NULL) ? asm_error(ctx, "%s", pipeline.error) : check_fixups(ctx);
+
+	// Only a complete output gets its end written
+	if (output_stream_close(&out, status == 0) != 0 && status == 0)
+		status = asm_error(ctx, "Output file could not be written.");
+
+	return status;
 }
 
+// Return the number of the register, recording an error in ctx on an unknown name
+// An empty name stands for an unused register field, which encodes as $zero
+int register_address(asm_context_t *ctx, token_view_t registerName, int32_t line_num) {
+
+	if (registerName.len == 0)
+		return 0;
+
+	int number = register_number(registerName.ptr, registerName.len);
+	if (number < 0) {
+		asm_error(ctx, "line %d: unknown register %.*s", line_num, (int)registerName.len, registerName.ptr);
+		return 0;
+	}
+
+	return number;
+}
+
+// Pack the ascii string, with its terminating NUL, into length / 4 + 1 words
+// Each word holds four characters with the first one in the low byte
+void ascii_rep(const char *string, size_t length, uint32_t *words) {
+
+	uint32_t word = 0;
+
+	for (size_t i = 0; i < length; i++) {
+		word |= (uint32_t)(uint8_t)string[i] << ((i % 4) * 8);
+
+		if (i % 4 == 3) {
+			*words++ = word;
+			word = 0;
+		}
+	}
+
+	// The last word holds the NUL and any zero padding
+	*words = word;
+}
@@ -5,23 +5,25 @@
  *      Author: nayef
  */
 
-#include "hash_table.h"
+#include "asm_context.h"
+#include "source.h"
+#include "tokenizer.h"
+#include "instruction_set.h"
+#include "output.h"
+#include "block_cache.h"
 
 #ifndef FILE_PARSER_H_
 #define FILE_PARSER_H_
 
-#define MAX_LINE_LENGTH 256
+// Most operands any supported instruction takes
+#define MAX_OPERANDS 3
 
-void parse_file(FILE *fptr, int pass, char *instructions[], size_t inst_len, hash_table_t *hash_table, FILE *Out);
-int binarySearch(char *instructions[], int low, int high, char *string);
-char instruction_type(char *instruction);
-char *register_address(char *registerName);
-void rtype_instruction(char *instruction, char *rs, char *rt, char *rd, int shamt, FILE *Out);
-void itype_instruction(char *instruction, char *rs, char *rt, int immediate, FILE *Out);
-void jtype_instruction(char *instruction, int immediate, FILE *Out);
-void word_rep(int binary_rep, FILE *Out);
-void ascii_rep(char string[], FILE *Out);
-void getBin(int num, char *str, int padding);
-int getDec(char *bin);
+int parse_file(const source_t *src, int pass, asm_context_t *ctx);
+int parse_incremental(const source_t *src, int pass, const block_cache_t *previous, block_cache_t *cache,
+		asm_context_t *ctx);
+int parse_stream(FILE *In, asm_context_t *ctx);
+int parse_pipeline(FILE *In, FILE *Out, output_format_t format, int big_endian, asm_context_t *ctx);
+int register_address(asm_context_t *ctx, token_view_t registerName, int32_t line_num);
+void ascii_rep(const char *string, size_t length, uint32_t *words);
 
 #endif /* FILE_PARSER_H_ */
@@ -0,0 +1,358 @@
+#ifndef __FROZEN_SYMTAB_H
+#define __FROZEN_SYMTAB_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "symtab.h"
+
+/*
+   read-only symbol table for after pass 1.
+
+   symtab_freeze copies the defined symbols of a symtab_t into one array
+   sorted by address, with all names packed into a single block of memory.
+   names are found through a minimal perfect hash built in linear time
+   (CHD: compress, hash and displace). keys are hashed into buckets of about
+   FROZEN_SYMTAB_LOAD keys each; going from the largest bucket to the
+   smallest, each bucket is given the first displacement that moves all of
+   its keys to free slots. by the time only buckets of one key are left the
+   table is nearly full, so those are given a free slot directly instead,
+   marked with FROZEN_SYMTAB_DIRECT. a lookup is then one hash, one displacement and
+   one slot, which caches the full hash like symtab_slot_t and so only
+   touches the symbol on a likely match. nothing is ever written after the
+   freeze, so any number of threads can look up at once.
+
+   the hash is hash_wy64, since a perfect hash needs every name to hash
+   differently and 32-bit hashes of a few hundred thousand names already
+   collide. if the build still fails for a seed, it is tried again with the
+   next one.
+
+   a table frozen into an arena is released with the arena, and
+   frozen_symtab_destroy does not need to be called.
+*/
+
+/* average keys per bucket */
+#define FROZEN_SYMTAB_LOAD 2
+/* displacements tried for one bucket before giving up on a seed */
+#define FROZEN_SYMTAB_TRIES (1u << 20)
+/* seeds tried before giving up */
+#define FROZEN_SYMTAB_SEEDS 8
+/* set in a displacement that is the slot itself */
+#define FROZEN_SYMTAB_DIRECT 0x80000000u
+
+typedef struct
+{
+  uint64_t hash;
+  uint32_t value;
+  uint32_t key_len;
+  const char *key;     /* into keys */
+} frozen_symbol_t;
+
+typedef struct
+{
+  frozen_symbol_t *symbols; /* sorted by address, then name */
+  char *keys;
+  symtab_slot_t *slots;     /* one per symbol, caching the low half of its hash */
+  uint32_t *displacements;  /* one per bucket */
+  uint32_t count;
+  uint32_t bucket_count;
+  uint32_t seed;
+  arena_t *arena;           /* NULL if memory comes from malloc */
+} frozen_symtab_t;
+
+static inline uint64_t frozen_symtab_mix(uint64_t h)
+{
+  h ^= h >> 33;
+  h *= 0xff51afd7ed558ccdull;
+  h ^= h >> 33;
+  h *= 0xc4ceb9fe1a85ec53ull;
+  h ^= h >> 33;
+  return(h);
+}
+
+static inline uint32_t frozen_symtab_bucket(uint64_t h, uint32_t bucket_count)
+{
+  return (uint32_t) (h >> 32) % bucket_count;
+}
+
+/* slot that displacement d moves a key with hash h to */
+static inline uint32_t frozen_symtab_slot(uint64_t h, uint32_t d, uint32_t count)
+{
+  if (d & FROZEN_SYMTAB_DIRECT) return(d & ~FROZEN_SYMTAB_DIRECT);
+  return (uint32_t) ((frozen_symtab_mix(h + d * 0x9e3779b97f4a7c15ull) >> 32) * count >> 32);
+}
+
+/* orders symbols by address, then by name */
+static inline int frozen_symbol_compare(const void *a, const void *b)
+{
+  const frozen_symbol_t *x = (const frozen_symbol_t *) a, *y = (const frozen_symbol_t *) b;
+  uint32_t len = (x->key_len < y->key_len) ? x->key_len : y->key_len;
+  int order;
+
+  if (x->value != y->value) return (x->value < y->value) ? -1 : 1;
+  order = memcmp(x->key, y->key, len);
+  if (order != 0) return(order);
+  return (x->key_len < y->key_len) ? -1 : (x->key_len > y->key_len);
+}
+
+/*
+   builds the hash over frozen->symbols with one seed
+
+   parameters:
+   first : the symbols of each bucket are order[first[b]] .. order[first[b + 1] - 1]
+   order : scratch for one index per symbol
+   buckets : scratch for one index per bucket
+   taken : scratch for one byte per symbol
+   by_size : scratch for two more indices than there are symbols
+
+   returns: TRUE on success, FALSE if this seed does not give a perfect hash
+*/
+static inline int frozen_symtab_build(frozen_symtab_t *frozen, uint32_t *first, uint32_t *order,
+				      uint32_t *buckets, uint8_t *taken, uint32_t *by_size)
+{
+  uint32_t n = frozen->count, bucket_count = frozen->bucket_count;
+  uint32_t b, i, t, largest = 0, free_slot = 0;
+
+  /* bucket the symbols with a counting sort */
+  memset(first, 0, sizeof(uint32_t) * (bucket_count + 1));
+  for (i = 0; i < n; i++)
+    first[frozen_symtab_bucket(frozen->symbols[i].hash, bucket_count) + 1]++;
+  for (b = 0; b < bucket_count; b++)
+    {
+      if (first[b + 1] > largest) largest = first[b + 1];
+      first[b + 1] += first[b];
+    }
+  for (i = 0; i < n; i++)
+    {
+      b = frozen_symtab_bucket(frozen->symbols[i].hash, bucket_count);
+      order[first[b]++] = i;
+    }
+  for (b = bucket_count; b > 0; b--)
+    first[b] = first[b - 1];
+  first[0] = 0;
+
+  /* and the buckets by size, largest first, with another */
+  memset(by_size, 0, sizeof(uint32_t) * (largest + 2));
+  for (b = 0; b < bucket_count; b++)
+    by_size[largest - (first[b + 1] - first[b]) + 1]++;
+  for (t = 0; t <= largest; t++)
+    by_size[t + 1] += by_size[t];
+  for (b = 0; b < bucket_count; b++)
+    buckets[by_size[largest - (first[b + 1] - first[b])]++] = b;
+
+  memset(taken, 0, n);
+  for (t = 0; t < bucket_count; t++)
+    {
+      uint32_t start, end, d;
+
+      b = buckets[t];
+      start = first[b];
+      end = first[b + 1];
+      frozen->displacements[b] = 0;
+      if (start == end) continue;
+
+      if (end - start == 1)
+	{
+	  while (taken[free_slot]) free_slot++;
+	  taken[free_slot] = 1;
+	  frozen->displacements[b] = FROZEN_SYMTAB_DIRECT | free_slot;
+	  frozen->slots[free_slot].hash = (uint32_t) frozen->symbols[order[start]].hash;
+	  frozen->slots[free_slot].index = order[start];
+	  continue;
+	}
+
+      /* names that share a hash can never be told apart */
+      for (i = start; i < end; i++)
+	for (d = start; d < i; d++)
+	  if (frozen->symbols[order[i]].hash == frozen->symbols[order[d]].hash)
+	    return(FALSE);
+
+      for (d = 0; d < FROZEN_SYMTAB_TRIES; d++)
+	{
+	  for (i = start; i < end; i++)
+	    {
+	      uint32_t pos = frozen_symtab_slot(frozen->symbols[order[i]].hash, d, n);
+	      if (taken[pos]) break;
+	      taken[pos] = 1;
+	    }
+	  if (i == end) break;
+
+	  /* give back the slots of this attempt */
+	  while (i-- > start)
+	    taken[frozen_symtab_slot(frozen->symbols[order[i]].hash, d, n)] = 0;
+	}
+      if (d == FROZEN_SYMTAB_TRIES) return(FALSE);
+
+      frozen->displacements[b] = d;
+      for (i = start; i < end; i++)
+	{
+	  symtab_slot_t *slot = &frozen->slots[frozen_symtab_slot(frozen->symbols[order[i]].hash, d, n)];
+	  slot->hash = (uint32_t) frozen->symbols[order[i]].hash;
+	  slot->index = order[i];
+	}
+    }
+  return(TRUE);
+}
+
+static inline void *frozen_symtab_alloc(arena_t *arena, size_t size)
+{
+  return (arena != NULL) ? arena_alloc(arena, size) : malloc(size);
+}
+
+/*
+  destroys a frozen table and frees all allocated memory
+*/
+static inline void frozen_symtab_destroy(frozen_symtab_t *frozen)
+{
+  if (frozen->arena != NULL) return;
+
+  free(frozen->symbols);
+  free(frozen->keys);
+  free(frozen->slots);
+  free(frozen->displacements);
+  free(frozen);
+}
+
+/*
+   freezes the defined symbols of a symbol table. the symbol table itself is
+   not changed.
+
+   parameters:
+   symtab : table to freeze
+   arena : arena to take the frozen table from, or NULL for malloc
+   no_hash : if not NULL, set to TRUE when the table failed because no seed
+	     gave a perfect hash, and to FALSE otherwise
+
+   returns: pointer to the frozen table or NULL on failure
+*/
+static inline frozen_symtab_t *symtab_freeze(const symtab_t *symtab, arena_t *arena, int *no_hash)
+{
+  frozen_symtab_t *frozen;
+  uint32_t id, n = 0, seed, *first, *order, *buckets, *by_size;
+  size_t key_bytes = 0;
+  uint8_t *taken;
+  int built = FALSE, scratch;
+
+  if (no_hash != NULL) *no_hash = FALSE;
+  for (id = 0; id < symtab->count; id++)
+    if ((symtab->entries[id].flags & (SYMTAB_DEFINED | SYMTAB_DELETED)) == SYMTAB_DEFINED)
+      {
+	n++;
+	key_bytes += symtab->entries[id].key_len;
+      }
+
+  frozen = (frozen_symtab_t *) frozen_symtab_alloc(arena, sizeof(frozen_symtab_t));
+  if (frozen == NULL) return(NULL);
+  memset(frozen, 0, sizeof(frozen_symtab_t));
+  frozen->arena = arena;
+  frozen->count = n;
+  frozen->bucket_count = (n + FROZEN_SYMTAB_LOAD - 1) / FROZEN_SYMTAB_LOAD + 1;
+
+  frozen->symbols = (frozen_symbol_t *) frozen_symtab_alloc(arena, sizeof(frozen_symbol_t) * n + 1);
+  frozen->keys = (char *) frozen_symtab_alloc(arena, key_bytes + 1);
+  frozen->slots = (symtab_slot_t *) frozen_symtab_alloc(arena, sizeof(symtab_slot_t) * n + 1);
+  frozen->displacements = (uint32_t *) frozen_symtab_alloc(arena, sizeof(uint32_t) * frozen->bucket_count);
+  if ((frozen->symbols == NULL) || (frozen->keys == NULL) || (frozen->slots == NULL)
+      || (frozen->displacements == NULL))
+    {
+      frozen_symtab_destroy(frozen);
+      return(NULL);
+    }
+
+  /* pack the names and sort the symbols */
+  key_bytes = 0;
+  n = 0;
+  for (id = 0; id < symtab->count; id++)
+    {
+      const symtab_entry_t *entry = &symtab->entries[id];
+      frozen_symbol_t *symbol = &frozen->symbols[n];
+
+      if ((entry->flags & (SYMTAB_DEFINED | SYMTAB_DELETED)) != SYMTAB_DEFINED) continue;
+      symbol->value = entry->value;
+      symbol->key = frozen->keys + key_bytes;
+      symbol->key_len = entry->key_len;
+      memcpy(frozen->keys + key_bytes, symtab_key(entry), entry->key_len);
+      key_bytes += entry->key_len;
+      n++;
+    }
+  qsort(frozen->symbols, n, sizeof(frozen_symbol_t), frozen_symbol_compare);
+
+  /* scratch space for the build; an arena keeps it until it is reset, so
+     freezing into a reused arena does not allocate */
+  first = (uint32_t *) frozen_symtab_alloc(arena, sizeof(uint32_t) * (frozen->bucket_count + 1));
+  order = (uint32_t *) frozen_symtab_alloc(arena, sizeof(uint32_t) * n + 1);
+  buckets = (uint32_t *) frozen_symtab_alloc(arena, sizeof(uint32_t) * frozen->bucket_count);
+  taken = (uint8_t *) frozen_symtab_alloc(arena, n + 1);
+  by_size = (uint32_t *) frozen_symtab_alloc(arena, sizeof(uint32_t) * (n + 2));
+
+  scratch = (first != NULL) && (order != NULL) && (buckets != NULL) && (taken != NULL) && (by_size != NULL);
+  for (seed = 0; scratch && (seed < FROZEN_SYMTAB_SEEDS); seed++)
+    {
+      frozen->seed = seed;
+      for (id = 0; id < n; id++)
+	frozen->symbols[id].hash = hash_wy64(frozen->symbols[id].key, frozen->symbols[id].key_len, seed);
+      if ((built = frozen_symtab_build(frozen, first, order, buckets, taken, by_size))) break;
+    }
+
+  if (arena == NULL)
+    {
+      free(first);
+      free(order);
+      free(buckets);
+      free(taken);
+      free(by_size);
+    }
+
+  if (!built)
+    {
+      if (no_hash != NULL) *no_hash = scratch;
+      frozen_symtab_destroy(frozen);
+      return(NULL);
+    }
+  return(frozen);
+}
+
+/*
+  finds the symbol named key
+
+  returns: pointer to the symbol, or NULL if there is no such symbol
+*/
+static inline const frozen_symbol_t *frozen_symtab_find(const frozen_symtab_t *frozen, const void *key,
+							uint32_t key_len)
+{
+  uint64_t h = hash_wy64(key, key_len, frozen->seed);
+  const symtab_slot_t *slot;
+  const frozen_symbol_t *symbol;
+
+  if (frozen->count == 0) return(NULL);
+
+  slot = &frozen->slots[frozen_symtab_slot(h, frozen->displacements[frozen_symtab_bucket(h, frozen->bucket_count)],
+					   frozen->count)];
+  if (slot->hash != (uint32_t) h) return(NULL);
+
+  symbol = &frozen->symbols[slot->index];
+  if ((symbol->key_len != key_len) || (memcmp(symbol->key, key, key_len) != 0))
+    return(NULL);
+  return(symbol);
+}
+
+/*
+  writes a symbol map: one line per symbol, in address order, with the
+  address in hex and the name
+
+  returns: TRUE on success, FALSE if the map could not be written
+*/
+static inline int frozen_symtab_write(const frozen_symtab_t *frozen, FILE *out)
+{
+  uint32_t i;
+
+  for (i = 0; i < frozen->count; i++)
+    {
+      const frozen_symbol_t *symbol = &frozen->symbols[i];
+      fprintf(out, "%08x %.*s\n", symbol->value, (int) symbol->key_len, symbol->key);
+    }
+  return(!ferror(out));
+}
+
+#endif
@@ -12,6 +12,8 @@ Routines to test the hash are included if SELF_TEST is defined.
 #include <stdio.h>
 #include <stddef.h>
 #include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
 typedef  unsigned long  int  ub4;   /* unsigned 4-byte quantities */
 typedef  unsigned       char ub1;
 
@@ -120,5 +122,121 @@ static inline ub4 hash(register ub1 *k, register ub4 length, register ub4 level)
    /*-------------------------------------------- report the result */
    return d;
 }
+
+/*
+--------------------------------------------------------------------
+selectable hash functions.
+
+every hash function takes a key, its length in bytes and a seed, and
+returns a 32-bit hash. HASH_DEFAULT names the one the symbol tables
+use; build with -DHASH_DEFAULT=hash_lookup2 to go back to the hash
+above, or with any other function of type hash_function_t.
+
+hash_wy is wyhash (Wang Yi, public domain): it loads the key 4 or 8
+bytes at a time and mixes with one 64x64->128-bit multiply per 16
+bytes, where hash() above takes a byte at a time and 32 cycles of mix
+per 16 bytes. labels are short, so whole-word loads matter more than
+wide vector ones. hash_wy64 keeps all 64 bits for tables that need
+them.
+--------------------------------------------------------------------
+*/
+
+typedef uint32_t (*hash_function_t)(const void *key, uint32_t key_len, uint32_t seed);
+
+static inline uint32_t hash_lookup2(const void *key, uint32_t key_len, uint32_t seed)
+{
+  return (uint32_t) hash((ub1 *) key, key_len, seed);
+}
+
+static inline uint64_t wy_mix(uint64_t a, uint64_t b)
+{
+  __uint128_t r = (__uint128_t) a * b;
+  return (uint64_t) r ^ (uint64_t) (r >> 64);
+}
+
+static inline uint64_t wy_read8(const uint8_t *p)
+{
+  uint64_t v;
+  memcpy(&v, p, 8);
+  return v;
+}
+
+static inline uint64_t wy_read4(const uint8_t *p)
+{
+  uint32_t v;
+  memcpy(&v, p, 4);
+  return v;
+}
+
+#define WY_SECRET0 0xa0761d6478bd642full
+#define WY_SECRET1 0xe7037ed1a0b428dbull
+#define WY_SECRET2 0x8ebc6af09c88c6e3ull
+#define WY_SECRET3 0x589965cc75374cc3ull
+
+static inline uint64_t hash_wy64(const void *key, uint32_t key_len, uint64_t seed)
+{
+  const uint8_t *p = (const uint8_t *) key;
+  uint64_t a, b;
+  __uint128_t r;
+
+  seed ^= wy_mix(seed ^ WY_SECRET0, WY_SECRET1);
+  if (key_len <= 16)
+    {
+      if (key_len >= 4)
+	{
+	  /* two overlapping pairs of words cover 4 to 16 bytes */
+	  a = (wy_read4(p) << 32) | wy_read4(p + ((key_len >> 3) << 2));
+	  b = (wy_read4(p + key_len - 4) << 32) | wy_read4(p + key_len - 4 - ((key_len >> 3) << 2));
+	}
+      else if (key_len > 0)
+	{
+	  a = ((uint64_t) p[0] << 16) | ((uint64_t) p[key_len >> 1] << 8) | p[key_len - 1];
+	  b = 0;
+	}
+      else
+	a = b = 0;
+    }
+  else
+    {
+      uint32_t i = key_len;
+
+      if (i > 48)
+	{
+	  uint64_t see1 = seed, see2 = seed;
+	  do
+	    {
+	      seed = wy_mix(wy_read8(p) ^ WY_SECRET1, wy_read8(p + 8) ^ seed);
+	      see1 = wy_mix(wy_read8(p + 16) ^ WY_SECRET2, wy_read8(p + 24) ^ see1);
+	      see2 = wy_mix(wy_read8(p + 32) ^ WY_SECRET3, wy_read8(p + 40) ^ see2);
+	      p += 48;
+	      i -= 48;
+	    }
+	  while (i > 48);
+	  seed ^= see1 ^ see2;
+	}
+      while (i > 16)
+	{
+	  seed = wy_mix(wy_read8(p) ^ WY_SECRET1, wy_read8(p + 8) ^ seed);
+	  i -= 16;
+	  p += 16;
+	}
+      /* the last 16 bytes, which may overlap bytes already mixed */
+      a = wy_read8(p + i - 16);
+      b = wy_read8(p + i - 8);
+    }
+
+  r = (__uint128_t) (a ^ WY_SECRET1) * (b ^ seed);
+  return wy_mix((uint64_t) r ^ WY_SECRET0 ^ key_len, (uint64_t) (r >> 64) ^ WY_SECRET1);
+}
+
+static inline uint32_t hash_wy(const void *key, uint32_t key_len, uint32_t seed)
+{
+  return (uint32_t) hash_wy64(key, key_len, seed);
+}
+
+#ifndef HASH_DEFAULT
+#define HASH_DEFAULT hash_wy
+#endif
+
 #endif
 
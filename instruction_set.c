@@ -0,0 +1,29 @@
+/*
+ * instruction_set.c
+ *
+ * Opcode and function bits for every supported mnemonic.
+ */
+#include "instruction_set.h"
+
+const inst_desc_t instruction_set[OP_COUNT] = {
+		[OP_LA]   = { "la",   2, OP_LA,   'i', 0x00, 0x00, SHAPE_RT_LABEL,     8 },
+		[OP_LUI]  = { "lui",  3, OP_LUI,  'i', 0x0f, 0x00, SHAPE_RT_IMM,       4 },
+		[OP_LW]   = { "lw",   2, OP_LW,   'i', 0x23, 0x00, SHAPE_RT_OFFSET_RS, 4 },
+		[OP_SW]   = { "sw",   2, OP_SW,   'i', 0x2b, 0x00, SHAPE_RT_OFFSET_RS, 4 },
+		[OP_ADD]  = { "add",  3, OP_ADD,  'r', 0x00, 0x20, SHAPE_RD_RS_RT,     4 },
+		[OP_SUB]  = { "sub",  3, OP_SUB,  'r', 0x00, 0x21, SHAPE_RD_RS_RT,     4 },
+		[OP_ADDI] = { "addi", 4, OP_ADDI, 'i', 0x08, 0x00, SHAPE_RT_RS_IMM,    4 },
+		[OP_OR]   = { "or",   2, OP_OR,   'r', 0x00, 0x25, SHAPE_RD_RS_RT,     4 },
+		[OP_AND]  = { "and",  3, OP_AND,  'r', 0x00, 0x24, SHAPE_RD_RS_RT,     4 },
+		[OP_ORI]  = { "ori",  3, OP_ORI,  'i', 0x0d, 0x00, SHAPE_RT_RS_IMM,    4 },
+		[OP_ANDI] = { "andi", 4, OP_ANDI, 'i', 0x0c, 0x00, SHAPE_RT_RS_IMM,    4 },
+		[OP_SLT]  = { "slt",  3, OP_SLT,  'r', 0x00, 0x2a, SHAPE_RD_RS_RT,     4 },
+		[OP_SLTI] = { "slti", 4, OP_SLTI, 'i', 0x0a, 0x00, SHAPE_RT_RS_IMM,    4 },
+		[OP_SLL]  = { "sll",  3, OP_SLL,  'r', 0x00, 0x00, SHAPE_RD_RT_SHAMT,  4 },
+		[OP_SRL]  = { "srl",  3, OP_SRL,  'r', 0x00, 0x02, SHAPE_RD_RT_SHAMT,  4 },
+		[OP_BEQ]  = { "beq",  3, OP_BEQ,  'i', 0x04, 0x00, SHAPE_RS_RT_LABEL,  4 },
+		[OP_J]    = { "j",    1, OP_J,    'j', 0x02, 0x00, SHAPE_LABEL,        4 },
+		[OP_JR]   = { "jr",   2, OP_JR,   'r', 0x00, 0x08, SHAPE_RS,           4 },
+		[OP_JAL]  = { "jal",  3, OP_JAL,  'j', 0x03, 0x00, SHAPE_LABEL,        4 },
+		[OP_NOP]  = { "nop",  3, OP_NOP,  'r', 0x00, 0x00, SHAPE_NONE,         4 }
+	};
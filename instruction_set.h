@@ -0,0 +1,190 @@
+/*
+ * instruction_set.h
+ *
+ * Descriptor table for the supported mnemonics and the register file, and the
+ * encoders that turn decoded operands into instruction words. Every mnemonic
+ * is looked up through a perfect hash, so classifying a token costs one
+ * multiply and at most one compare; registers decode through a switch.
+ */
+
+#ifndef INSTRUCTION_SET_H_
+#define INSTRUCTION_SET_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include "mnemonic_hash.h"
+
+// Supported mnemonics, in the order of instruction_set[]
+typedef enum {
+	OP_LA,
+	OP_LUI,
+	OP_LW,
+	OP_SW,
+	OP_ADD,
+	OP_SUB,
+	OP_ADDI,
+	OP_OR,
+	OP_AND,
+	OP_ORI,
+	OP_ANDI,
+	OP_SLT,
+	OP_SLTI,
+	OP_SLL,
+	OP_SRL,
+	OP_BEQ,
+	OP_J,
+	OP_JR,
+	OP_JAL,
+	OP_NOP,
+	OP_COUNT
+} opcode_t;
+
+// Operand layout written in the source for each mnemonic
+typedef enum {
+	SHAPE_NONE,			// nop
+	SHAPE_RD_RS_RT,		// add $rd, $rs, $rt
+	SHAPE_RD_RT_SHAMT,	// sll $rd, $rt, shamt
+	SHAPE_RS,			// jr $rs
+	SHAPE_RT_LABEL,		// la $rt, label
+	SHAPE_RT_OFFSET_RS,	// lw $rt, offset($rs)
+	SHAPE_RT_RS_IMM,	// addi $rt, $rs, immediate
+	SHAPE_RT_IMM,		// lui $rt, immediate
+	SHAPE_RS_RT_LABEL,	// beq $rs, $rt, label
+	SHAPE_LABEL			// j label
+} operand_shape_t;
+
+typedef struct {
+	const char *name;
+	uint8_t len;
+	uint8_t op;			// opcode_t
+	char format;		// 'r', 'i' or 'j'
+	uint8_t opcode;		// 6-bit opcode field
+	uint8_t funct;		// 6-bit function field of R-Type instructions
+	uint8_t shape;		// operand_shape_t
+	uint8_t size;		// Bytes emitted; la expands to lui + ori
+} inst_desc_t;
+
+extern const inst_desc_t instruction_set[OP_COUNT];
+
+/*
+ * Perfect hash over the mnemonics. The first two bytes, the last byte and
+ * the length are packed into one word and multiplied; the top bits select a
+ * slot. The multiplier and mnemonic_slots[] are generated into
+ * mnemonic_hash.h and mnemonic_hash.c by tools/gen_mnemonic_hash.c, which
+ * must be run again when a mnemonic is added, removed or renamed. Static
+ * assertions fail the build only when the number of mnemonics changes or
+ * two of them share a slot. A renamed mnemonic still compiles and is then
+ * not found at run time; only the generator's --check catches it.
+ */
+#define MNEMONIC_KEY(c0, c1, last, len) \
+		((uint32_t)(uint8_t)(c0) | ((uint32_t)(uint8_t)(c1) << 8) \
+		| ((uint32_t)(uint8_t)(last) << 16) | ((uint32_t)(len) << 24))
+#define MNEMONIC_SLOT(key) ((uint32_t)((key) * MNEMONIC_HASH_MULT) >> (32 - MNEMONIC_HASH_BITS))
+
+// Index into instruction_set[] plus one for each slot; 0 marks an empty slot
+extern const uint8_t mnemonic_slots[1 << MNEMONIC_HASH_BITS];
+
+// Return the descriptor for the mnemonic in name[0..len), or NULL
+static inline const inst_desc_t *lookup_instruction(const char *name, size_t len) {
+
+	if (len == 0)
+		return NULL;
+
+	uint32_t key = MNEMONIC_KEY(name[0], (len > 1) ? name[1] : 0, name[len - 1], len);
+	uint8_t index = mnemonic_slots[MNEMONIC_SLOT(key)];
+	if (index == 0)
+		return NULL;
+
+	const inst_desc_t *desc = &instruction_set[index - 1];
+	if (desc->len != len || memcmp(desc->name, name, len) != 0)
+		return NULL;
+
+	return desc;
+}
+
+/*
+ * Instruction encoders. Fields wider than their slot are truncated, so a
+ * negative immediate keeps its low 16 bits.
+ */
+static inline uint32_t encode_rtype(const inst_desc_t *inst, int rs, int rt, int rd, int shamt) {
+
+	return ((uint32_t)inst->opcode << 26) | (((uint32_t)rs & 0x1f) << 21)
+			| (((uint32_t)rt & 0x1f) << 16) | (((uint32_t)rd & 0x1f) << 11)
+			| (((uint32_t)shamt & 0x1f) << 6) | inst->funct;
+}
+
+static inline uint32_t encode_itype(const inst_desc_t *inst, int rs, int rt, int32_t immediate) {
+
+	return ((uint32_t)inst->opcode << 26) | (((uint32_t)rs & 0x1f) << 21)
+			| (((uint32_t)rt & 0x1f) << 16) | ((uint32_t)immediate & 0xffff);
+}
+
+static inline uint32_t encode_jtype(const inst_desc_t *inst, int32_t target) {
+
+	return ((uint32_t)inst->opcode << 26) | ((uint32_t)target & 0x3ffffff);
+}
+
+/*
+ * Decode a register name, without its '$', to its 5-bit number. Accepts
+ * every ABI name (including s8 as an alias of fp) and the numeric forms
+ * 0 to 31. Returns -1 for anything else.
+ */
+static inline int register_number(const char *name, size_t len) {
+
+	if (len == 0)
+		return -1;
+
+	char c0 = name[0];
+
+	// Numeric forms: 0-9 and 10-31, without leading zeros
+	if (c0 >= '0' && c0 <= '9') {
+		if (len == 1)
+			return c0 - '0';
+		if (len == 2 && c0 != '0' && name[1] >= '0' && name[1] <= '9') {
+			int n = (c0 - '0') * 10 + (name[1] - '0');
+			return (n < 32) ? n : -1;
+		}
+		return -1;
+	}
+
+	if (len == 4)
+		return (memcmp(name, "zero", 4) == 0) ? 0 : -1;
+
+	if (len != 2)
+		return -1;
+
+	char c1 = name[1];
+	int d = c1 - '0';
+
+	switch (c0) {
+	case 'a':
+		if (c1 == 't')
+			return 1;
+		return (d >= 0 && d <= 3) ? 4 + d : -1;
+	case 'v':
+		return (d >= 0 && d <= 1) ? 2 + d : -1;
+	case 't':
+		if (d >= 0 && d <= 7)
+			return 8 + d;
+		return (d >= 8 && d <= 9) ? 24 + (d - 8) : -1;
+	case 's':
+		if (c1 == 'p')
+			return 29;
+		if (d >= 0 && d <= 7)
+			return 16 + d;
+		return (d == 8) ? 30 : -1;
+	case 'k':
+		return (d >= 0 && d <= 1) ? 26 + d : -1;
+	case 'g':
+		return (c1 == 'p') ? 28 : -1;
+	case 'f':
+		return (c1 == 'p') ? 30 : -1;
+	case 'r':
+		return (c1 == 'a') ? 31 : -1;
+	}
+
+	return -1;
+}
+
+#endif /* INSTRUCTION_SET_H_ */
@@ -0,0 +1,187 @@
+/*
+ * ir.h
+ *
+ * Decoded form of the source produced by pass 1. Each instruction or data
+ * directive becomes one fixed-size record, so pass 2 only resolves symbols
+ * and encodes, without looking at the source text again.
+ */
+
+#ifndef IR_H_
+#define IR_H_
+
+#include <stdint.h>
+#include <stdlib.h>
+#include "instruction_set.h"
+
+// Record kinds beyond the opcodes of instruction_set[]
+#define IR_WORD		OP_COUNT		// .word: imm repeated count times
+#define IR_ASCIIZ	(OP_COUNT + 1)	// .asciiz: count bytes at source offset imm
+#define IR_LABEL	(OP_COUNT + 2)	// Label sym defined at addr, in the pipelined mode
+
+// sym of a record without a label operand
+#define IR_NO_SYMBOL 0xffffffffu
+
+typedef struct {
+	uint8_t op;			// opcode_t or one of the IR_ kinds
+	uint8_t rs;
+	uint8_t rt;
+	uint8_t rd;
+	int32_t imm;		// Immediate, shift amount, .word value or string offset
+	uint32_t sym;		// Symbol id of a label operand, or IR_NO_SYMBOL
+	uint32_t addr;		// Location counter after this record
+	uint32_t count;		// .word repeat count or .asciiz length
+	uint32_t line;		// Source line, for error messages
+} asm_inst_t;
+
+typedef struct {
+	asm_inst_t *insts;
+	size_t count;
+	size_t capacity;
+	size_t text_words;	// Words pass 2 will emit into each section
+	size_t data_words;
+} asm_program_t;
+
+static inline void program_init(asm_program_t *program) {
+
+	program->insts = NULL;
+	program->count = 0;
+	program->capacity = 0;
+	program->text_words = 0;
+	program->data_words = 0;
+}
+
+static inline void program_clear(asm_program_t *program) {
+
+	program->count = 0;
+	program->text_words = 0;
+	program->data_words = 0;
+}
+
+static inline void program_free(asm_program_t *program) {
+
+	free(program->insts);
+	program_init(program);
+}
+
+// Make room for count records in total, returning -1 if the array could not grow
+static inline int program_reserve(asm_program_t *program, size_t count) {
+
+	if (count <= program->capacity)
+		return 0;
+
+	size_t capacity = program->capacity ? program->capacity : 1024;
+	while (capacity < count)
+		capacity *= 2;
+
+	asm_inst_t *insts = realloc(program->insts, capacity * sizeof(asm_inst_t));
+	if (insts == NULL)
+		return -1;
+	program->insts = insts;
+	program->capacity = capacity;
+	return 0;
+}
+
+// Reserve a new record at the end, returning NULL if the array could not grow
+static inline asm_inst_t *program_append(asm_program_t *program) {
+
+	if (program->count == program->capacity) {
+		size_t capacity = program->capacity ? program->capacity * 2 : 1024;
+		asm_inst_t *insts = realloc(program->insts, capacity * sizeof(asm_inst_t));
+		if (insts == NULL)
+			return NULL;
+		program->insts = insts;
+		program->capacity = capacity;
+	}
+
+	return &program->insts[program->count++];
+}
+
+/*
+ * Single-pass assembly encodes each record as soon as it is decoded. A label
+ * operand that is not defined yet is encoded as zero and a fixup is recorded
+ * against the label; when the label is defined its fixups are walked and the
+ * words patched in place.
+ */
+
+// End of a fixup list
+#define FIXUP_NONE 0xffffffffu
+
+typedef struct {
+	uint32_t next;		// Next fixup for the same symbol, or FIXUP_NONE
+	uint32_t sym;		// Symbol the word waits for
+	uint32_t word;		// Index of the first word to patch in the .text section
+	uint32_t addr;		// Location counter after the instruction, for beq
+	uint32_t line;		// Source line, for error messages
+	uint8_t op;			// opcode_t of the instruction, which decides the field
+} asm_fixup_t;
+
+typedef struct {
+	asm_fixup_t *items;
+	size_t count;
+	size_t capacity;
+	uint32_t *heads;	// Most recent fixup of each symbol id
+	size_t head_count;
+} asm_fixups_t;
+
+static inline void fixups_init(asm_fixups_t *fixups) {
+
+	fixups->items = NULL;
+	fixups->count = 0;
+	fixups->capacity = 0;
+	fixups->heads = NULL;
+	fixups->head_count = 0;
+}
+
+static inline void fixups_clear(asm_fixups_t *fixups) {
+
+	fixups->count = 0;
+	for (size_t i = 0; i < fixups->head_count; i++)
+		fixups->heads[i] = FIXUP_NONE;
+}
+
+static inline void fixups_free(asm_fixups_t *fixups) {
+
+	free(fixups->items);
+	free(fixups->heads);
+	fixups_init(fixups);
+}
+
+// Head of the fixup list of symbol id
+static inline uint32_t fixups_head(const asm_fixups_t *fixups, uint32_t sym) {
+
+	return (sym < fixups->head_count) ? fixups->heads[sym] : FIXUP_NONE;
+}
+
+// Reserve a new fixup at the head of the list of sym, returning NULL if the arrays could not grow
+static inline asm_fixup_t *fixups_add(asm_fixups_t *fixups, uint32_t sym) {
+
+	if (sym >= fixups->head_count) {
+		size_t head_count = fixups->head_count ? fixups->head_count : 128;
+		while (head_count <= sym)
+			head_count *= 2;
+		uint32_t *heads = realloc(fixups->heads, head_count * sizeof(uint32_t));
+		if (heads == NULL)
+			return NULL;
+		for (size_t i = fixups->head_count; i < head_count; i++)
+			heads[i] = FIXUP_NONE;
+		fixups->heads = heads;
+		fixups->head_count = head_count;
+	}
+
+	if (fixups->count == fixups->capacity) {
+		size_t capacity = fixups->capacity ? fixups->capacity * 2 : 256;
+		asm_fixup_t *items = realloc(fixups->items, capacity * sizeof(asm_fixup_t));
+		if (items == NULL)
+			return NULL;
+		fixups->items = items;
+		fixups->capacity = capacity;
+	}
+
+	asm_fixup_t *fixup = &fixups->items[fixups->count];
+	fixup->sym = sym;
+	fixup->next = fixups->heads[sym];
+	fixups->heads[sym] = fixups->count++;
+	return fixup;
+}
+
+#endif /* IR_H_ */
@@ -0,0 +1,155 @@
+/*
+ * mipsasm.c
+ *
+ * The library interface, on top of an assembly context.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include "mipsasm.h"
+#include "assemble.h"
+
+struct mipsasm {
+	asm_context_t ctx;
+	uint32_t error_line;		// Line of the error of the last run
+	const char *error_message;	// Its message, after the line
+};
+
+const char *mipsasm_version(void) {
+
+	return ASSEMBLER_VERSION;
+}
+
+// Returns NULL if the context could not be allocated
+mipsasm_t *mipsasm_create(void) {
+
+	mipsasm_t *as = malloc(sizeof(mipsasm_t));
+	if (as == NULL)
+		return NULL;
+
+	if (asm_context_init(&as->ctx) != 0) {
+		asm_context_free(&as->ctx);
+		free(as);
+		return NULL;
+	}
+
+	as->error_line = 0;
+	as->error_message = NULL;
+	return as;
+}
+
+void mipsasm_destroy(mipsasm_t *as) {
+
+	if (as == NULL)
+		return;
+
+	asm_context_free(&as->ctx);
+	free(as);
+}
+
+// Split the "line N: " that messages about a line start with from the message
+static void split_error(mipsasm_t *as) {
+
+	const char *message = as->ctx.error;
+	as->error_line = 0;
+
+	if (strncmp(message, "line ", 5) == 0) {
+		char *end;
+		unsigned long line = strtoul(message + 5, &end, 10);
+		if (end != message + 5 && end[0] == ':' && end[1] == ' ') {
+			as->error_line = line;
+			message = end + 2;
+		}
+	}
+
+	as->error_message = message;
+}
+
+/*
+ * Assemble len bytes of source, which are only read and need not be
+ * terminated. Returns 0, or -1 if there were errors; they are then listed by
+ * mipsasm_error() and no words or symbols are returned.
+ */
+int mipsasm_assemble(mipsasm_t *as, const char *source, size_t len) {
+
+	asm_context_t *ctx = &as->ctx;
+
+	// The passes never write to the source, so the caller's buffer is used in place
+	source_t src = { (char *)source, len, 0 };
+
+	int status = (asm_context_reset(ctx) != 0) ? asm_error(ctx, "Out of memory") : assemble_source(ctx, &src);
+	if (status != 0)
+		split_error(as);
+	return status;
+}
+
+// Words of the .text section, with their number in *count
+const uint32_t *mipsasm_text(const mipsasm_t *as, size_t *count) {
+
+	*count = as->ctx.failed ? 0 : as->ctx.output.text.count;
+	return (*count > 0) ? as->ctx.output.text.words : NULL;
+}
+
+// Words of the .data section, with their number in *count
+const uint32_t *mipsasm_data(const mipsasm_t *as, size_t *count) {
+
+	*count = as->ctx.failed ? 0 : as->ctx.output.data.count;
+	return (*count > 0) ? as->ctx.output.data.words : NULL;
+}
+
+// Number of labels defined by the last run. They are frozen for lookup on the first call after a run.
+size_t mipsasm_symbol_count(mipsasm_t *as) {
+
+	if (as->ctx.failed)
+		return 0;
+
+	// A run whose labels cannot be frozen becomes a failed run with that error
+	if (asm_context_labels(&as->ctx) != 0) {
+		split_error(as);
+		return 0;
+	}
+	return as->ctx.labels->count;
+}
+
+// Label index, in address order. Returns -1 if there is no such label.
+int mipsasm_symbol(mipsasm_t *as, size_t index, mipsasm_symbol_t *symbol) {
+
+	if (index >= mipsasm_symbol_count(as))
+		return -1;
+
+	const frozen_symbol_t *frozen = &as->ctx.labels->symbols[index];
+	symbol->name = frozen->key;
+	symbol->name_len = frozen->key_len;
+	symbol->address = frozen->value;
+	return 0;
+}
+
+// Address of the label called name. Returns -1 if there is no such label.
+int mipsasm_lookup(mipsasm_t *as, const char *name, size_t name_len, uint32_t *address) {
+
+	if (mipsasm_symbol_count(as) == 0)
+		return -1;
+
+	const frozen_symbol_t *symbol = frozen_symtab_find(as->ctx.labels, name, name_len);
+	if (symbol == NULL)
+		return -1;
+
+	*address = symbol->value;
+	return 0;
+}
+
+// Number of errors of the last run; assembly stops at the first one
+size_t mipsasm_error_count(const mipsasm_t *as) {
+
+	return as->ctx.failed ? 1 : 0;
+}
+
+// Error index of the last run. Returns -1 if there is no such error.
+int mipsasm_error(const mipsasm_t *as, size_t index, mipsasm_error_t *error) {
+
+	if (index >= mipsasm_error_count(as))
+		return -1;
+
+	error->line = as->error_line;
+	error->message = as->error_message;
+	return 0;
+}
@@ -0,0 +1,51 @@
+/*
+ * mipsasm.h
+ *
+ * libmipsasm: the assembler as a library. A context assembles a source held
+ * in memory into the words of the .text and .data sections, the table of
+ * labels and the errors found, all of which stay valid until the context is
+ * used again. Nothing is printed and the process is never exited. The
+ * labels are only frozen into their lookup table when first asked for, so a
+ * run whose labels are never looked at does not pay for it.
+ *
+ * A context may be reused for any number of sources. It keeps the memory of
+ * earlier runs, so once it has assembled the largest source it will see,
+ * later runs do not allocate. Contexts share no state: each thread can use
+ * its own at the same time, but a context must not be used by two threads
+ * at once.
+ */
+
+#ifndef MIPSASM_H_
+#define MIPSASM_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+typedef struct mipsasm mipsasm_t;
+
+// A label and the address it was defined at
+typedef struct {
+	const char *name;	// Not terminated
+	size_t name_len;
+	uint32_t address;
+} mipsasm_symbol_t;
+
+// An error of the last run
+typedef struct {
+	uint32_t line;			// Source line it was found on, or 0 if it has none
+	const char *message;	// Terminated, without the line
+} mipsasm_error_t;
+
+const char *mipsasm_version(void);
+mipsasm_t *mipsasm_create(void);
+void mipsasm_destroy(mipsasm_t *as);
+int mipsasm_assemble(mipsasm_t *as, const char *source, size_t len);
+const uint32_t *mipsasm_text(const mipsasm_t *as, size_t *count);
+const uint32_t *mipsasm_data(const mipsasm_t *as, size_t *count);
+size_t mipsasm_symbol_count(mipsasm_t *as);
+int mipsasm_symbol(mipsasm_t *as, size_t index, mipsasm_symbol_t *symbol);
+int mipsasm_lookup(mipsasm_t *as, const char *name, size_t name_len, uint32_t *address);
+size_t mipsasm_error_count(const mipsasm_t *as);
+int mipsasm_error(const mipsasm_t *as, size_t index, mipsasm_error_t *error);
+
+#endif /* MIPSASM_H_ */
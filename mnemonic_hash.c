@@ -0,0 +1,78 @@
+/*
+ * mnemonic_hash.c
+ *
+ * Generated by tools/gen_mnemonic_hash.c from instruction_set[]; do not edit.
+ * The asserts fail the build when the mnemonics change in number or collide;
+ * a renamed mnemonic is only found by --check.
+ */
+#include "instruction_set.h"
+
+_Static_assert(OP_COUNT == 20, "instruction_set[] changed; run tools/gen_mnemonic_hash");
+
+#define MNEMONIC_BIT(key) ((uint64_t)1 << MNEMONIC_SLOT(key))
+
+_Static_assert((MNEMONIC_BIT(MNEMONIC_KEY('l', 'a', 'a', 2))
+		| MNEMONIC_BIT(MNEMONIC_KEY('l', 'u', 'i', 3))
+		| MNEMONIC_BIT(MNEMONIC_KEY('l', 'w', 'w', 2))
+		| MNEMONIC_BIT(MNEMONIC_KEY('s', 'w', 'w', 2))
+		| MNEMONIC_BIT(MNEMONIC_KEY('a', 'd', 'd', 3))
+		| MNEMONIC_BIT(MNEMONIC_KEY('s', 'u', 'b', 3))
+		| MNEMONIC_BIT(MNEMONIC_KEY('a', 'd', 'i', 4))
+		| MNEMONIC_BIT(MNEMONIC_KEY('o', 'r', 'r', 2))
+		| MNEMONIC_BIT(MNEMONIC_KEY('a', 'n', 'd', 3))
+		| MNEMONIC_BIT(MNEMONIC_KEY('o', 'r', 'i', 3))
+		| MNEMONIC_BIT(MNEMONIC_KEY('a', 'n', 'i', 4))
+		| MNEMONIC_BIT(MNEMONIC_KEY('s', 'l', 't', 3))
+		| MNEMONIC_BIT(MNEMONIC_KEY('s', 'l', 'i', 4))
+		| MNEMONIC_BIT(MNEMONIC_KEY('s', 'l', 'l', 3))
+		| MNEMONIC_BIT(MNEMONIC_KEY('s', 'r', 'l', 3))
+		| MNEMONIC_BIT(MNEMONIC_KEY('b', 'e', 'q', 3))
+		| MNEMONIC_BIT(MNEMONIC_KEY('j', '\0', 'j', 1))
+		| MNEMONIC_BIT(MNEMONIC_KEY('j', 'r', 'r', 2))
+		| MNEMONIC_BIT(MNEMONIC_KEY('j', 'a', 'l', 3))
+		| MNEMONIC_BIT(MNEMONIC_KEY('n', 'o', 'p', 3)))
+		== (MNEMONIC_BIT(MNEMONIC_KEY('l', 'a', 'a', 2))
+		+ MNEMONIC_BIT(MNEMONIC_KEY('l', 'u', 'i', 3))
+		+ MNEMONIC_BIT(MNEMONIC_KEY('l', 'w', 'w', 2))
+		+ MNEMONIC_BIT(MNEMONIC_KEY('s', 'w', 'w', 2))
+		+ MNEMONIC_BIT(MNEMONIC_KEY('a', 'd', 'd', 3))
+		+ MNEMONIC_BIT(MNEMONIC_KEY('s', 'u', 'b', 3))
+		+ MNEMONIC_BIT(MNEMONIC_KEY('a', 'd', 'i', 4))
+		+ MNEMONIC_BIT(MNEMONIC_KEY('o', 'r', 'r', 2))
+		+ MNEMONIC_BIT(MNEMONIC_KEY('a', 'n', 'd', 3))
+		+ MNEMONIC_BIT(MNEMONIC_KEY('o', 'r', 'i', 3))
+		+ MNEMONIC_BIT(MNEMONIC_KEY('a', 'n', 'i', 4))
+		+ MNEMONIC_BIT(MNEMONIC_KEY('s', 'l', 't', 3))
+		+ MNEMONIC_BIT(MNEMONIC_KEY('s', 'l', 'i', 4))
+		+ MNEMONIC_BIT(MNEMONIC_KEY('s', 'l', 'l', 3))
+		+ MNEMONIC_BIT(MNEMONIC_KEY('s', 'r', 'l', 3))
+		+ MNEMONIC_BIT(MNEMONIC_KEY('b', 'e', 'q', 3))
+		+ MNEMONIC_BIT(MNEMONIC_KEY('j', '\0', 'j', 1))
+		+ MNEMONIC_BIT(MNEMONIC_KEY('j', 'r', 'r', 2))
+		+ MNEMONIC_BIT(MNEMONIC_KEY('j', 'a', 'l', 3))
+		+ MNEMONIC_BIT(MNEMONIC_KEY('n', 'o', 'p', 3))),
+		"two mnemonics share a slot; run tools/gen_mnemonic_hash");
+
+// Index into instruction_set[] plus one for each slot; 0 marks an empty slot
+const uint8_t mnemonic_slots[1 << MNEMONIC_HASH_BITS] = {
+		[MNEMONIC_SLOT(MNEMONIC_KEY('l', 'u', 'i', 3))] = OP_LUI + 1,
+		[MNEMONIC_SLOT(MNEMONIC_KEY('o', 'r', 'i', 3))] = OP_ORI + 1,
+		[MNEMONIC_SLOT(MNEMONIC_KEY('o', 'r', 'r', 2))] = OP_OR + 1,
+		[MNEMONIC_SLOT(MNEMONIC_KEY('j', 'a', 'l', 3))] = OP_JAL + 1,
+		[MNEMONIC_SLOT(MNEMONIC_KEY('a', 'n', 'd', 3))] = OP_AND + 1,
+		[MNEMONIC_SLOT(MNEMONIC_KEY('a', 'n', 'i', 4))] = OP_ANDI + 1,
+		[MNEMONIC_SLOT(MNEMONIC_KEY('s', 'l', 't', 3))] = OP_SLT + 1,
+		[MNEMONIC_SLOT(MNEMONIC_KEY('s', 'l', 'l', 3))] = OP_SLL + 1,
+		[MNEMONIC_SLOT(MNEMONIC_KEY('l', 'w', 'w', 2))] = OP_LW + 1,
+		[MNEMONIC_SLOT(MNEMONIC_KEY('s', 'w', 'w', 2))] = OP_SW + 1,
+		[MNEMONIC_SLOT(MNEMONIC_KEY('s', 'l', 'i', 4))] = OP_SLTI + 1,
+		[MNEMONIC_SLOT(MNEMONIC_KEY('s', 'u', 'b', 3))] = OP_SUB + 1,
+		[MNEMONIC_SLOT(MNEMONIC_KEY('b', 'e', 'q', 3))] = OP_BEQ + 1,
+		[MNEMONIC_SLOT(MNEMONIC_KEY('a', 'd', 'd', 3))] = OP_ADD + 1,
+		[MNEMONIC_SLOT(MNEMONIC_KEY('a', 'd', 'i', 4))] = OP_ADDI + 1,
+		[MNEMONIC_SLOT(MNEMONIC_KEY('j', '\0', 'j', 1))] = OP_J + 1,
+		[MNEMONIC_SLOT(MNEMONIC_KEY('l', 'a', 'a', 2))] = OP_LA + 1,
+		[MNEMONIC_SLOT(MNEMONIC_KEY('s', 'r', 'l', 3))] = OP_SRL + 1,
+		[MNEMONIC_SLOT(MNEMONIC_KEY('n', 'o', 'p', 3))] = OP_NOP + 1,
+		[MNEMONIC_SLOT(MNEMONIC_KEY('j', 'r', 'r', 2))] = OP_JR + 1,
+	};
@@ -0,0 +1,14 @@
+/*
+ * mnemonic_hash.h
+ *
+ * Generated by tools/gen_mnemonic_hash.c from instruction_set[]; do not edit.
+ * Run it again whenever a mnemonic is added, removed or renamed.
+ */
+
+#ifndef MNEMONIC_HASH_H_
+#define MNEMONIC_HASH_H_
+
+#define MNEMONIC_HASH_MULT 0x6ec15d39u
+#define MNEMONIC_HASH_BITS 5
+
+#endif /* MNEMONIC_HASH_H_ */
@@ -0,0 +1,489 @@
+/*
+ * output.c
+ *
+ * Buffers assembled words and renders them in the output format.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "output.h"
+
+// Initial number of words reserved for a section
+#define WORD_BUFFER_INITIAL 1024
+
+void output_init(output_t *output) {
+
+	output->text.words = NULL;
+	output->text.count = 0;
+	output->text.capacity = 0;
+
+	output->data.words = NULL;
+	output->data.count = 0;
+	output->data.capacity = 0;
+}
+
+void output_free(output_t *output) {
+
+	free(output->text.words);
+	free(output->data.words);
+	output_init(output);
+}
+
+// Double the capacity of the buffer
+int word_buffer_grow(word_buffer_t *buffer) {
+
+	size_t capacity = buffer->capacity ? buffer->capacity * 2 : WORD_BUFFER_INITIAL;
+	uint32_t *words = realloc(buffer->words, capacity * sizeof(uint32_t));
+	if (words == NULL)
+		return -1;
+
+	buffer->words = words;
+	buffer->capacity = capacity;
+	return 0;
+}
+
+// Make room for count more words, returning -1 if the buffer could not grow
+int word_buffer_reserve(word_buffer_t *buffer, size_t count) {
+
+	while (buffer->capacity - buffer->count < count)
+		if (word_buffer_grow(buffer) != 0)
+			return -1;
+
+	return 0;
+}
+
+// Map a --format name to its output format
+int output_parse_format(const char *name, output_format_t *format) {
+
+	if (strcmp(name, "text") == 0)
+		*format = FORMAT_TEXT;
+	else if (strcmp(name, "bin") == 0)
+		*format = FORMAT_BIN;
+	else if (strcmp(name, "hex") == 0)
+		*format = FORMAT_HEX;
+	else if (strcmp(name, "elf") == 0)
+		*format = FORMAT_ELF;
+	else
+		return -1;
+
+	return 0;
+}
+
+// Serialize the assembled program in the chosen format
+int output_write(const output_t *output, output_format_t format, int big_endian, FILE *Out) {
+
+	switch (format) {
+	case FORMAT_TEXT:
+		return output_write_text(output, Out);
+	case FORMAT_BIN:
+		return output_write_bin(output, big_endian, Out);
+	case FORMAT_HEX:
+		return output_write_hex(output, big_endian, Out);
+	case FORMAT_ELF:
+		return output_write_elf(output, big_endian, Out);
+	}
+
+	return -1;
+}
+
+// Store a 16 or 32-bit value in the chosen byte order
+static void put16(uint8_t *dst, uint16_t value, int big_endian) {
+
+	if (big_endian) {
+		dst[0] = value >> 8;
+		dst[1] = value;
+	}
+	else {
+		dst[0] = value;
+		dst[1] = value >> 8;
+	}
+}
+
+static void put32(uint8_t *dst, uint32_t value, int big_endian) {
+
+	if (big_endian) {
+		dst[0] = value >> 24;
+		dst[1] = value >> 16;
+		dst[2] = value >> 8;
+		dst[3] = value;
+	}
+	else {
+		dst[0] = value;
+		dst[1] = value >> 8;
+		dst[2] = value >> 16;
+		dst[3] = value >> 24;
+	}
+}
+
+// Write words as packed bytes
+static int write_words(const uint32_t *words, size_t count, int big_endian, FILE *Out) {
+
+	uint8_t bytes[4096];
+	size_t i = 0;
+
+	while (i < count) {
+
+		size_t n = count - i;
+		if (n > sizeof(bytes) / 4)
+			n = sizeof(bytes) / 4;
+
+		for (size_t k = 0; k < n; k++)
+			put32(&bytes[k * 4], words[i + k], big_endian);
+
+		if (fwrite(bytes, 4, n, Out) != n)
+			return -1;
+		i += n;
+	}
+
+	return 0;
+}
+
+int output_write_bin(const output_t *output, int big_endian, FILE *Out) {
+
+	if (write_words(output->text.words, output->text.count, big_endian, Out) != 0)
+		return -1;
+
+	return write_words(output->data.words, output->data.count, big_endian, Out);
+}
+
+// Write one Intel HEX record
+static void hex_record(uint8_t type, uint16_t address, const uint8_t *bytes, size_t len, FILE *Out) {
+
+	uint8_t checksum = len + (address >> 8) + (address & 0xff) + type;
+
+	fprintf(Out, ":%02X%04X%02X", (unsigned)len, address, type);
+	for (size_t i = 0; i < len; i++) {
+		fprintf(Out, "%02X", bytes[i]);
+		checksum += bytes[i];
+	}
+	fprintf(Out, "%02X\n", (uint8_t)-checksum);
+}
+
+// Write words as data records of up to 16 bytes starting at base
+static void hex_words(const uint32_t *words, size_t count, uint32_t base, int big_endian,
+		uint32_t *upper, FILE *Out) {
+
+	uint8_t bytes[16];
+
+	for (size_t i = 0; i < count; i += 4) {
+
+		size_t n = count - i;
+		if (n > 4)
+			n = 4;
+
+		uint32_t address = base + i * 4;
+
+		// Records cannot cross a 64 KB boundary; words are aligned, so a
+		// new extended linear address is only needed at a record start
+		if ((address >> 16) != *upper) {
+			uint8_t segment[2];
+			*upper = address >> 16;
+			segment[0] = *upper >> 8;
+			segment[1] = *upper;
+			hex_record(0x04, 0, segment, 2, Out);
+		}
+
+		for (size_t k = 0; k < n; k++)
+			put32(&bytes[k * 4], words[i + k], big_endian);
+
+		hex_record(0x00, address & 0xffff, bytes, n * 4, Out);
+	}
+}
+
+int output_write_hex(const output_t *output, int big_endian, FILE *Out) {
+
+	uint32_t upper = 0;
+
+	hex_words(output->text.words, output->text.count, TEXT_BASE_ADDRESS, big_endian, &upper, Out);
+	hex_words(output->data.words, output->data.count, DATA_BASE_ADDRESS, big_endian, &upper, Out);
+
+	// End of file record
+	hex_record(0x01, 0, NULL, 0, Out);
+	return ferror(Out) ? -1 : 0;
+}
+
+// ELF32 constants used by the minimal executable
+#define ELF_HEADER_SIZE		52
+#define ELF_PHDR_SIZE		32
+#define ELF_SHDR_SIZE		40
+#define ELF_EM_MIPS			8
+#define ELF_ET_EXEC			2
+#define ELF_PT_LOAD			1
+#define ELF_PF_X			1
+#define ELF_PF_W			2
+#define ELF_PF_R			4
+#define ELF_SHT_PROGBITS	1
+#define ELF_SHT_STRTAB		3
+#define ELF_SHF_WRITE		1
+#define ELF_SHF_ALLOC		2
+#define ELF_SHF_EXECINSTR	4
+
+// Section names: "", ".text", ".data" and ".shstrtab"
+static const char elf_shstrtab[] = "\0.text\0.data\0.shstrtab";
+#define ELF_NAME_TEXT		1
+#define ELF_NAME_DATA		7
+#define ELF_NAME_SHSTRTAB	13
+
+static void elf_phdr(uint8_t *dst, uint32_t offset, uint32_t address, uint32_t size,
+		uint32_t flags, int big_endian) {
+
+	put32(dst, ELF_PT_LOAD, big_endian);
+	put32(dst + 4, offset, big_endian);
+	put32(dst + 8, address, big_endian);
+	put32(dst + 12, address, big_endian);
+	put32(dst + 16, size, big_endian);
+	put32(dst + 20, size, big_endian);
+	put32(dst + 24, flags, big_endian);
+	put32(dst + 28, 4, big_endian);
+}
+
+static void elf_shdr(uint8_t *dst, uint32_t name, uint32_t type, uint32_t flags, uint32_t address,
+		uint32_t offset, uint32_t size, uint32_t align, int big_endian) {
+
+	memset(dst, 0, ELF_SHDR_SIZE);
+	put32(dst, name, big_endian);
+	put32(dst + 4, type, big_endian);
+	put32(dst + 8, flags, big_endian);
+	put32(dst + 12, address, big_endian);
+	put32(dst + 16, offset, big_endian);
+	put32(dst + 20, size, big_endian);
+	put32(dst + 32, align, big_endian);
+}
+
+/*
+ * Write a minimal ELF32 MIPS executable: a header, one PT_LOAD segment for
+ * each of .text (at 0) and .data (at 0x2000), the section contents and a
+ * section header table naming them.
+ */
+int output_write_elf(const output_t *output, int big_endian, FILE *Out) {
+
+	uint32_t text_size = output->text.count * 4;
+	uint32_t data_size = output->data.count * 4;
+	uint32_t text_offset = ELF_HEADER_SIZE + 2 * ELF_PHDR_SIZE;
+	uint32_t data_offset = text_offset + text_size;
+	uint32_t shstrtab_offset = data_offset + data_size;
+	uint32_t shdr_offset = (shstrtab_offset + sizeof(elf_shstrtab) + 3) & ~3u;
+
+	uint8_t header[ELF_HEADER_SIZE + 2 * ELF_PHDR_SIZE];
+	memset(header, 0, sizeof(header));
+
+	// e_ident
+	header[0] = 0x7f;
+	header[1] = 'E';
+	header[2] = 'L';
+	header[3] = 'F';
+	header[4] = 1;					// ELFCLASS32
+	header[5] = big_endian ? 2 : 1;	// ELFDATA2MSB or ELFDATA2LSB
+	header[6] = 1;					// EV_CURRENT
+
+	put16(header + 16, ELF_ET_EXEC, big_endian);
+	put16(header + 18, ELF_EM_MIPS, big_endian);
+	put32(header + 20, 1, big_endian);
+	put32(header + 24, TEXT_BASE_ADDRESS, big_endian);	// e_entry
+	put32(header + 28, ELF_HEADER_SIZE, big_endian);	// e_phoff
+	put32(header + 32, shdr_offset, big_endian);		// e_shoff
+	put16(header + 40, ELF_HEADER_SIZE, big_endian);
+	put16(header + 42, ELF_PHDR_SIZE, big_endian);
+	put16(header + 44, 2, big_endian);
+	put16(header + 46, ELF_SHDR_SIZE, big_endian);
+	put16(header + 48, 4, big_endian);
+	put16(header + 50, 3, big_endian);					// e_shstrndx
+
+	elf_phdr(header + ELF_HEADER_SIZE, text_offset, TEXT_BASE_ADDRESS, text_size,
+			ELF_PF_R | ELF_PF_X, big_endian);
+	elf_phdr(header + ELF_HEADER_SIZE + ELF_PHDR_SIZE, data_offset, DATA_BASE_ADDRESS, data_size,
+			ELF_PF_R | ELF_PF_W, big_endian);
+
+	if (fwrite(header, sizeof(header), 1, Out) != 1)
+		return -1;
+	if (write_words(output->text.words, output->text.count, big_endian, Out) != 0)
+		return -1;
+	if (write_words(output->data.words, output->data.count, big_endian, Out) != 0)
+		return -1;
+
+	// Section name table, padded so the section headers are aligned
+	uint8_t padding[3] = { 0, 0, 0 };
+	if (fwrite(elf_shstrtab, sizeof(elf_shstrtab), 1, Out) != 1)
+		return -1;
+	size_t pad = shdr_offset - shstrtab_offset - sizeof(elf_shstrtab);
+	if (pad > 0 && fwrite(padding, pad, 1, Out) != 1)
+		return -1;
+
+	uint8_t sections[4 * ELF_SHDR_SIZE];
+	memset(sections, 0, ELF_SHDR_SIZE);
+	elf_shdr(sections + ELF_SHDR_SIZE, ELF_NAME_TEXT, ELF_SHT_PROGBITS,
+			ELF_SHF_ALLOC | ELF_SHF_EXECINSTR, TEXT_BASE_ADDRESS, text_offset, text_size, 4, big_endian);
+	elf_shdr(sections + 2 * ELF_SHDR_SIZE, ELF_NAME_DATA, ELF_SHT_PROGBITS,
+			ELF_SHF_ALLOC | ELF_SHF_WRITE, DATA_BASE_ADDRESS, data_offset, data_size, 4, big_endian);
+	elf_shdr(sections + 3 * ELF_SHDR_SIZE, ELF_NAME_SHSTRTAB, ELF_SHT_STRTAB,
+			0, 0, shstrtab_offset, sizeof(elf_shstrtab), 1, big_endian);
+
+	if (fwrite(sections, sizeof(sections), 1, Out) != 1)
+		return -1;
+
+	return 0;
+}
+
+/*
+ * ASCII digits for every byte value, most significant bit first. The
+ * nested macros expand to all 256 entries at compile time.
+ */
+#define BYTE_DIGITS(n) { \
+	'0' + (((n) >> 7) & 1), '0' + (((n) >> 6) & 1), '0' + (((n) >> 5) & 1), '0' + (((n) >> 4) & 1), \
+	'0' + (((n) >> 3) & 1), '0' + (((n) >> 2) & 1), '0' + (((n) >> 1) & 1), '0' + ((n) & 1) }
+#define DIGITS_2(n)		BYTE_DIGITS(n), BYTE_DIGITS((n) + 1)
+#define DIGITS_4(n)		DIGITS_2(n), DIGITS_2((n) + 2)
+#define DIGITS_8(n)		DIGITS_4(n), DIGITS_4((n) + 4)
+#define DIGITS_16(n)	DIGITS_8(n), DIGITS_8((n) + 8)
+#define DIGITS_32(n)	DIGITS_16(n), DIGITS_16((n) + 16)
+#define DIGITS_64(n)	DIGITS_32(n), DIGITS_32((n) + 32)
+#define DIGITS_128(n)	DIGITS_64(n), DIGITS_64((n) + 64)
+
+static const char byte_digits[256][8] = { DIGITS_128(0), DIGITS_128(128) };
+
+// Words rendered into the text buffer between writes
+#define TEXT_BUFFER_WORDS 8192
+
+// Render count words as text lines into dst, returning the bytes written
+size_t output_render_text(const uint32_t *words, size_t count, char *dst) {
+
+	char *ptr = dst;
+
+	for (size_t i = 0; i < count; i++) {
+		uint32_t word = words[i];
+		memcpy(ptr, byte_digits[word >> 24], 8);
+		memcpy(ptr + 8, byte_digits[(word >> 16) & 0xff], 8);
+		memcpy(ptr + 16, byte_digits[(word >> 8) & 0xff], 8);
+		memcpy(ptr + 24, byte_digits[word & 0xff], 8);
+		ptr[32] = '\n';
+		ptr += TEXT_LINE_LENGTH;
+	}
+
+	return ptr - dst;
+}
+
+// Render words through buffer and write them in large blocks
+static int write_text_words(const uint32_t *words, size_t count, char *buffer, FILE *Out) {
+
+	for (size_t i = 0; i < count; i += TEXT_BUFFER_WORDS) {
+
+		size_t n = count - i;
+		if (n > TEXT_BUFFER_WORDS)
+			n = TEXT_BUFFER_WORDS;
+
+		size_t len = output_render_text(words + i, n, buffer);
+		if (fwrite(buffer, 1, len, Out) != len)
+			return -1;
+	}
+
+	return 0;
+}
+
+// Write every word as a line of 32 ASCII '0'/'1' characters
+int output_write_text(const output_t *output, FILE *Out) {
+
+	char *buffer = malloc(TEXT_BUFFER_WORDS * TEXT_LINE_LENGTH);
+	if (buffer == NULL)
+		return -1;
+
+	int ret = write_text_words(output->text.words, output->text.count, buffer, Out);
+	if (ret == 0)
+		ret = write_text_words(output->data.words, output->data.count, buffer, Out);
+
+	free(buffer);
+	return ret;
+}
+
+/*
+ * Start writing a program whose words arrive in pieces, .text first. Only
+ * formats that need no section sizes up front can be streamed, so ELF
+ * returns -1.
+ */
+int output_stream_open(output_stream_t *stream, output_format_t format, int big_endian, FILE *Out) {
+
+	if (format == FORMAT_ELF)
+		return -1;
+
+	stream->format = format;
+	stream->big_endian = big_endian;
+	stream->Out = Out;
+	stream->data = 0;
+	stream->written = 0;
+	stream->upper = 0;
+	stream->pending_count = 0;
+	stream->buffer = NULL;
+
+	if (format == FORMAT_TEXT) {
+		stream->buffer = malloc(TEXT_BUFFER_WORDS * TEXT_LINE_LENGTH);
+		if (stream->buffer == NULL)
+			return -1;
+	}
+
+	return 0;
+}
+
+// Write the hex words held back for a full record
+static void hex_flush(output_stream_t *stream) {
+
+	uint32_t base = stream->data ? DATA_BASE_ADDRESS : TEXT_BASE_ADDRESS;
+
+	hex_words(stream->pending, stream->pending_count, base + (stream->written - stream->pending_count) * 4,
+			stream->big_endian, &stream->upper, stream->Out);
+	stream->pending_count = 0;
+}
+
+/*
+ * Write the next count words of .text, or of .data once data is set. Hex
+ * records hold four words from the start of their section, so words that
+ * do not fill a record wait for the next call.
+ */
+int output_stream_write(output_stream_t *stream, int data, const uint32_t *words, size_t count) {
+
+	if (data && !stream->data) {
+		if (stream->format == FORMAT_HEX && stream->pending_count > 0)
+			hex_flush(stream);
+		stream->data = 1;
+		stream->written = 0;
+	}
+
+	if (stream->format == FORMAT_TEXT)
+		return write_text_words(words, count, stream->buffer, stream->Out);
+	if (stream->format == FORMAT_BIN)
+		return write_words(words, count, stream->big_endian, stream->Out);
+
+	uint32_t base = stream->data ? DATA_BASE_ADDRESS : TEXT_BASE_ADDRESS;
+
+	while (count > 0 && stream->pending_count > 0) {
+		stream->pending[stream->pending_count++] = *words++;
+		stream->written++;
+		count--;
+		if (stream->pending_count == 4)
+			hex_flush(stream);
+	}
+
+	size_t whole = count & ~(size_t)3;
+	hex_words(words, whole, base + stream->written * 4, stream->big_endian, &stream->upper, stream->Out);
+	stream->written += whole;
+
+	for (size_t i = whole; i < count; i++) {
+		stream->pending[stream->pending_count++] = words[i];
+		stream->written++;
+	}
+
+	return ferror(stream->Out) ? -1 : 0;
+}
+
+// Write what is held back and the end of the output if finish is set, and release the stream
+int output_stream_close(output_stream_t *stream, int finish) {
+
+	if (finish && stream->format == FORMAT_HEX) {
+		if (stream->pending_count > 0)
+			hex_flush(stream);
+		hex_record(0x01, 0, NULL, 0, stream->Out);
+	}
+
+	free(stream->buffer);
+	stream->buffer = NULL;
+	return ferror(stream->Out) ? -1 : 0;
+}
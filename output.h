@@ -0,0 +1,81 @@
+/*
+ * output.h
+ *
+ * Assembled program as 32-bit words. Pass 2 appends encoded words here and
+ * the output format serializes them once assembly is complete.
+ */
+
+#ifndef OUTPUT_H_
+#define OUTPUT_H_
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+
+// Load addresses of the sections, matching the location counter in parse_file()
+#define TEXT_BASE_ADDRESS 0x00000000
+#define DATA_BASE_ADDRESS 0x00002000
+
+// Output formats selected with --format
+typedef enum {
+	FORMAT_TEXT,	// One line of 32 ASCII '0'/'1' characters per word
+	FORMAT_BIN,		// Raw packed words, .text followed by .data
+	FORMAT_HEX,		// Intel HEX with .text and .data at their load addresses
+	FORMAT_ELF		// ELF32 MIPS executable
+} output_format_t;
+
+// Bytes per word in the text format: 32 digits and a newline
+#define TEXT_LINE_LENGTH 33
+
+// A growable array of instruction or data words
+typedef struct {
+	uint32_t *words;
+	size_t count;
+	size_t capacity;
+} word_buffer_t;
+
+// Words of the .text section followed by those of the .data section
+typedef struct {
+	word_buffer_t text;
+	word_buffer_t data;
+} output_t;
+
+// Writes a program whose words arrive in pieces, as the pipelined mode produces them
+typedef struct {
+	output_format_t format;
+	int big_endian;
+	FILE *Out;
+	int data;				// The .data section has started
+	size_t written;			// Words of the current section written or pending
+	uint32_t upper;			// Extended linear address of the last hex record
+	uint32_t pending[4];	// Hex words waiting to fill a record
+	size_t pending_count;
+	char *buffer;			// Text lines are rendered here
+} output_stream_t;
+
+void output_init(output_t *output);
+void output_free(output_t *output);
+int word_buffer_grow(word_buffer_t *buffer);
+int word_buffer_reserve(word_buffer_t *buffer, size_t count);
+int output_parse_format(const char *name, output_format_t *format);
+int output_write(const output_t *output, output_format_t format, int big_endian, FILE *Out);
+int output_write_text(const output_t *output, FILE *Out);
+size_t output_render_text(const uint32_t *words, size_t count, char *dst);
+int output_write_bin(const output_t *output, int big_endian, FILE *Out);
+int output_write_hex(const output_t *output, int big_endian, FILE *Out);
+int output_write_elf(const output_t *output, int big_endian, FILE *Out);
+int output_stream_open(output_stream_t *stream, output_format_t format, int big_endian, FILE *Out);
+int output_stream_write(output_stream_t *stream, int data, const uint32_t *words, size_t count);
+int output_stream_close(output_stream_t *stream, int finish);
+
+// Append one word, returning -1 if the buffer could not grow
+static inline int word_buffer_append(word_buffer_t *buffer, uint32_t word) {
+
+	if (buffer->count == buffer->capacity && word_buffer_grow(buffer) != 0)
+		return -1;
+
+	buffer->words[buffer->count++] = word;
+	return 0;
+}
+
+#endif /* OUTPUT_H_ */
@@ -0,0 +1,416 @@
+/*
+ * output_cache.c
+ *
+ * Lookup, storage and LRU eviction of the whole-output cache.
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/ioctl.h>
+#ifdef __linux__
+#include <linux/fs.h>
+#endif
+#include "output_cache.h"
+#include "assemble.h"
+#include "hash_function.h"
+
+// Bytes copied at a time when an entry cannot be reflinked
+#define OUTPUT_CACHE_COPY_SIZE (64 * 1024)
+
+// An entry found while scanning the directory
+typedef struct {
+	char *name;
+	uint64_t size;
+	struct timespec used;
+} cache_entry_t;
+
+// A path in the cache directory; the caller frees it
+static char *cache_path(const output_cache_t *cache, const char *name) {
+
+	size_t len = strlen(cache->dir) + strlen(name) + 2;
+	char *path = malloc(len);
+	if (path != NULL)
+		snprintf(path, len, "%s/%s", cache->dir, name);
+	return path;
+}
+
+// Entry names are keys; anything else in the directory is a temporary file or not ours
+static int is_key(const char *name) {
+
+	if (strlen(name) != OUTPUT_CACHE_KEY_LENGTH)
+		return 0;
+	for (const char *c = name; *c != '\0'; c++)
+		if (!((*c >= '0' && *c <= '9') || (*c >= 'a' && *c <= 'f')))
+			return 0;
+	return 1;
+}
+
+static int is_temporary(const char *name) {
+
+	size_t len = strlen(name);
+	return len > OUTPUT_CACHE_KEY_LENGTH + 4 && strcmp(name + len - 4, ".tmp") == 0
+			&& name[OUTPUT_CACHE_KEY_LENGTH] == '.';
+}
+
+// Least recently used first
+static int compare_used(const void *a, const void *b) {
+
+	const cache_entry_t *entry_a = a, *entry_b = b;
+
+	if (entry_a->used.tv_sec != entry_b->used.tv_sec)
+		return (entry_a->used.tv_sec < entry_b->used.tv_sec) ? -1 : 1;
+	if (entry_a->used.tv_nsec != entry_b->used.tv_nsec)
+		return (entry_a->used.tv_nsec < entry_b->used.tv_nsec) ? -1 : 1;
+	return strcmp(entry_a->name, entry_b->name);
+}
+
+/*
+ * Total the entries of the directory into cache->size and, if they exceed
+ * target, remove the least recently used until they fit. Temporary files
+ * left behind by crashed runs are removed on the way. Called with the lock
+ * held; returns the number of entries removed.
+ */
+static uint64_t cache_scan(output_cache_t *cache, uint64_t target) {
+
+	DIR *dir = opendir(cache->dir);
+	if (dir == NULL)
+		return 0;
+
+	cache_entry_t *entries = NULL;
+	size_t count = 0, capacity = 0;
+	uint64_t size = 0;
+	time_t now = time(NULL);
+	struct dirent *dirent;
+
+	while ((dirent = readdir(dir)) != NULL) {
+
+		int key = is_key(dirent->d_name);
+		if (!key && !is_temporary(dirent->d_name))
+			continue;
+
+		struct stat st;
+		if (fstatat(dirfd(dir), dirent->d_name, &st, 0) != 0 || !S_ISREG(st.st_mode))
+			continue;
+
+		if (!key) {
+			if (now - st.st_mtime > OUTPUT_CACHE_STALE)
+				unlinkat(dirfd(dir), dirent->d_name, 0);
+			continue;
+		}
+
+		size += st.st_size;
+		if (count == capacity) {
+			size_t grown = capacity ? capacity * 2 : 256;
+			cache_entry_t *resized = realloc(entries, grown * sizeof(cache_entry_t));
+			if (resized == NULL)
+				break;
+			entries = resized;
+			capacity = grown;
+		}
+		entries[count].name = strdup(dirent->d_name);
+		if (entries[count].name == NULL)
+			break;
+		entries[count].size = st.st_size;
+		entries[count].used = st.st_mtim;
+		count++;
+	}
+
+	uint64_t evicted = 0;
+	if (size > target) {
+		qsort(entries, count, sizeof(cache_entry_t), compare_used);
+		for (size_t i = 0; i < count && size > target; i++)
+			if (unlinkat(dirfd(dir), entries[i].name, 0) == 0 || errno == ENOENT) {
+				size -= entries[i].size;
+				evicted++;
+			}
+	}
+
+	for (size_t i = 0; i < count; i++)
+		free(entries[i].name);
+	free(entries);
+	closedir(dir);
+
+	cache->size = size;
+	return evicted;
+}
+
+/*
+ * Use dir as the cache, creating it if needed, with entries taking up at
+ * most max_size bytes. Returns -1 if the directory cannot be used.
+ */
+int output_cache_open(output_cache_t *cache, const char *dir, uint64_t max_size) {
+
+	if (mkdir(dir, 0777) != 0 && errno != EEXIST)
+		return -1;
+
+	struct stat st;
+	if (stat(dir, &st) != 0 || !S_ISDIR(st.st_mode))
+		return -1;
+
+	cache->dir = strdup(dir);
+	if (cache->dir == NULL)
+		return -1;
+	cache->max_size = max_size;
+	cache->size = 0;
+	cache->sequence = 0;
+	pthread_mutex_init(&cache->lock, NULL);
+
+	cache_scan(cache, UINT64_MAX);
+	return 0;
+}
+
+void output_cache_close(output_cache_t *cache) {
+
+	pthread_mutex_destroy(&cache->lock);
+	free(cache->dir);
+	cache->dir = NULL;
+}
+
+// Hash len bytes, which may be more than one call of the hash takes
+static uint64_t hash_source(const char *data, size_t len, uint64_t seed) {
+
+	do {
+		uint32_t piece = (len > (1u << 30)) ? (1u << 30) : (uint32_t)len;
+		seed = hash_wy64(data, piece, seed);
+		data += piece;
+		len -= piece;
+	} while (len > 0);
+
+	return seed;
+}
+
+/*
+ * The key of a source assembled to format: OUTPUT_CACHE_KEY_LENGTH hex
+ * digits written to key, which has room for them and a terminator.
+ */
+void output_cache_key(char *key, const source_t *src, output_format_t format, int big_endian) {
+
+	// The text format has no byte order
+	if (format == FORMAT_TEXT)
+		big_endian = 0;
+
+	char salt[64];
+	int salt_len = snprintf(salt, sizeof(salt), "mipsasm %s format %d endian %d", ASSEMBLER_VERSION, (int)format, big_endian);
+	uint64_t seed = hash_wy64(salt, salt_len, 0);
+
+	snprintf(key, OUTPUT_CACHE_KEY_LENGTH + 1, "%016llx%016llx",
+			(unsigned long long)hash_source(src->data, src->len, seed),
+			(unsigned long long)hash_source(src->data, src->len, ~seed));
+}
+
+/*
+ * Open the entry for key, making it the most recently used. Returns its
+ * descriptor with its size in *size, or -1 on a miss.
+ */
+int output_cache_lookup(output_cache_t *cache, const char *key, uint64_t *size) {
+
+	char *path = cache_path(cache, key);
+	if (path == NULL)
+		return -1;
+
+	int fd = open(path, O_RDONLY | O_CLOEXEC);
+	free(path);
+	if (fd < 0)
+		return -1;
+
+	struct stat st;
+	if (fstat(fd, &st) != 0) {
+		close(fd);
+		return -1;
+	}
+
+	futimens(fd, NULL);
+	*size = st.st_size;
+	return fd;
+}
+
+/*
+ * Write the entry opened by output_cache_lookup() to Out, which is empty,
+ * and close it. A regular output file on a filesystem that supports it
+ * shares the entry's blocks instead of copying them. Returns -1 if Out
+ * could not be written.
+ */
+int output_cache_copy(int fd, FILE *Out) {
+
+	int status = 0;
+	if (fflush(Out) != 0)
+		status = -1;
+
+#ifdef FICLONE
+	else if (Out != stdout && fileno(Out) >= 0 && ioctl(fileno(Out), FICLONE, fd) == 0) {
+		close(fd);
+		return 0;
+	}
+#endif
+
+	else {
+		char *buffer = malloc(OUTPUT_CACHE_COPY_SIZE);
+		ssize_t n = 0;
+		if (buffer == NULL)
+			status = -1;
+		while (status == 0 && (n = read(fd, buffer, OUTPUT_CACHE_COPY_SIZE)) > 0)
+			if (fwrite(buffer, 1, n, Out) != (size_t)n)
+				status = -1;
+		if (n < 0)
+			status = -1;
+		free(buffer);
+	}
+
+	close(fd);
+	return status;
+}
+
+/*
+ * Write the entry for key to Out, which is empty. Returns 1 with the
+ * entry's size in *size on a hit, 0 on a miss and -1 if Out could not be
+ * written.
+ */
+int output_cache_fetch(output_cache_t *cache, const char *key, FILE *Out, uint64_t *size) {
+
+	int fd = output_cache_lookup(cache, key, size);
+	if (fd < 0)
+		return 0;
+
+	return (output_cache_copy(fd, Out) == 0) ? 1 : -1;
+}
+
+// Write len bytes to fd
+static int write_all(int fd, const char *data, size_t len) {
+
+	while (len > 0) {
+		ssize_t n = write(fd, data, len);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			return -1;
+		data += n;
+		len -= n;
+	}
+	return 0;
+}
+
+/*
+ * Create a temporary file for the entry of key, under a name unique to
+ * this process and call, and give the entry's path in *path. Returns its
+ * descriptor, or -1 with nothing to free.
+ */
+static int cache_create(output_cache_t *cache, const char *key, char **tmp_path, char **path) {
+
+	char name[OUTPUT_CACHE_KEY_LENGTH + 48];
+	snprintf(name, sizeof(name), "%s.%ld.%u.tmp", key, (long)getpid(),
+			__atomic_fetch_add(&cache->sequence, 1, __ATOMIC_RELAXED));
+
+	*tmp_path = cache_path(cache, name);
+	*path = cache_path(cache, key);
+	int fd = (*tmp_path != NULL && *path != NULL) ? open(*tmp_path, O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0666) : -1;
+	if (fd < 0) {
+		free(*tmp_path);
+		free(*path);
+	}
+	return fd;
+}
+
+/*
+ * Rename the temporary file written for an entry into place, or remove it
+ * if status is not 0, then evict entries if the cache went over its cap,
+ * adding their number to *evicted. Frees both paths and returns status, or
+ * -1 if the rename failed.
+ */
+static int cache_commit(output_cache_t *cache, char *tmp_path, char *path, int status, uint64_t size,
+		uint64_t *evicted) {
+
+	if (status == 0) {
+		pthread_mutex_lock(&cache->lock);
+
+		// Two workers that missed on the same key both store it; the second replaces the first
+		struct stat st;
+		uint64_t replaced = (stat(path, &st) == 0) ? (uint64_t)st.st_size : 0;
+
+		if (rename(tmp_path, path) == 0) {
+			cache->size -= (replaced < cache->size) ? replaced : cache->size;
+			cache->size += size;
+			if (cache->size > cache->max_size)
+				*evicted += cache_scan(cache, cache->max_size * OUTPUT_CACHE_LOW_WATER);
+		}
+		else
+			status = -1;
+
+		pthread_mutex_unlock(&cache->lock);
+	}
+
+	if (status != 0)
+		remove(tmp_path);
+
+	free(tmp_path);
+	free(path);
+	return status;
+}
+
+/*
+ * Store the size bytes of a finished output in data as the entry for key.
+ * Returns -1 if the entry could not be written, or was larger than the
+ * cap; the cache is then left as it was.
+ */
+int output_cache_store(output_cache_t *cache, const char *key, const char *data, size_t size, uint64_t *evicted) {
+
+	if (size > cache->max_size)
+		return -1;
+
+	char *tmp_path, *path;
+	int fd = cache_create(cache, key, &tmp_path, &path);
+	if (fd < 0)
+		return -1;
+
+	int status = write_all(fd, data, size);
+	if (close(fd) != 0)
+		status = -1;
+	return cache_commit(cache, tmp_path, path, status, size, evicted);
+}
+
+/*
+ * Store the finished output file open on fd as the entry for key, sharing
+ * its blocks where the filesystem supports it, as a hit shares the entry's.
+ * fd must be readable; its offset is not used. Returns as
+ * output_cache_store().
+ */
+int output_cache_store_file(output_cache_t *cache, const char *key, int fd, uint64_t *evicted) {
+
+	struct stat st;
+	if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || (uint64_t)st.st_size > cache->max_size)
+		return -1;
+
+	char *tmp_path, *path;
+	int entry = cache_create(cache, key, &tmp_path, &path);
+	if (entry < 0)
+		return -1;
+
+	int status = 0;
+#ifdef FICLONE
+	if (ioctl(entry, FICLONE, fd) != 0)
+#endif
+	{
+		char *buffer = malloc(OUTPUT_CACHE_COPY_SIZE);
+		off_t offset = 0;
+		ssize_t n = 0;
+		if (buffer == NULL)
+			status = -1;
+		while (status == 0 && (n = pread(fd, buffer, OUTPUT_CACHE_COPY_SIZE, offset)) > 0) {
+			status = write_all(entry, buffer, n);
+			offset += n;
+		}
+		if (n < 0)
+			status = -1;
+		free(buffer);
+	}
+
+	if (close(entry) != 0)
+		status = -1;
+	return cache_commit(cache, tmp_path, path, status, st.st_size, evicted);
+}
@@ -0,0 +1,52 @@
+/*
+ * output_cache.h
+ *
+ * Whole-output cache of --cache-dir. Each entry is the finished output of
+ * one file, named by a hash of the source bytes, the assembler version and
+ * the output format and byte order, so an unchanged source is never parsed
+ * again. Entries are written under a temporary name and renamed into place,
+ * so concurrent runs sharing the directory only ever see whole entries. A
+ * hit refreshes the entry's modification time, and once the entries take
+ * up more than the size cap the least recently used ones are removed.
+ */
+
+#ifndef OUTPUT_CACHE_H_
+#define OUTPUT_CACHE_H_
+
+#include <stdio.h>
+#include <stdint.h>
+#include <pthread.h>
+#include "output.h"
+#include "source.h"
+
+// Hex digits of a key: two 64-bit hashes
+#define OUTPUT_CACHE_KEY_LENGTH 32
+
+// Size cap when --cache-size is not given
+#define OUTPUT_CACHE_DEFAULT_SIZE (256ull * 1024 * 1024)
+
+// Eviction stops once the entries fit in this share of the cap, so it does not run on every store
+#define OUTPUT_CACHE_LOW_WATER 0.9
+
+// Seconds after which a temporary file is taken to be left over from a crashed run
+#define OUTPUT_CACHE_STALE 3600
+
+// One cache directory, shared by the workers of a batch
+typedef struct {
+	char *dir;
+	uint64_t max_size;		// Bytes the entries may take up
+	uint64_t size;			// Bytes they took up at the last scan, plus those stored since
+	uint32_t sequence;		// Makes the temporary names of this process unique
+	pthread_mutex_t lock;
+} output_cache_t;
+
+int output_cache_open(output_cache_t *cache, const char *dir, uint64_t max_size);
+void output_cache_close(output_cache_t *cache);
+void output_cache_key(char *key, const source_t *src, output_format_t format, int big_endian);
+int output_cache_lookup(output_cache_t *cache, const char *key, uint64_t *size);
+int output_cache_copy(int fd, FILE *Out);
+int output_cache_fetch(output_cache_t *cache, const char *key, FILE *Out, uint64_t *size);
+int output_cache_store(output_cache_t *cache, const char *key, const char *data, size_t size, uint64_t *evicted);
+int output_cache_store_file(output_cache_t *cache, const char *key, int fd, uint64_t *evicted);
+
+#endif /* OUTPUT_CACHE_H_ */
@@ -0,0 +1,657 @@
+/*
+ * serve.c
+ *
+ * The daemon of --serve, its request statistics, and the client of
+ * --connect.
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <errno.h>
+#include <limits.h>
+#include <pthread.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/stat.h>
+#include "serve.h"
+
+// Latencies are counted in buckets an eighth of a power of two of nanoseconds wide, so percentiles are within 12.5%
+#define SERVE_LATENCY_STEPS 8
+#define SERVE_LATENCY_BUCKETS (62 * SERVE_LATENCY_STEPS)
+
+// Bytes copied at a time from a reply to the output, and the first size of a worker's reply buffer
+#define SERVE_COPY_SIZE (64 * 1024)
+
+typedef struct {
+	int listen_fd;
+	int stopping;					// Set once a signal asked the daemon to stop
+	int worker_count;
+	const asm_options_t *options;	// Supplies the output cache shared by the workers
+
+	pthread_mutex_t lock;			// Guards the counters below
+	struct timespec started;
+	uint64_t requests;
+	uint64_t failed;				// Requests answered with an error, or not at all
+	uint64_t latency[SERVE_LATENCY_BUCKETS];	// Requests by time from accept to the end of the reply
+	uint64_t latency_max;			// Nanoseconds
+	asm_stats_t total;				// Summed over the assembly requests
+} serve_server_t;
+
+// A worker thread and the context it assembles every request in
+typedef struct {
+	serve_server_t *server;
+	asm_context_t ctx;
+	int ready;			// The context was created
+	int assembled;		// The current request was assembled in the context
+	char *buffer;		// Source or path of the current request, reused by the next
+	size_t capacity;
+	char *reply;		// Output of the current request, built in full before it is sent
+	size_t reply_length;
+	size_t reply_capacity;
+	const char *message;	// Error sent instead of the output when the status is not SERVE_OK
+	int started;
+	pthread_t thread;
+} serve_worker_t;
+
+static int serve_error(char *error, const char *format, ...) {
+
+	va_list args;
+	va_start(args, format);
+	vsnprintf(error, ASM_ERROR_LENGTH, format, args);
+	va_end(args);
+	return -1;
+}
+
+// Send len bytes; a client or daemon that went away gives an error, not SIGPIPE
+static int send_all(int fd, const void *data, size_t len) {
+
+	const char *pos = data;
+	while (len > 0) {
+		ssize_t n = send(fd, pos, len, MSG_NOSIGNAL);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			return -1;
+		pos += n;
+		len -= n;
+	}
+	return 0;
+}
+
+// Receive exactly len bytes. Returns -1 on an error, a timeout or the end of the connection.
+static int recv_all(int fd, void *data, size_t len) {
+
+	char *pos = data;
+	while (len > 0) {
+		ssize_t n = recv(fd, pos, len, 0);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			return -1;
+		pos += n;
+		len -= n;
+	}
+	return 0;
+}
+
+// Append to the worker's reply; it keeps the size of the largest reply so far
+static ssize_t reply_write(void *cookie, const char *data, size_t len) {
+
+	serve_worker_t *worker = cookie;
+	if (len > worker->reply_capacity - worker->reply_length) {
+		size_t capacity = (worker->reply_capacity > 0) ? worker->reply_capacity : SERVE_COPY_SIZE;
+		while (capacity - worker->reply_length < len)
+			capacity *= 2;
+		char *reply = realloc(worker->reply, capacity);
+		if (reply == NULL)
+			return -1;
+		worker->reply = reply;
+		worker->reply_capacity = capacity;
+	}
+
+	memcpy(worker->reply + worker->reply_length, data, len);
+	worker->reply_length += len;
+	return len;
+}
+
+static int serve_address(struct sockaddr_un *addr, const char *socket_path) {
+
+	if (strlen(socket_path) >= sizeof(addr->sun_path)) {
+		errno = ENAMETOOLONG;
+		return -1;
+	}
+
+	memset(addr, 0, sizeof(*addr));
+	addr->sun_family = AF_UNIX;
+	strcpy(addr->sun_path, socket_path);
+	return 0;
+}
+
+// Returns the connected socket, or -1 with errno set
+static int serve_connect(const char *socket_path) {
+
+	struct sockaddr_un addr;
+	if (serve_address(&addr, socket_path) != 0)
+		return -1;
+
+	int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (fd < 0)
+		return -1;
+
+	if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+		int saved = errno;
+		close(fd);
+		errno = saved;
+		return -1;
+	}
+	return fd;
+}
+
+/*
+ * Bind and listen on socket_path. A socket left behind by a daemon that is
+ * gone is replaced; one that a daemon still answers on is not. The socket
+ * is made accessible to its owner only, since the daemon opens the paths
+ * it is sent with its own privileges.
+ */
+static int serve_listen(const char *socket_path) {
+
+	struct sockaddr_un addr;
+	if (serve_address(&addr, socket_path) != 0)
+		return -1;
+
+	int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (fd < 0)
+		return -1;
+
+	if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+
+		int stale = 0;
+		if (errno == EADDRINUSE) {
+			int probe = serve_connect(socket_path);
+			stale = (probe < 0 && errno == ECONNREFUSED);
+			if (probe >= 0)
+				close(probe);
+		}
+
+		if (!stale || unlink(socket_path) != 0 || bind(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+			close(fd);
+			return -1;
+		}
+	}
+
+	if (chmod(socket_path, S_IRUSR | S_IWUSR) != 0 || listen(fd, SOMAXCONN) != 0) {
+		close(fd);
+		unlink(socket_path);
+		return -1;
+	}
+	return fd;
+}
+
+static size_t latency_bucket(uint64_t ns) {
+
+	if (ns < SERVE_LATENCY_STEPS)
+		return ns;
+
+	int exponent = 63 - __builtin_clzll(ns);
+	return (exponent - 2) * SERVE_LATENCY_STEPS + ((ns >> (exponent - 3)) & (SERVE_LATENCY_STEPS - 1));
+}
+
+// Smallest latency counted in a bucket
+static uint64_t latency_floor(size_t bucket) {
+
+	if (bucket < SERVE_LATENCY_STEPS)
+		return bucket;
+
+	int exponent = bucket / SERVE_LATENCY_STEPS + 2;
+	return (uint64_t)(SERVE_LATENCY_STEPS + bucket % SERVE_LATENCY_STEPS) << (exponent - 3);
+}
+
+// Latency in microseconds that fraction of the requests took at most, rounded up to its bucket
+static double latency_percentile(const serve_server_t *server, double fraction) {
+
+	if (server->requests == 0)
+		return 0;
+
+	uint64_t rank = (uint64_t)(fraction * server->requests);
+	if (rank < fraction * server->requests || rank == 0)
+		rank++;
+
+	uint64_t seen = 0;
+	size_t bucket = 0;
+	while (bucket < SERVE_LATENCY_BUCKETS - 1 && (seen += server->latency[bucket]) < rank)
+		bucket++;
+
+	uint64_t bound = (bucket < SERVE_LATENCY_BUCKETS - 1) ? latency_floor(bucket + 1) - 1 : server->latency_max;
+	return ((bound < server->latency_max) ? bound : server->latency_max) * 1e-3;
+}
+
+static void serve_record(serve_server_t *server, uint64_t ns, int status) {
+
+	pthread_mutex_lock(&server->lock);
+	server->requests++;
+	if (status != SERVE_OK)
+		server->failed++;
+	server->latency[latency_bucket(ns)]++;
+	if (ns > server->latency_max)
+		server->latency_max = ns;
+	pthread_mutex_unlock(&server->lock);
+}
+
+/*
+ * The counters of the daemon as one JSON object: requests and how fast they
+ * came since it started, latency percentiles, and the --stats figures
+ * summed over every file it assembled.
+ */
+static void serve_print_stats(serve_server_t *server, FILE *Out) {
+
+	pthread_mutex_lock(&server->lock);
+
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	double uptime = (now.tv_sec - server->started.tv_sec) + (now.tv_nsec - server->started.tv_nsec) * 1e-9;
+	double rate = (uptime > 0) ? 1 / uptime : 0;
+
+	fprintf(Out, "{\"uptime_s\": %.3f, \"workers\": %d, \"requests\": %llu, \"failed\": %llu", uptime,
+			server->worker_count, (unsigned long long)server->requests, (unsigned long long)server->failed);
+	fprintf(Out, ", \"requests_per_s\": %.3f, \"bytes_in_per_s\": %.0f, \"bytes_out_per_s\": %.0f",
+			server->requests * rate, server->total.bytes_in * rate, server->total.bytes_out * rate);
+	fprintf(Out, ", \"latency_us\": {\"p50\": %.1f, \"p90\": %.1f, \"p99\": %.1f, \"p999\": %.1f, \"max\": %.1f}",
+			latency_percentile(server, 0.5), latency_percentile(server, 0.9), latency_percentile(server, 0.99),
+			latency_percentile(server, 0.999), server->latency_max * 1e-3);
+	fprintf(Out, ", \"assembly\": ");
+	stats_print_json(&server->total, Out);
+	fprintf(Out, "}\n");
+
+	pthread_mutex_unlock(&server->lock);
+}
+
+// Reply with the message of an error in place of whatever output was written
+static int serve_fail(serve_worker_t *worker, serve_status_t status, const char *message) {
+
+	worker->message = message;
+	return status;
+}
+
+/*
+ * Assemble the source of a request, loaded into the worker's buffer, and
+ * write the output to Out, the worker's reply, or set the error. The
+ * output cache is used as by assemble_file(). Returns the status of the
+ * reply.
+ */
+static int serve_assemble(serve_worker_t *worker, const serve_request_t *request, FILE *Out) {
+
+	asm_context_t *ctx = &worker->ctx;
+	const asm_options_t *options = worker->server->options;
+
+	if (!worker->ready || asm_context_reset(ctx) != 0)
+		return serve_fail(worker, SERVE_FAILED, "Out of memory");
+	worker->assembled = 1;
+
+	// A path is mapped like the input of assemble_file(); a source is used where it was received
+	source_t src = { worker->buffer, request->length, 0 };
+	if (request->type == SERVE_PATH) {
+		worker->buffer[request->length] = '\0';
+		stats_begin(&ctx->stats);
+		if (source_open(&src, worker->buffer) != 0)
+			return serve_fail(worker, SERVE_FAILED, "Input file could not be opened.");
+		stats_end(&ctx->stats, STATS_READ);
+	}
+	ctx->stats.files = 1;
+	ctx->stats.bytes_in = src.len;
+
+	output_format_t format = request->format;
+	int big_endian = request->big_endian;
+	char key[OUTPUT_CACHE_KEY_LENGTH + 1];
+	int entry = -1;
+	uint64_t size;
+
+	if (options->output_cache != NULL) {
+		output_cache_key(key, &src, format, big_endian);
+		entry = output_cache_lookup(options->output_cache, key, &size);
+	}
+
+	int status = SERVE_OK;
+	if (entry >= 0) {
+		stats_begin(&ctx->stats);
+		if (output_cache_copy(entry, Out) != 0 || fflush(Out) != 0)
+			status = serve_fail(worker, SERVE_FAILED, "Output cache entry could not be read.");
+		stats_end(&ctx->stats, STATS_WRITE);
+		ctx->stats.cache_hits++;
+	}
+
+	else if (assemble_source(ctx, &src) != 0) {
+		stats_symbols(&ctx->stats, ctx->symbols);
+		status = serve_fail(worker, SERVE_ASSEMBLY_ERROR, ctx->error);
+	}
+
+	else {
+		stats_symbols(&ctx->stats, ctx->symbols);
+		stats_begin(&ctx->stats);
+		if (output_write(&ctx->output, format, big_endian, Out) != 0 || fflush(Out) != 0)
+			status = serve_fail(worker, SERVE_FAILED, "Out of memory");
+		else if (options->output_cache != NULL) {
+			ctx->stats.cache_misses++;
+			output_cache_store(options->output_cache, key, worker->reply, worker->reply_length,
+					&ctx->stats.cache_evictions);
+		}
+		stats_end(&ctx->stats, STATS_WRITE);
+	}
+
+	if (request->type == SERVE_PATH)
+		source_close(&src);
+	return status;
+}
+
+// Grow the worker's buffer to hold size bytes; it keeps the size of the largest request so far
+static int serve_reserve(serve_worker_t *worker, size_t size) {
+
+	if (size <= worker->capacity)
+		return 0;
+
+	char *buffer = realloc(worker->buffer, size);
+	if (buffer == NULL)
+		return -1;
+	worker->buffer = buffer;
+	worker->capacity = size;
+	return 0;
+}
+
+/*
+ * Read the request on fd and reply to it. The output is built in the
+ * worker's reply buffer and only then sent behind its header, so a failure
+ * while building it is reported in its status. Returns the status of the
+ * reply, or -1 if the request was malformed or the client went away; the
+ * connection is then closed without a reply, or with a short one.
+ */
+static int serve_connection(serve_worker_t *worker, int fd) {
+
+	serve_server_t *server = worker->server;
+	serve_request_t request;
+	worker->assembled = 0;
+
+	// A path is opened with the daemon's privileges, so only its own user may send one
+	struct ucred peer;
+	socklen_t peer_len = sizeof(peer);
+	int trusted = (getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &peer, &peer_len) == 0 && peer.uid == geteuid());
+
+	if (recv_all(fd, &request, sizeof(request)) != 0 || request.magic != SERVE_MAGIC
+			|| (request.type == SERVE_PATH && !trusted)
+			|| request.type > SERVE_STATS || request.format > FORMAT_ELF || request.length > SERVE_MAX_SOURCE
+			|| (request.type == SERVE_PATH && (request.length == 0 || request.length >= PATH_MAX)))
+		return -1;
+
+	worker->reply_length = 0;
+	FILE *Out = fopencookie(worker, "w", (cookie_io_functions_t){ NULL, reply_write, NULL, NULL });
+	if (Out == NULL)
+		return -1;
+
+	int status = SERVE_OK;
+	if (request.type == SERVE_STATS)
+		serve_print_stats(server, Out);
+	else if (serve_reserve(worker, request.length + 1) != 0)
+		status = serve_fail(worker, SERVE_FAILED, "Out of memory");
+	else if (recv_all(fd, worker->buffer, request.length) != 0)
+		status = -1;
+	else
+		status = serve_assemble(worker, &request, Out);
+
+	int unwritten = ferror(Out);
+	if ((fclose(Out) != 0 || unwritten) && status == SERVE_OK)
+		status = serve_fail(worker, SERVE_FAILED, "Out of memory");
+
+	if (status >= 0) {
+		const char *body = (status == SERVE_OK) ? worker->reply : worker->message;
+		serve_reply_t reply = { SERVE_MAGIC, status, (status == SERVE_OK) ? worker->reply_length : strlen(body) };
+		if (send_all(fd, &reply, sizeof(reply)) != 0 || send_all(fd, body, reply.length) != 0)
+			status = -1;
+	}
+
+	if (worker->assembled) {
+		worker->ctx.stats.bytes_out = (status == SERVE_OK) ? worker->reply_length : 0;
+		pthread_mutex_lock(&server->lock);
+		stats_add(&server->total, &worker->ctx.stats);
+		pthread_mutex_unlock(&server->lock);
+	}
+
+	return status;
+}
+
+static void *serve_worker(void *arg) {
+
+	serve_worker_t *worker = arg;
+	serve_server_t *server = worker->server;
+	struct timeval timeout = { SERVE_TIMEOUT, 0 };
+
+	while (!__atomic_load_n(&server->stopping, __ATOMIC_ACQUIRE)) {
+
+		// Shutting the listening socket down wakes the workers to stop
+		int fd = accept4(server->listen_fd, NULL, NULL, SOCK_CLOEXEC);
+		if (fd < 0) {
+			if (errno == EINTR || errno == ECONNABORTED)
+				continue;
+			if (errno == EMFILE || errno == ENFILE || errno == ENOBUFS || errno == ENOMEM) {
+				nanosleep(&(struct timespec){ 0, 10 * 1000 * 1000 }, NULL);
+				continue;
+			}
+			break;
+		}
+
+		struct timespec start, end;
+		clock_gettime(CLOCK_MONOTONIC, &start);
+
+		setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+		setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+		int status = serve_connection(worker, fd);
+		close(fd);
+
+		clock_gettime(CLOCK_MONOTONIC, &end);
+		serve_record(server, (end.tv_sec - start.tv_sec) * 1000000000ull + end.tv_nsec - start.tv_nsec, status);
+	}
+
+	return NULL;
+}
+
+/*
+ * Serve requests on socket_path with workers threads until SIGINT, SIGTERM
+ * or SIGHUP arrives, then finish the requests being answered, remove the
+ * socket and return 0. Only the output cache of options is used; each
+ * request names its own format. Returns -1 with a message in error if the
+ * daemon could not start.
+ */
+int serve_run(const char *socket_path, int workers, const asm_options_t *options, char *error) {
+
+	// The signals that stop the daemon are taken by this thread alone, so they are blocked before the workers start
+	sigset_t signals;
+	sigemptyset(&signals);
+	sigaddset(&signals, SIGINT);
+	sigaddset(&signals, SIGTERM);
+	sigaddset(&signals, SIGHUP);
+	pthread_sigmask(SIG_BLOCK, &signals, NULL);
+
+	serve_server_t server;
+	memset(&server, 0, sizeof(server));
+	server.listen_fd = serve_listen(socket_path);
+	if (server.listen_fd < 0)
+		return serve_error(error, "Socket %s could not be listened on.", socket_path);
+
+	server.worker_count = workers;
+	server.options = options;
+	pthread_mutex_init(&server.lock, NULL);
+	clock_gettime(CLOCK_MONOTONIC, &server.started);
+	stats_clear(&server.total, 0);
+
+	serve_worker_t *pool = calloc(workers, sizeof(serve_worker_t));
+	int started = 0;
+	for (int w = 0; pool != NULL && w < workers; w++) {
+		pool[w].server = &server;
+		pool[w].ready = (asm_context_init(&pool[w].ctx) == 0);
+		pool[w].started = (pthread_create(&pool[w].thread, NULL, serve_worker, &pool[w]) == 0);
+		started += pool[w].started;
+	}
+
+	int status = 0;
+	if (started == 0)
+		status = serve_error(error, "Worker threads could not be started.");
+	else {
+		int caught;
+		sigwait(&signals, &caught);
+	}
+
+	__atomic_store_n(&server.stopping, 1, __ATOMIC_RELEASE);
+	shutdown(server.listen_fd, SHUT_RDWR);
+
+	for (int w = 0; pool != NULL && w < workers; w++) {
+		if (pool[w].started)
+			pthread_join(pool[w].thread, NULL);
+		asm_context_free(&pool[w].ctx);
+		free(pool[w].buffer);
+		free(pool[w].reply);
+	}
+	free(pool);
+
+	close(server.listen_fd);
+	unlink(socket_path);
+	pthread_mutex_destroy(&server.lock);
+	return status;
+}
+
+/*
+ * Send a request to the daemon at socket_path and read the header of its
+ * reply into *reply. The error of a reply that is not SERVE_OK is read
+ * into error. Returns the socket, to read the rest of the reply from, or -1
+ * with a message in error.
+ */
+static int serve_exchange(const char *socket_path, const serve_request_t *request, const char *payload,
+		serve_reply_t *reply, char *error) {
+
+	int fd = serve_connect(socket_path);
+	if (fd < 0)
+		return serve_error(error, "Server %s could not be reached.", socket_path);
+
+	if (send_all(fd, request, sizeof(*request)) != 0 || send_all(fd, payload, request->length) != 0
+			|| recv_all(fd, reply, sizeof(*reply)) != 0 || reply->magic != SERVE_MAGIC || reply->status > SERVE_FAILED
+			|| (reply->status != SERVE_OK && (reply->length >= ASM_ERROR_LENGTH
+			|| recv_all(fd, error, reply->length) != 0))) {
+		close(fd);
+		return serve_error(error, "Server %s did not reply.", socket_path);
+	}
+
+	if (reply->status != SERVE_OK)
+		error[reply->length] = '\0';
+	return fd;
+}
+
+// Copy the length bytes of a reply to Out; a reply cut short is an error
+static int serve_copy(int fd, uint64_t length, FILE *Out, char *error) {
+
+	char *buffer = malloc(SERVE_COPY_SIZE);
+	if (buffer == NULL)
+		return serve_error(error, "Out of memory");
+
+	int status = 0;
+	while (status == 0 && length > 0) {
+		ssize_t n = recv(fd, buffer, (length < SERVE_COPY_SIZE) ? length : SERVE_COPY_SIZE, 0);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n < 0)
+			status = serve_error(error, "Server reply could not be read.");
+		else if (n == 0)
+			status = serve_error(error, "Server reply was cut short.");
+		else if (fwrite(buffer, 1, n, Out) != (size_t)n)
+			status = serve_error(error, "Output file could not be written.");
+		else
+			length -= n;
+	}
+
+	free(buffer);
+	return status;
+}
+
+/*
+ * Have the daemon at socket_path assemble in_path into out_path, as
+ * assemble_file() would in process. An input of "-" is read from stdin and
+ * sent; any other input is sent as its absolute path for the daemon to map.
+ * An output of "-" is written to stdout, and an assembly error is written to
+ * the output file, for which ASM_ERROR_IN_OUTPUT is returned. Returns -1
+ * for any other error, with the error in error.
+ */
+int serve_request_file(const char *socket_path, const char *in_path, const char *out_path,
+		const asm_options_t *options, char *error) {
+
+	serve_request_t request = { SERVE_MAGIC, SERVE_PATH, options->format, options->big_endian, 0, 0 };
+	source_t src = { NULL, 0, 0 };
+	char *path = NULL;
+	const char *payload;
+
+	if (strcmp(in_path, "-") == 0) {
+		if (source_read_stream(&src, stdin) != 0)
+			return serve_error(error, "Input file could not be opened.");
+		request.type = SERVE_SOURCE;
+		request.length = src.len;
+		payload = src.data;
+	}
+	else {
+		path = realpath(in_path, NULL);
+		if (path == NULL)
+			return serve_error(error, "Input file could not be opened.");
+		request.length = strlen(path);
+		payload = path;
+	}
+
+	serve_reply_t reply;
+	int fd = serve_exchange(socket_path, &request, payload, &reply, error);
+	free(path);
+	source_close(&src);
+	if (fd < 0)
+		return -1;
+
+	// Like an in-process run, an input that could not be read leaves no output behind
+	if (reply.status == SERVE_FAILED) {
+		close(fd);
+		return -1;
+	}
+
+	FILE *Out = (strcmp(out_path, "-") == 0) ? stdout : fopen(out_path, options->format == FORMAT_TEXT ? "w" : "wb");
+	if (Out == NULL) {
+		close(fd);
+		return serve_error(error, "Output file could not opened.");
+	}
+
+	int result;
+	int partial = 0;
+	if (reply.status == SERVE_ASSEMBLY_ERROR) {
+		fprintf(Out, "%s\n", error);
+		result = ASM_ERROR_IN_OUTPUT;
+	}
+	else
+		partial = result = serve_copy(fd, reply.length, Out, error);
+	close(fd);
+
+	if ((Out == stdout ? fflush(Out) : fclose(Out)) != 0 && result >= 0)
+		partial = result = serve_error(error, "Output file could not be written.");
+
+	// An output the reply did not carry in full is not left behind as if it were whole
+	if (partial != 0 && Out != stdout)
+		remove(out_path);
+	return result;
+}
+
+// Write the stats of the daemon at socket_path to Out
+int serve_request_stats(const char *socket_path, FILE *Out, char *error) {
+
+	serve_request_t request = { SERVE_MAGIC, SERVE_STATS, 0, 0, 0, 0 };
+	serve_reply_t reply;
+
+	int fd = serve_exchange(socket_path, &request, NULL, &reply, error);
+	if (fd < 0)
+		return -1;
+
+	int result = (reply.status == SERVE_OK) ? serve_copy(fd, reply.length, Out, error) : -1;
+	close(fd);
+	return result;
+}
@@ -0,0 +1,69 @@
+/*
+ * serve.h
+ *
+ * The assembler as a daemon. --serve listens on a Unix domain socket with a
+ * pool of worker threads, each of which keeps one context and reuses it for
+ * every request it takes, so a build that runs the assembler thousands of
+ * times pays for process startup only in the small client. --connect sends
+ * one file to the daemon and writes the reply where an in-process run would
+ * have written its output.
+ *
+ * A connection carries one request and its reply. The request is a
+ * serve_request_t followed by length bytes: the source itself, or the
+ * absolute path of a file for the daemon to map. The reply is a
+ * serve_reply_t followed by length bytes: the output, the error message or
+ * the stats. The daemon builds a reply in full before it sends the header,
+ * so the status covers all of it; a client that receives fewer bytes must
+ * treat the output as lost. Both sides are on the same machine, so the
+ * headers are in its byte order.
+ */
+
+#ifndef SERVE_H_
+#define SERVE_H_
+
+#include <stdio.h>
+#include <stdint.h>
+#include "assemble.h"
+
+// "MIPS", first in every request and reply
+#define SERVE_MAGIC 0x4d495053
+
+// Longest source a request may carry
+#define SERVE_MAX_SOURCE (1ull << 30)
+
+// Seconds a worker waits on a client that stopped sending or reading
+#define SERVE_TIMEOUT 30
+
+typedef enum {
+	SERVE_SOURCE,		// The source follows
+	SERVE_PATH,			// The absolute path of the source follows
+	SERVE_STATS			// Latency and throughput of the daemon, as JSON
+} serve_type_t;
+
+typedef enum {
+	SERVE_OK,				// The output, or the stats, follow
+	SERVE_ASSEMBLY_ERROR,	// The error follows; it belongs in the output file
+	SERVE_FAILED			// The error follows; there is no output
+} serve_status_t;
+
+typedef struct {
+	uint32_t magic;
+	uint8_t type;
+	uint8_t format;
+	uint8_t big_endian;
+	uint8_t reserved;
+	uint64_t length;	// Bytes that follow
+} serve_request_t;
+
+typedef struct {
+	uint32_t magic;
+	uint32_t status;
+	uint64_t length;	// Bytes that follow
+} serve_reply_t;
+
+int serve_run(const char *socket_path, int workers, const asm_options_t *options, char *error);
+int serve_request_file(const char *socket_path, const char *in_path, const char *out_path,
+		const asm_options_t *options, char *error);
+int serve_request_stats(const char *socket_path, FILE *Out, char *error);
+
+#endif /* SERVE_H_ */
@@ -0,0 +1,117 @@
+/*
+ * source.c
+ *
+ * Loads an input file into memory once so that both passes can share it.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "source.h"
+
+// Size of the blocks used when spooling a stream into memory
+#define SPOOL_BLOCK_SIZE (64 * 1024)
+
+// Open path and map it into memory. "-" reads from stdin.
+int source_open(source_t *src, const char *path) {
+
+	src->data = NULL;
+	src->len = 0;
+	src->mapped_len = 0;
+
+	if (strcmp(path, "-") == 0)
+		return source_read_stream(src, stdin);
+
+	int fd = open(path, O_RDONLY);
+	if (fd < 0)
+		return -1;
+
+	struct stat st;
+	if (fstat(fd, &st) < 0) {
+		close(fd);
+		return -1;
+	}
+
+	// Pipes, FIFOs and character devices cannot be mapped, so spool them
+	if (!S_ISREG(st.st_mode)) {
+		FILE *fptr = fdopen(fd, "r");
+		if (fptr == NULL) {
+			close(fd);
+			return -1;
+		}
+		int ret = source_read_stream(src, fptr);
+		fclose(fptr);
+		return ret;
+	}
+
+	// mmap refuses zero-length mappings; an empty file is simply empty
+	if (st.st_size == 0) {
+		close(fd);
+		return 0;
+	}
+
+	void *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED)
+		return -1;
+
+	madvise(map, st.st_size, MADV_SEQUENTIAL);
+
+	src->data = map;
+	src->len = st.st_size;
+	src->mapped_len = st.st_size;
+	return 0;
+}
+
+// Read all of fptr into a single growing buffer
+int source_read_stream(source_t *src, FILE *fptr) {
+
+	size_t capacity = SPOOL_BLOCK_SIZE;
+	char *buffer = malloc(capacity);
+	if (buffer == NULL)
+		return -1;
+
+	size_t len = 0;
+	while (1) {
+
+		if (len == capacity) {
+			capacity *= 2;
+			char *grown = realloc(buffer, capacity);
+			if (grown == NULL) {
+				free(buffer);
+				return -1;
+			}
+			buffer = grown;
+		}
+
+		size_t n = fread(buffer + len, 1, capacity - len, fptr);
+		len += n;
+		if (n == 0)
+			break;
+	}
+
+	if (ferror(fptr)) {
+		free(buffer);
+		return -1;
+	}
+
+	src->data = buffer;
+	src->len = len;
+	src->mapped_len = 0;
+	return 0;
+}
+
+void source_close(source_t *src) {
+
+	if (src->mapped_len != 0)
+		munmap(src->data, src->mapped_len);
+	else
+		free(src->data);
+
+	src->data = NULL;
+	src->len = 0;
+	src->mapped_len = 0;
+}
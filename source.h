@@ -0,0 +1,59 @@
+/*
+ * source.h
+ *
+ * Input layer for the assembler. The whole source file is mapped (or, for
+ * pipes and stdin, spooled) into a single buffer once, and every pass walks
+ * that buffer through zero-copy line views.
+ */
+
+#ifndef SOURCE_H_
+#define SOURCE_H_
+
+#include <stdio.h>
+#include <stddef.h>
+#include <string.h>
+
+// A view of one line in the source buffer, without its terminating newline
+typedef struct {
+	const char *ptr;
+	size_t len;
+} line_view_t;
+
+// The in-memory copy of an input file
+typedef struct {
+	char *data;
+	size_t len;
+	size_t mapped_len;	// Non-zero when data is an mmap'd region
+} source_t;
+
+int source_open(source_t *src, const char *path);
+int source_read_stream(source_t *src, FILE *fptr);
+void source_close(source_t *src);
+
+/*
+ * Fetch the line starting at *pos and advance *pos past its newline.
+ * Returns 0 once the end of the buffer has been reached.
+ */
+static inline int source_next_line(const source_t *src, size_t *pos, line_view_t *line) {
+
+	if (*pos >= src->len)
+		return 0;
+
+	const char *start = src->data + *pos;
+	size_t remaining = src->len - *pos;
+	const char *newline = memchr(start, '\n', remaining);
+
+	line->ptr = start;
+	if (newline != NULL) {
+		line->len = newline - start;
+		*pos += line->len + 1;
+	}
+	else {
+		line->len = remaining;
+		*pos = src->len;
+	}
+
+	return 1;
+}
+
+#endif /* SOURCE_H_ */
@@ -0,0 +1,164 @@
+#ifndef __SPSC_RING_H
+#define __SPSC_RING_H
+
+#include <stdlib.h>
+#include <stddef.h>
+#include <sched.h>
+#include <pthread.h>
+
+/*
+   bounded single-producer single-consumer ring of pointers.
+
+   exactly one thread pushes and one thread pops. each side owns one index
+   and only reads the other's, so the fast path is a load, a store and no
+   lock. a side that finds the ring full or empty spins for a while and
+   then sleeps on a condition variable; the other side only takes the lock
+   to wake it when it has announced that it is sleeping.
+
+   the producer closes the ring when it has nothing more to send; the
+   consumer still drains what is left. aborting the ring makes both sides
+   fail at once, which lets any stage of a pipeline stop all the others.
+*/
+
+#define SPSC_RING_OPEN 0
+#define SPSC_RING_CLOSED 1
+#define SPSC_RING_ABORTED 2
+
+/* polls of the other side's index before a waiting side sleeps */
+#define SPSC_RING_SPINS 256
+
+typedef struct
+{
+  void **items;
+  size_t mask;                                 /* capacity - 1, a power of two */
+  size_t head __attribute__((aligned(64)));    /* next item to pop, written by the consumer */
+  size_t tail __attribute__((aligned(64)));    /* next free slot, written by the producer */
+  int state __attribute__((aligned(64)));
+  int sleepers;
+  pthread_mutex_t lock;
+  pthread_cond_t wake;
+} spsc_ring_t;
+
+/* creates a ring holding at least capacity items.
+   returns: FALSE if it could not be allocated.
+*/
+static inline int spsc_ring_init(spsc_ring_t *ring, size_t capacity)
+{
+  size_t size = 2;
+  while (size < capacity) size <<= 1;
+
+  ring->items = malloc(size * sizeof(void *));
+  if (ring->items == NULL) return(0);
+
+  ring->mask = size - 1;
+  ring->head = 0;
+  ring->tail = 0;
+  ring->state = SPSC_RING_OPEN;
+  ring->sleepers = 0;
+  pthread_mutex_init(&ring->lock, NULL);
+  pthread_cond_init(&ring->wake, NULL);
+  return(1);
+}
+
+static inline void spsc_ring_destroy(spsc_ring_t *ring)
+{
+  free(ring->items);
+  ring->items = NULL;
+  pthread_mutex_destroy(&ring->lock);
+  pthread_cond_destroy(&ring->wake);
+}
+
+/* wakes the other side if it went to sleep. the fence orders the index
+   or state store before the read of sleepers, pairing with the fence in
+   spsc_ring_wait, so a sleeper either sees the store or gets woken.
+*/
+static inline void spsc_ring_notify(spsc_ring_t *ring)
+{
+  __atomic_thread_fence(__ATOMIC_SEQ_CST);
+  if (__atomic_load_n(&ring->sleepers, __ATOMIC_RELAXED) == 0) return;
+
+  pthread_mutex_lock(&ring->lock);
+  pthread_cond_broadcast(&ring->wake);
+  pthread_mutex_unlock(&ring->lock);
+}
+
+/* producer can push: there is room, or the ring was aborted */
+static inline int spsc_ring_can_push(spsc_ring_t *ring)
+{
+  return (ring->tail - __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE) <= ring->mask)
+    || (__atomic_load_n(&ring->state, __ATOMIC_ACQUIRE) == SPSC_RING_ABORTED);
+}
+
+/* consumer can pop: there is an item, or no more will come */
+static inline int spsc_ring_can_pop(spsc_ring_t *ring)
+{
+  return (__atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE) != ring->head)
+    || (__atomic_load_n(&ring->state, __ATOMIC_ACQUIRE) != SPSC_RING_OPEN);
+}
+
+/* waits until ready(ring) holds, spinning first and then sleeping */
+static inline void spsc_ring_wait(spsc_ring_t *ring, int (*ready)(spsc_ring_t *))
+{
+  int spins;
+
+  for (spins = 0; spins < SPSC_RING_SPINS; spins++)
+    {
+      if (ready(ring)) return;
+      sched_yield();
+    }
+
+  pthread_mutex_lock(&ring->lock);
+  __atomic_fetch_add(&ring->sleepers, 1, __ATOMIC_SEQ_CST);
+  __atomic_thread_fence(__ATOMIC_SEQ_CST);
+  while (!ready(ring))
+    pthread_cond_wait(&ring->wake, &ring->lock);
+  __atomic_fetch_sub(&ring->sleepers, 1, __ATOMIC_RELAXED);
+  pthread_mutex_unlock(&ring->lock);
+}
+
+/* pushes item, waiting while the ring is full.
+   returns: FALSE if the ring was aborted.
+*/
+static inline int spsc_ring_push(spsc_ring_t *ring, void *item)
+{
+  if (!spsc_ring_can_push(ring)) spsc_ring_wait(ring, spsc_ring_can_push);
+  if (__atomic_load_n(&ring->state, __ATOMIC_ACQUIRE) == SPSC_RING_ABORTED) return(0);
+
+  ring->items[ring->tail & ring->mask] = item;
+  __atomic_store_n(&ring->tail, ring->tail + 1, __ATOMIC_RELEASE);
+  spsc_ring_notify(ring);
+  return(1);
+}
+
+/* pops the oldest item into *item, waiting while the ring is empty.
+   returns: FALSE once the ring is closed and drained, or aborted.
+*/
+static inline int spsc_ring_pop(spsc_ring_t *ring, void **item)
+{
+  if (!spsc_ring_can_pop(ring)) spsc_ring_wait(ring, spsc_ring_can_pop);
+  if (__atomic_load_n(&ring->state, __ATOMIC_ACQUIRE) == SPSC_RING_ABORTED) return(0);
+  if (__atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE) == ring->head) return(0);
+
+  *item = ring->items[ring->head & ring->mask];
+  __atomic_store_n(&ring->head, ring->head + 1, __ATOMIC_RELEASE);
+  spsc_ring_notify(ring);
+  return(1);
+}
+
+/* the producer is done; the consumer pops what is left, then stops */
+static inline void spsc_ring_close(spsc_ring_t *ring)
+{
+  int open = SPSC_RING_OPEN;
+  __atomic_compare_exchange_n(&ring->state, &open, SPSC_RING_CLOSED, 0,
+                              __ATOMIC_RELEASE, __ATOMIC_RELAXED);
+  spsc_ring_notify(ring);
+}
+
+/* stops both sides; may be called from any thread */
+static inline void spsc_ring_abort(spsc_ring_t *ring)
+{
+  __atomic_store_n(&ring->state, SPSC_RING_ABORTED, __ATOMIC_RELEASE);
+  spsc_ring_notify(ring);
+}
+
+#endif /* __SPSC_RING_H */
@@ -0,0 +1,150 @@
+/*
+ * stats.c
+ *
+ * Phase timing, the symbol table report and the --stats output.
+ */
+#include <string.h>
+#include "stats.h"
+
+static const char *phase_names[STATS_PHASES] = { "read", "pass1", "pass2", "write" };
+
+/*
+ * Reset the counters for a new assembly. A threaded assembly spreads its
+ * work over a thread pool, so its CPU time is the whole process's; otherwise
+ * only the calling thread's CPU time counts, which keeps the files of a
+ * batch that run side by side apart.
+ */
+void stats_clear(asm_stats_t *stats, int threaded) {
+
+	memset(stats, 0, sizeof(*stats));
+	stats->cpu_clock = threaded ? CLOCK_PROCESS_CPUTIME_ID : CLOCK_THREAD_CPUTIME_ID;
+}
+
+// Start timing a phase
+void stats_begin(asm_stats_t *stats) {
+
+	clock_gettime(CLOCK_MONOTONIC, &stats->mark_wall);
+	clock_gettime(stats->cpu_clock, &stats->mark_cpu);
+}
+
+static double seconds_since(const struct timespec *start, const struct timespec *end) {
+
+	return (end->tv_sec - start->tv_sec) + (end->tv_nsec - start->tv_nsec) * 1e-9;
+}
+
+// Add the time since stats_begin to a phase
+void stats_end(asm_stats_t *stats, asm_phase_t phase) {
+
+	struct timespec wall, cpu;
+	clock_gettime(CLOCK_MONOTONIC, &wall);
+	clock_gettime(stats->cpu_clock, &cpu);
+
+	stats->wall[phase] += seconds_since(&stats->mark_wall, &wall);
+	stats->cpu[phase] += seconds_since(&stats->mark_cpu, &cpu);
+}
+
+// Record the size of the symbol table and how far its labels are from their home slots
+void stats_symbols(asm_stats_t *stats, const symtab_t *symtab) {
+
+	stats->symbols += symtab->used;
+	stats->slots += symtab->slot_mask + 1;
+
+	for (uint32_t pos = 0; pos <= symtab->slot_mask; pos++) {
+
+		const symtab_slot_t *slot = &symtab->slots[pos];
+		if (slot->index == SYMTAB_EMPTY)
+			continue;
+
+		uint32_t length = symtab_distance(symtab, slot->hash, pos) + 1;
+		stats->probes[(length < STATS_PROBE_BUCKETS) ? length - 1 : STATS_PROBE_BUCKETS - 1]++;
+	}
+}
+
+// Sum the stats of one assembly into a total
+void stats_add(asm_stats_t *total, const asm_stats_t *stats) {
+
+	for (int phase = 0; phase < STATS_PHASES; phase++) {
+		total->wall[phase] += stats->wall[phase];
+		total->cpu[phase] += stats->cpu[phase];
+	}
+
+	total->files += stats->files;
+	total->lines += stats->lines;
+	total->tokens += stats->tokens;
+	total->instructions += stats->instructions;
+	total->bytes_in += stats->bytes_in;
+	total->bytes_out += stats->bytes_out;
+	total->symbols += stats->symbols;
+	total->slots += stats->slots;
+
+	for (int i = 0; i < STATS_PROBE_BUCKETS; i++)
+		total->probes[i] += stats->probes[i];
+
+	total->cache_hits += stats->cache_hits;
+	total->cache_misses += stats->cache_misses;
+	total->cache_evictions += stats->cache_evictions;
+}
+
+static double total_time(const double *times) {
+
+	double total = 0;
+	for (int phase = 0; phase < STATS_PHASES; phase++)
+		total += times[phase];
+	return total;
+}
+
+static double load_factor(const asm_stats_t *stats) {
+
+	return (stats->slots > 0) ? (double)stats->symbols / stats->slots : 0;
+}
+
+void stats_print(const asm_stats_t *stats, FILE *Out) {
+
+	fprintf(Out, "phase        wall ms      cpu ms\n");
+	for (int phase = 0; phase < STATS_PHASES; phase++)
+		fprintf(Out, "%-8s %11.3f %11.3f\n", phase_names[phase], stats->wall[phase] * 1e3, stats->cpu[phase] * 1e3);
+	fprintf(Out, "%-8s %11.3f %11.3f\n", "total", total_time(stats->wall) * 1e3, total_time(stats->cpu) * 1e3);
+
+	fprintf(Out, "files %llu, lines %llu, tokens %llu, instructions %llu\n",
+			(unsigned long long)stats->files, (unsigned long long)stats->lines,
+			(unsigned long long)stats->tokens, (unsigned long long)stats->instructions);
+	fprintf(Out, "bytes in %llu, bytes out %llu\n",
+			(unsigned long long)stats->bytes_in, (unsigned long long)stats->bytes_out);
+	fprintf(Out, "symbols %llu in %llu slots, load factor %.3f\n",
+			(unsigned long long)stats->symbols, (unsigned long long)stats->slots, load_factor(stats));
+
+	fprintf(Out, "probe length:");
+	for (int i = 0; i < STATS_PROBE_BUCKETS; i++)
+		if (stats->probes[i] != 0)
+			fprintf(Out, " %d%s:%llu", i + 1, (i == STATS_PROBE_BUCKETS - 1) ? "+" : "",
+					(unsigned long long)stats->probes[i]);
+	fprintf(Out, "\n");
+
+	if (stats->cache_hits + stats->cache_misses > 0)
+		fprintf(Out, "output cache: %llu hits, %llu misses, %llu evicted\n",
+				(unsigned long long)stats->cache_hits, (unsigned long long)stats->cache_misses,
+				(unsigned long long)stats->cache_evictions);
+}
+
+void stats_print_json(const asm_stats_t *stats, FILE *Out) {
+
+	fprintf(Out, "{\"phases\": {");
+	for (int phase = 0; phase < STATS_PHASES; phase++)
+		fprintf(Out, "%s\"%s\": {\"wall_ms\": %.3f, \"cpu_ms\": %.3f}", (phase > 0) ? ", " : "",
+				phase_names[phase], stats->wall[phase] * 1e3, stats->cpu[phase] * 1e3);
+	fprintf(Out, ", \"total\": {\"wall_ms\": %.3f, \"cpu_ms\": %.3f}}",
+			total_time(stats->wall) * 1e3, total_time(stats->cpu) * 1e3);
+
+	fprintf(Out, ", \"files\": %llu, \"lines\": %llu, \"tokens\": %llu, \"instructions\": %llu",
+			(unsigned long long)stats->files, (unsigned long long)stats->lines,
+			(unsigned long long)stats->tokens, (unsigned long long)stats->instructions);
+	fprintf(Out, ", \"bytes_in\": %llu, \"bytes_out\": %llu",
+			(unsigned long long)stats->bytes_in, (unsigned long long)stats->bytes_out);
+	fprintf(Out, ", \"symtab\": {\"symbols\": %llu, \"slots\": %llu, \"load_factor\": %.3f, \"probe_lengths\": [",
+			(unsigned long long)stats->symbols, (unsigned long long)stats->slots, load_factor(stats));
+	for (int i = 0; i < STATS_PROBE_BUCKETS; i++)
+		fprintf(Out, "%s%llu", (i > 0) ? ", " : "", (unsigned long long)stats->probes[i]);
+	fprintf(Out, "]}, \"output_cache\": {\"hits\": %llu, \"misses\": %llu, \"evictions\": %llu}}\n",
+			(unsigned long long)stats->cache_hits, (unsigned long long)stats->cache_misses,
+			(unsigned long long)stats->cache_evictions);
+}
@@ -0,0 +1,57 @@
+/*
+ * stats.h
+ *
+ * Counters and phase timings of an assembly. They are always collected:
+ * a phase costs two clock reads at each end and the counters are summed
+ * per line, so leaving them on costs nothing measurable. --stats prints
+ * them, as text or as JSON.
+ */
+
+#ifndef STATS_H_
+#define STATS_H_
+
+#include <stdio.h>
+#include <stdint.h>
+#include <time.h>
+#include "symtab.h"
+
+typedef enum {
+	STATS_READ,
+	STATS_PASS1,
+	STATS_PASS2,
+	STATS_WRITE,
+	STATS_PHASES
+} asm_phase_t;
+
+// Probe lengths 1 to STATS_PROBE_BUCKETS - 1 each get a bucket; the last holds longer ones
+#define STATS_PROBE_BUCKETS 16
+
+typedef struct {
+	double wall[STATS_PHASES];	// Seconds spent in each phase
+	double cpu[STATS_PHASES];	// CPU seconds of every thread working on it
+	uint64_t files;
+	uint64_t lines;
+	uint64_t tokens;
+	uint64_t instructions;
+	uint64_t bytes_in;
+	uint64_t bytes_out;
+	uint64_t symbols;			// Labels in the symbol table
+	uint64_t slots;				// Slots of its index
+	uint64_t probes[STATS_PROBE_BUCKETS];	// Labels found at each probe length
+	uint64_t cache_hits;		// Files whose output came from --cache-dir
+	uint64_t cache_misses;		// Files assembled and then stored there
+	uint64_t cache_evictions;	// Entries removed to stay under the size cap
+	struct timespec mark_wall;	// Start of the phase being timed
+	struct timespec mark_cpu;
+	clockid_t cpu_clock;
+} asm_stats_t;
+
+void stats_clear(asm_stats_t *stats, int threaded);
+void stats_begin(asm_stats_t *stats);
+void stats_end(asm_stats_t *stats, asm_phase_t phase);
+void stats_symbols(asm_stats_t *stats, const symtab_t *symtab);
+void stats_add(asm_stats_t *total, const asm_stats_t *stats);
+void stats_print(const asm_stats_t *stats, FILE *Out);
+void stats_print_json(const asm_stats_t *stats, FILE *Out);
+
+#endif /* STATS_H_ */
@@ -0,0 +1,449 @@
+#ifndef __SYMTAB_H
+#define __SYMTAB_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "hash_function.h"
+#include "arena.h"
+
+#ifndef TRUE
+#define TRUE 1
+#define FALSE 0
+#endif
+
+/*
+   symbol table for labels.
+
+   symbols live in a dense array of entries, in insertion order, so that an
+   entry's index is a stable symbol id. lookups go through a separate open
+   addressing index using robin hood probing. each index slot caches the
+   full hash of its key next to the entry index, so probing compares hashes
+   and only touches an entry on a likely match. keys up to
+   SYMTAB_INLINE_KEY bytes are stored inside the entry and the 32-bit
+   address is stored inline too, so a typical label costs no allocation of
+   its own. the index doubles automatically before it gets too full.
+
+   a symbol can be interned before it is defined, which gives forward
+   references an id to refer to. only defined symbols are found by
+   symtab_find.
+
+   a table created with symtab_create_arena takes all of its memory from
+   an arena instead of malloc. it is then released with the arena, and
+   symtab_destroy does not need to be called.
+*/
+
+#define SYMTAB_INLINE_KEY 20
+#define SYMTAB_EMPTY 0xffffffffu
+
+/* flags for symtab_entry_t */
+#define SYMTAB_DELETED 1
+#define SYMTAB_DEFINED 2
+
+typedef struct
+{
+  uint32_t hash;
+  uint32_t key_len;
+  uint32_t value;
+  uint32_t flags;
+  union
+  {
+    char bytes[SYMTAB_INLINE_KEY];
+    char *ptr;
+  } key;
+} symtab_entry_t;
+
+typedef struct
+{
+  uint32_t hash;
+  uint32_t index; /* index into entries, or SYMTAB_EMPTY */
+} symtab_slot_t;
+
+typedef struct
+{
+  symtab_slot_t *slots;
+  uint32_t slot_mask;
+  uint32_t used; /* occupied slots */
+  symtab_entry_t *entries;
+  uint32_t count; /* entries handed out, including deleted ones */
+  uint32_t capacity;
+  arena_t *arena; /* NULL if memory comes from malloc */
+} symtab_t;
+
+static inline void *symtab_alloc(symtab_t *symtab, size_t size)
+{
+  return (symtab->arena != NULL) ? arena_alloc(symtab->arena, size) : malloc(size);
+}
+
+/* arena memory is only released with the arena */
+static inline void symtab_free(symtab_t *symtab, void *ptr)
+{
+  if (symtab->arena == NULL) free(ptr);
+}
+
+static inline uint32_t symtab_hash(const void *key, uint32_t key_len)
+{
+  return HASH_DEFAULT(key, key_len, 7);
+}
+
+static inline const char *symtab_key(const symtab_entry_t *entry)
+{
+  return (entry->key_len <= SYMTAB_INLINE_KEY) ? entry->key.bytes : entry->key.ptr;
+}
+
+static inline int symtab_entry_matches(const symtab_entry_t *entry, const void *key, uint32_t key_len)
+{
+  return (entry->key_len == key_len) && (memcmp(symtab_key(entry), key, key_len) == 0);
+}
+
+/* distance of the slot at pos from the home slot of hash */
+static inline uint32_t symtab_distance(const symtab_t *symtab, uint32_t hash, uint32_t pos)
+{
+  return (pos - (hash & symtab->slot_mask)) & symtab->slot_mask;
+}
+
+/* places (hash, index) in slots using robin hood displacement. the key must
+   not already be present. */
+static inline void symtab_place(symtab_t *symtab, uint32_t hash, uint32_t index)
+{
+  uint32_t pos = hash & symtab->slot_mask;
+  uint32_t dist = 0;
+
+  while (1)
+    {
+      symtab_slot_t *slot = &symtab->slots[pos];
+      if (slot->index == SYMTAB_EMPTY)
+	{
+	  slot->hash = hash;
+	  slot->index = index;
+	  return;
+	}
+
+      /* the resident is closer to home than we are: take its place */
+      uint32_t resident = symtab_distance(symtab, slot->hash, pos);
+      if (resident < dist)
+	{
+	  uint32_t tmp_hash = slot->hash, tmp_index = slot->index;
+	  slot->hash = hash;
+	  slot->index = index;
+	  hash = tmp_hash;
+	  index = tmp_index;
+	  dist = resident;
+	}
+
+      pos = (pos + 1) & symtab->slot_mask;
+      dist++;
+    }
+}
+
+static inline int symtab_alloc_slots(symtab_t *symtab, uint32_t slot_count)
+{
+  uint32_t t;
+
+  symtab->slots = (symtab_slot_t *) symtab_alloc(symtab, sizeof(symtab_slot_t) * slot_count);
+  if (symtab->slots == NULL) return(FALSE);
+
+  for (t = 0; t < slot_count; t++)
+    symtab->slots[t].index = SYMTAB_EMPTY;
+  symtab->slot_mask = slot_count - 1;
+  return(TRUE);
+}
+
+/* doubles the index, reusing the cached hashes */
+static inline int symtab_grow_slots(symtab_t *symtab)
+{
+  symtab_slot_t *old_slots = symtab->slots;
+  uint32_t t, old_count = symtab->slot_mask + 1;
+
+  if (!symtab_alloc_slots(symtab, old_count * 2))
+    {
+      symtab->slots = old_slots;
+      return(FALSE);
+    }
+
+  for (t = 0; t < old_count; t++)
+    if (old_slots[t].index != SYMTAB_EMPTY)
+      symtab_place(symtab, old_slots[t].hash, old_slots[t].index);
+
+  symtab_free(symtab, old_slots);
+  return(TRUE);
+}
+
+static inline symtab_t *symtab_create_common(arena_t *arena, uint32_t initial_size)
+{
+  symtab_t *symtab;
+  uint32_t slot_count = 16;
+
+  /* keep the index at most 7/8 full */
+  while (slot_count - (slot_count >> 3) < initial_size) slot_count <<= 1;
+
+  symtab = (symtab_t *) ((arena != NULL) ? arena_alloc(arena, sizeof(symtab_t)) : malloc(sizeof(symtab_t)));
+  if (symtab == NULL) return(NULL);
+  symtab->arena = arena;
+
+  if (!symtab_alloc_slots(symtab, slot_count))
+    {
+      symtab_free(symtab, symtab);
+      return(NULL);
+    }
+
+  symtab->capacity = (initial_size > 0) ? initial_size : 1;
+  symtab->entries = (symtab_entry_t *) symtab_alloc(symtab, sizeof(symtab_entry_t) * symtab->capacity);
+  if (symtab->entries == NULL)
+    {
+      symtab_free(symtab, symtab->slots);
+      symtab_free(symtab, symtab);
+      return(NULL);
+    }
+
+  symtab->used = 0;
+  symtab->count = 0;
+  return(symtab);
+}
+
+/*
+   creates a symbol table and returns a pointer to it
+
+   parameters:
+   initial_size : number of symbols to make room for before the first resize
+
+   returns: pointer to created symbol table or NULL on failure
+*/
+static inline symtab_t *symtab_create(uint32_t initial_size)
+{
+  return symtab_create_common(NULL, initial_size);
+}
+
+/*
+   creates a symbol table whose memory, including the table itself, comes
+   from arena
+
+   returns: pointer to created symbol table or NULL on failure
+*/
+static inline symtab_t *symtab_create_arena(arena_t *arena, uint32_t initial_size)
+{
+  return symtab_create_common(arena, initial_size);
+}
+
+/*
+   finds the slot holding key
+
+   returns: position of the slot, or SYMTAB_EMPTY if the key is not present
+*/
+static inline uint32_t symtab_find_slot(const symtab_t *symtab, const void *key, uint32_t key_len, uint32_t hash)
+{
+  uint32_t pos = hash & symtab->slot_mask;
+  uint32_t dist = 0;
+
+  while (1)
+    {
+      const symtab_slot_t *slot = &symtab->slots[pos];
+
+      /* robin hood invariant: once residents are closer to home than we
+	 would be, the key cannot be further along */
+      if ((slot->index == SYMTAB_EMPTY) || (symtab_distance(symtab, slot->hash, pos) < dist))
+	return(SYMTAB_EMPTY);
+
+      if ((slot->hash == hash) && symtab_entry_matches(&symtab->entries[slot->index], key, key_len))
+	return(pos);
+
+      pos = (pos + 1) & symtab->slot_mask;
+      dist++;
+    }
+}
+
+/*
+   adds an entry to the end of the dense array without looking for key
+   first, reusing a hash the caller already has. a SYMTAB_DELETED entry
+   only takes up its id and is not placed in the index. this copies entries
+   in id order from another table.
+
+   returns: the id, or SYMTAB_EMPTY if the entry could not be added
+*/
+static inline uint32_t symtab_append(symtab_t *symtab, const void *key, uint32_t key_len, uint32_t hash,
+				     uint32_t value, uint32_t flags)
+{
+  symtab_entry_t *entry;
+
+  if (flags & SYMTAB_DELETED) key_len = 0;
+
+  if ((symtab->used + 1) > ((symtab->slot_mask + 1) - ((symtab->slot_mask + 1) >> 3)))
+    if (!symtab_grow_slots(symtab)) return(SYMTAB_EMPTY);
+
+  if (symtab->count == symtab->capacity)
+    {
+      symtab_entry_t *entries = (symtab_entry_t *) symtab_alloc(symtab,
+								sizeof(symtab_entry_t) * symtab->capacity * 2);
+      if (entries == NULL) return(SYMTAB_EMPTY);
+      memcpy(entries, symtab->entries, sizeof(symtab_entry_t) * symtab->count);
+      symtab_free(symtab, symtab->entries);
+      symtab->entries = entries;
+      symtab->capacity *= 2;
+    }
+
+  entry = &symtab->entries[symtab->count];
+  if (key_len > SYMTAB_INLINE_KEY)
+    {
+      entry->key.ptr = (char *) symtab_alloc(symtab, key_len);
+      if (entry->key.ptr == NULL) return(SYMTAB_EMPTY);
+    }
+  memcpy((key_len > SYMTAB_INLINE_KEY) ? entry->key.ptr : entry->key.bytes, key, key_len);
+  entry->hash = hash;
+  entry->key_len = key_len;
+  entry->value = value;
+  entry->flags = flags;
+
+  if (!(flags & SYMTAB_DELETED))
+    {
+      symtab_place(symtab, hash, symtab->count);
+      symtab->used++;
+    }
+  return(symtab->count++);
+}
+
+/*
+   symtab_intern with a hash the caller already has, such as one computed
+   by symtab_hash when the key was first seen.
+
+   returns: the id, or SYMTAB_EMPTY if the entry could not be added
+*/
+static inline uint32_t symtab_intern_hash(symtab_t *symtab, const void *key, uint32_t key_len, uint32_t hash)
+{
+  uint32_t pos = symtab_find_slot(symtab, key, key_len, hash);
+
+  if (pos != SYMTAB_EMPTY) return(symtab->slots[pos].index);
+  return(symtab_append(symtab, key, key_len, hash, 0, 0));
+}
+
+/*
+   returns the id of the symbol named key, adding an undefined entry for it
+   if it is not in the table yet.
+
+   returns: the id, or SYMTAB_EMPTY if the entry could not be added
+*/
+static inline uint32_t symtab_intern(symtab_t *symtab, const void *key, uint32_t key_len)
+{
+  return(symtab_intern_hash(symtab, key, key_len, symtab_hash(key, key_len)));
+}
+
+/*
+   gives the symbol id its value, unless it already has one. the value
+   stored first is the one that is kept.
+*/
+static inline void symtab_define(symtab_t *symtab, uint32_t id, uint32_t value)
+{
+  symtab_entry_t *entry = &symtab->entries[id];
+
+  if (entry->flags & SYMTAB_DEFINED) return;
+  entry->value = value;
+  entry->flags |= SYMTAB_DEFINED;
+}
+
+/*
+   inserts a symbol into the table.
+
+   parameters :
+   symtab : symbol table to use
+   key : name of the symbol
+   key_len: length of the name in bytes
+   value : address to store with the symbol
+
+   returns:
+   TRUE if key was inserted into the table, or was already present. as with
+        hash_find on a chained table, the value stored first is the one
+        that is found, so a repeated insert leaves the table unchanged.
+   FALSE if key could not be inserted into the table
+*/
+static inline int32_t symtab_insert(symtab_t *symtab, const void *key, uint32_t key_len, uint32_t value)
+{
+  uint32_t id = symtab_intern(symtab, key, key_len);
+
+  if (id == SYMTAB_EMPTY) return(FALSE);
+  symtab_define(symtab, id, value);
+  return(TRUE);
+}
+
+/*
+  finds the value stored for key
+
+  parameters:
+  symtab : pointer to the symbol table to use
+  key : name of the symbol
+  key_len: length of the name in bytes
+
+  returns:
+  pointer to the value in the table on success. it stays valid until the
+  next insert.
+  NULL on failure
+*/
+static inline uint32_t *symtab_find(symtab_t *symtab, const void *key, uint32_t key_len)
+{
+  uint32_t pos = symtab_find_slot(symtab, key, key_len, symtab_hash(key, key_len));
+  symtab_entry_t *entry;
+
+  if (pos == SYMTAB_EMPTY) return(NULL);
+  entry = &symtab->entries[symtab->slots[pos].index];
+  if (!(entry->flags & SYMTAB_DEFINED)) return(NULL);
+  return(&entry->value);
+}
+
+/*
+   deletes a symbol. its entry stays in the dense array, marked deleted, so
+   that the ids of later symbols do not change.
+
+   returns:
+   TRUE: if key was successfully deleted
+   FALSE: if key could not be deleted (key was not found)
+*/
+static inline int32_t symtab_delete(symtab_t *symtab, const void *key, uint32_t key_len)
+{
+  uint32_t pos = symtab_find_slot(symtab, key, key_len, symtab_hash(key, key_len));
+  uint32_t next;
+  symtab_entry_t *entry;
+
+  if (pos == SYMTAB_EMPTY) return(FALSE);
+
+  entry = &symtab->entries[symtab->slots[pos].index];
+  if (entry->key_len > SYMTAB_INLINE_KEY) symtab_free(symtab, entry->key.ptr);
+  entry->key_len = 0;
+  entry->flags |= SYMTAB_DELETED;
+
+  /* backward shift: pull following displaced slots one step closer home */
+  next = (pos + 1) & symtab->slot_mask;
+  while ((symtab->slots[next].index != SYMTAB_EMPTY)
+	 && (symtab_distance(symtab, symtab->slots[next].hash, next) > 0))
+    {
+      symtab->slots[pos] = symtab->slots[next];
+      pos = next;
+      next = (next + 1) & symtab->slot_mask;
+    }
+  symtab->slots[pos].index = SYMTAB_EMPTY;
+  symtab->used--;
+  return(TRUE);
+}
+
+/*
+  destroys the symbol table and frees all allocated memory
+
+  parameters:
+  symtab : pointer to the symbol table to use
+
+  returns : nothing
+*/
+static inline void symtab_destroy(symtab_t *symtab)
+{
+  uint32_t t;
+
+  if (symtab->arena != NULL) return;
+
+  for (t = 0; t < symtab->count; t++)
+    if (symtab->entries[t].key_len > SYMTAB_INLINE_KEY)
+      free(symtab->entries[t].key.ptr);
+
+  free(symtab->entries);
+  free(symtab->slots);
+  free(symtab);
+}
+
+#endif
@@ -0,0 +1,124 @@
+/*
+ * thread_pool.c
+ *
+ * Worker threads sharing one mutex-protected task queue.
+ */
+#include <stdlib.h>
+#include <pthread.h>
+#include "thread_pool.h"
+
+static void *thread_pool_worker(void *arg) {
+
+	thread_pool_t *pool = arg;
+
+	pthread_mutex_lock(&pool->lock);
+	while (1) {
+
+		while (pool->queued == 0 && !pool->stopping)
+			pthread_cond_wait(&pool->work, &pool->lock);
+
+		if (pool->queued == 0)
+			break;
+
+		thread_task_t task = pool->tasks[pool->head];
+		pool->head = (pool->head + 1) % pool->capacity;
+		pool->queued--;
+
+		pthread_mutex_unlock(&pool->lock);
+		task.fn(task.arg);
+		pthread_mutex_lock(&pool->lock);
+
+		if (--pool->pending == 0)
+			pthread_cond_broadcast(&pool->idle);
+	}
+	pthread_mutex_unlock(&pool->lock);
+
+	return NULL;
+}
+
+// Start thread_count workers, returning NULL on failure
+thread_pool_t *thread_pool_create(int thread_count) {
+
+	thread_pool_t *pool = calloc(1, sizeof(thread_pool_t));
+	if (pool == NULL)
+		return NULL;
+
+	pool->threads = malloc(thread_count * sizeof(pthread_t));
+	if (pool->threads == NULL) {
+		free(pool);
+		return NULL;
+	}
+
+	pthread_mutex_init(&pool->lock, NULL);
+	pthread_cond_init(&pool->work, NULL);
+	pthread_cond_init(&pool->idle, NULL);
+
+	for (int i = 0; i < thread_count; i++) {
+		if (pthread_create(&pool->threads[i], NULL, thread_pool_worker, pool) != 0) {
+			thread_pool_destroy(pool);
+			return NULL;
+		}
+		pool->thread_count++;
+	}
+
+	return pool;
+}
+
+// Queue fn(arg) to run on a worker, returning -1 if the queue could not grow
+int thread_pool_submit(thread_pool_t *pool, thread_task_fn fn, void *arg) {
+
+	pthread_mutex_lock(&pool->lock);
+
+	if (pool->queued == pool->capacity) {
+		size_t capacity = pool->capacity ? pool->capacity * 2 : 64;
+		thread_task_t *tasks = malloc(capacity * sizeof(thread_task_t));
+		if (tasks == NULL) {
+			pthread_mutex_unlock(&pool->lock);
+			return -1;
+		}
+
+		// Unwrap the circular queue into the new array
+		for (size_t i = 0; i < pool->queued; i++)
+			tasks[i] = pool->tasks[(pool->head + i) % pool->capacity];
+		free(pool->tasks);
+		pool->tasks = tasks;
+		pool->head = 0;
+		pool->capacity = capacity;
+	}
+
+	pool->tasks[(pool->head + pool->queued) % pool->capacity] = (thread_task_t){ fn, arg };
+	pool->queued++;
+	pool->pending++;
+
+	pthread_cond_signal(&pool->work);
+	pthread_mutex_unlock(&pool->lock);
+	return 0;
+}
+
+// Block until every submitted task has finished
+void thread_pool_wait(thread_pool_t *pool) {
+
+	pthread_mutex_lock(&pool->lock);
+	while (pool->pending != 0)
+		pthread_cond_wait(&pool->idle, &pool->lock);
+	pthread_mutex_unlock(&pool->lock);
+}
+
+// Finish the queued tasks, then stop and free the workers
+void thread_pool_destroy(thread_pool_t *pool) {
+
+	pthread_mutex_lock(&pool->lock);
+	pool->stopping = 1;
+	pthread_cond_broadcast(&pool->work);
+	pthread_mutex_unlock(&pool->lock);
+
+	for (int i = 0; i < pool->thread_count; i++)
+		pthread_join(pool->threads[i], NULL);
+
+	pthread_mutex_destroy(&pool->lock);
+	pthread_cond_destroy(&pool->work);
+	pthread_cond_destroy(&pool->idle);
+	free(pool->tasks);
+	free(pool->threads);
+	free(pool);
+}
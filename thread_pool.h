@@ -0,0 +1,43 @@
+/*
+ * thread_pool.h
+ *
+ * A fixed set of worker threads that run submitted tasks. Tasks are taken in
+ * submission order; thread_pool_wait() blocks until every task submitted so
+ * far has finished, which gives callers a barrier between phases.
+ */
+
+#ifndef THREAD_POOL_H_
+#define THREAD_POOL_H_
+
+#include <stddef.h>
+#include <pthread.h>
+
+typedef void (*thread_task_fn)(void *arg);
+
+typedef struct {
+	thread_task_fn fn;
+	void *arg;
+} thread_task_t;
+
+typedef struct {
+	pthread_t *threads;
+	int thread_count;
+
+	pthread_mutex_t lock;
+	pthread_cond_t work;		// Signalled when a task is queued or the pool stops
+	pthread_cond_t idle;		// Signalled when the last pending task finishes
+
+	thread_task_t *tasks;		// Circular queue of tasks not yet started
+	size_t head;
+	size_t queued;
+	size_t capacity;
+	size_t pending;				// Queued plus running tasks
+	int stopping;
+} thread_pool_t;
+
+thread_pool_t *thread_pool_create(int thread_count);
+int thread_pool_submit(thread_pool_t *pool, thread_task_fn fn, void *arg);
+void thread_pool_wait(thread_pool_t *pool);
+void thread_pool_destroy(thread_pool_t *pool);
+
+#endif /* THREAD_POOL_H_ */
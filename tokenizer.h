@@ -6,7 +6,8 @@
   copyright (C) 2005 
 
   this file contains a thread-safe string tokenization function that can be
-  used for general purpose parsing. 
+  used for general purpose parsing. tokens are returned as views into the
+  input, so tokenizing never allocates.
 */
 
 #include <stdlib.h>
@@ -15,46 +16,116 @@
 #include <errno.h>
 
 
-/* parses the token in_str delimited by the characters in delim. it returns
-   an output string out_str, which contains the remaining elements of
-   the string after the first token. this can be used to parse all tokens in
-   a line by recursively calling the parse function.
-   
-   it also returns the actual delimiting character in delim_char, which can 
-   be used to define numerical ranges. if this is not desired, delim_char may be 
-   set to NULL.
+/* a token is a view into the caller's buffer: it is never allocated and
+   never has to be freed. it is valid for as long as that buffer is. */
+typedef struct
+{
+  const char *ptr;
+  uint32_t len;
+} token_view_t;
+
+/* returns non-zero if c is one of the characters in delim */
+static inline int is_delim(const char *delim, char c)
+{
+  return (c != (char) 0) && (strchr(delim, c) != NULL);
+}
+
+/* parses the next token in [*cursor, end) delimited by the characters in
+   delim, storing a view of it in token. on return *cursor points just past
+   the delimiter that ended the token, which mirrors how the remainder of
+   the line was returned by the original malloc-based parse_token. the end
+   of the buffer acts as a delimiter, so a last line without a trailing
+   newline still yields its final token.
+
+   it also returns the actual delimiting character in delim_char, or 0 if
+   the token ran up to end. if this is not desired, delim_char may be set
+   to NULL.
 
-   it returns the first token delimited by characters in delim or NULL, 
-   if no such token is found.
+   returns 1 if a token was found, 0 if only delimiters remained.
 
-   this is a thread safe implementation 
+   this is a thread safe implementation
 */
-static inline char *parse_token(char *in_str, char *delim, char **out_str, char *delim_char)
+static inline int parse_token(const char **cursor, const char *end, const char *delim,
+                              token_view_t *token, char *delim_char)
 {
-  int len;
-  char *ptr, *tptr, *token;
+  const char *ptr, *tptr;
 
   /* Bypass leading whitespace delimiters */
-  len = strspn(in_str, delim);
-  ptr = (in_str + len);
-  
+  ptr = *cursor;
+  while ((ptr < end) && is_delim(delim, *ptr)) ptr++;
+  if (ptr == end)
+    {
+      *cursor = end;
+      return(0);
+    }
+
   /* Get end of token */
-  tptr = strpbrk(ptr, delim);
-  if (tptr == NULL) return(NULL);
-  len = tptr - ptr;
-
-  if (delim_char != NULL) *delim_char = *tptr;
-  
-  /* Create output string */
-  *out_str = tptr + 1; /* go past the delimiter */
-  
-  /* Create token */
-  token = (char *) malloc(len + 1);
-  if (token == NULL) return(NULL);
-  memcpy(token, ptr, len);
-  token[len] = (char) 0;
-  return(token);
+  tptr = ptr;
+  while ((tptr < end) && !is_delim(delim, *tptr)) tptr++;
+
+  token->ptr = ptr;
+  token->len = (uint32_t) (tptr - ptr);
+
+  if (tptr < end)
+    {
+      if (delim_char != NULL) *delim_char = *tptr;
+      *cursor = tptr + 1; /* go past the delimiter */
+    }
+  else
+    {
+      if (delim_char != NULL) *delim_char = (char) 0;
+      *cursor = end;
+    }
+  return(1);
 }
 
+/* parses up to max_tokens tokens from [*cursor, end) into the caller
+   provided array tokens. parsing stops early at the end of the buffer or
+   at a token beginning with '#', which starts a comment.
+
+   returns the number of tokens stored. *cursor is left just past the last
+   token consumed.
+*/
+static inline int parse_tokens(const char **cursor, const char *end, const char *delim,
+                               token_view_t *tokens, int max_tokens)
+{
+  int count = 0;
+  const char *ptr = *cursor;
+  token_view_t token;
+
+  while ((count < max_tokens) && parse_token(&ptr, end, delim, &token, NULL))
+    {
+      if (*token.ptr == '#') break;
+      tokens[count++] = token;
+      *cursor = ptr;
+    }
+  return(count);
+}
+
+/* returns non-zero if token is exactly the NUL-terminated string str */
+static inline int token_equals(token_view_t token, const char *str)
+{
+  return (strncmp(token.ptr, str, token.len) == 0) && (str[token.len] == (char) 0);
+}
+
+/* converts the leading integer in [ptr, end) the way atoi() would, without
+   reading past end. leading whitespace and a sign are accepted. */
+static inline int parse_int(const char *ptr, const char *end)
+{
+  int value = 0, negative = 0;
+
+  while ((ptr < end) && ((*ptr == ' ') || (*ptr == '\t') || (*ptr == '\n') || (*ptr == '\r'))) ptr++;
+  if ((ptr < end) && ((*ptr == '-') || (*ptr == '+')))
+    {
+      negative = (*ptr == '-');
+      ptr++;
+    }
+  while ((ptr < end) && (*ptr >= '0') && (*ptr <= '9'))
+    {
+      value = (value * 10) + (*ptr - '0');
+      ptr++;
+    }
+  return(negative ? -value : value);
+}
 
 #endif 
@@ -0,0 +1,200 @@
+/*
+ * gen_mnemonic_hash.c
+ *
+ * Generates the perfect hash that lookup_instruction() classifies mnemonics
+ * with: mnemonic_hash.h holds the multiplier and table size, and
+ * mnemonic_hash.c the slot of every entry of instruction_set[]. The
+ * current multiplier is kept while it still gives every mnemonic a slot of
+ * its own, so regenerating an unchanged set changes nothing. Otherwise
+ * multipliers are searched in a fixed order, growing the table when none
+ * fits. Run it from the top of the tree whenever a mnemonic is added,
+ * removed or renamed; --check only reports whether the files are current.
+ *
+ *     gcc -std=gnu99 -O2 -I. -o gen_mnemonic_hash tools/gen_mnemonic_hash.c instruction_set.c
+ *     ./gen_mnemonic_hash
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include "instruction_set.h"
+
+// Multipliers tried at each table size before growing it
+#define SEARCH_TRIES 10000000
+
+// Largest table searched; the build-time check keeps a bit per slot in a uint64_t
+#define MAX_HASH_BITS 6
+
+#define HEADER_PATH "mnemonic_hash.h"
+#define TABLE_PATH "mnemonic_hash.c"
+
+static uint32_t mnemonic_key(const inst_desc_t *inst) {
+
+	return MNEMONIC_KEY(inst->name[0], (inst->len > 1) ? inst->name[1] : 0, inst->name[inst->len - 1], inst->len);
+}
+
+// Whether every mnemonic lands in its own slot under mult; fills slots[] if so
+static int is_perfect(uint32_t mult, int bits, uint8_t *slots) {
+
+	memset(slots, 0, 1u << bits);
+	for (int op = 0; op < OP_COUNT; op++) {
+		uint32_t slot = (mnemonic_key(&instruction_set[op]) * mult) >> (32 - bits);
+		if (slots[slot] != 0)
+			return 0;
+		slots[slot] = op + 1;
+	}
+	return 1;
+}
+
+// splitmix32, so the search visits the same multipliers on every machine
+static uint32_t next_multiplier(uint32_t *state) {
+
+	uint32_t z = (*state += 0x9e3779b9u);
+	z = (z ^ (z >> 16)) * 0x85ebca6bu;
+	z = (z ^ (z >> 13)) * 0xc2b2ae35u;
+	return (z ^ (z >> 16)) | 1;
+}
+
+static const char *char_literal(char c, char *buffer) {
+
+	if (c == '\0')
+		strcpy(buffer, "'\\0'");
+	else
+		sprintf(buffer, "'%c'", c);
+	return buffer;
+}
+
+static char *enum_name(const inst_desc_t *inst, char *buffer) {
+
+	strcpy(buffer, "OP_");
+	for (int i = 0; i < inst->len; i++)
+		buffer[3 + i] = toupper((unsigned char)inst->name[i]);
+	buffer[3 + inst->len] = '\0';
+	return buffer;
+}
+
+// The key of an entry as a constant expression, so the compiler checks it against the multiplier
+static void write_key(FILE *Out, const inst_desc_t *inst) {
+
+	char c0[8], c1[8], last[8];
+	fprintf(Out, "MNEMONIC_KEY(%s, %s, %s, %d)", char_literal(inst->name[0], c0),
+			char_literal((inst->len > 1) ? inst->name[1] : '\0', c1), char_literal(inst->name[inst->len - 1], last),
+			inst->len);
+}
+
+static void write_header(FILE *Out, uint32_t mult, int bits) {
+
+	fprintf(Out, "/*\n * mnemonic_hash.h\n *\n"
+			" * Generated by tools/gen_mnemonic_hash.c from instruction_set[]; do not edit.\n"
+			" * Run it again whenever a mnemonic is added, removed or renamed.\n */\n\n"
+			"#ifndef MNEMONIC_HASH_H_\n#define MNEMONIC_HASH_H_\n\n"
+			"#define MNEMONIC_HASH_MULT 0x%08xu\n#define MNEMONIC_HASH_BITS %d\n\n"
+			"#endif /* MNEMONIC_HASH_H_ */\n", mult, bits);
+}
+
+static void write_table(FILE *Out, const uint8_t *slots, int bits) {
+
+	char name[16];
+
+	fprintf(Out, "/*\n * mnemonic_hash.c\n *\n"
+			" * Generated by tools/gen_mnemonic_hash.c from instruction_set[]; do not edit.\n"
+			" * The asserts fail the build when the mnemonics change in number or collide;\n"
+			" * a renamed mnemonic is only found by --check.\n */\n"
+			"#include \"instruction_set.h\"\n\n");
+	fprintf(Out, "_Static_assert(OP_COUNT == %d, \"instruction_set[] changed; run tools/gen_mnemonic_hash\");\n\n",
+			OP_COUNT);
+
+	// Summing distinct powers of two gives the same as or-ing them, so the sums differ on a collision
+	fprintf(Out, "#define MNEMONIC_BIT(key) ((uint64_t)1 << MNEMONIC_SLOT(key))\n\n");
+	for (int pass = 0; pass < 2; pass++) {
+		fprintf(Out, "%s", (pass == 0) ? "_Static_assert((" : "\t\t== (");
+		for (int op = 0; op < OP_COUNT; op++) {
+			fprintf(Out, "%sMNEMONIC_BIT(", (op == 0) ? "" : (pass == 0) ? "\n\t\t| " : "\n\t\t+ ");
+			write_key(Out, &instruction_set[op]);
+			fprintf(Out, ")");
+		}
+		fprintf(Out, "%s", (pass == 0) ? ")\n" : "),\n\t\t\"two mnemonics share a slot; run tools/gen_mnemonic_hash\");\n\n");
+	}
+
+	fprintf(Out, "// Index into instruction_set[] plus one for each slot; 0 marks an empty slot\n"
+			"const uint8_t mnemonic_slots[1 << MNEMONIC_HASH_BITS] = {\n");
+	for (uint32_t slot = 0; slot < (1u << bits); slot++) {
+		if (slots[slot] == 0)
+			continue;
+		const inst_desc_t *inst = &instruction_set[slots[slot] - 1];
+		fprintf(Out, "\t\t[MNEMONIC_SLOT(");
+		write_key(Out, inst);
+		fprintf(Out, ")] = %s + 1,\n", enum_name(inst, name));
+	}
+	fprintf(Out, "\t};\n");
+}
+
+// Write path, or with check compare it; returns 0 if the file is as generated
+static int emit(const char *path, const char *text, size_t len, int check) {
+
+	if (check) {
+		FILE *In = fopen(path, "r");
+		char *current = malloc(len + 1);
+		size_t read = (In != NULL && current != NULL) ? fread(current, 1, len + 1, In) : 0;
+		int same = (read == len && memcmp(current, text, len) == 0);
+		if (In != NULL)
+			fclose(In);
+		free(current);
+		if (!same)
+			printf("%s is out of date\n", path);
+		return same ? 0 : 1;
+	}
+
+	FILE *Out = fopen(path, "w");
+	if (Out == NULL || fwrite(text, 1, len, Out) != len || fclose(Out) != 0) {
+		printf("%s could not be written\n", path);
+		return 1;
+	}
+	return 0;
+}
+
+int main(int argc, char *argv[]) {
+
+	int check = (argc > 1 && strcmp(argv[1], "--check") == 0);
+	uint8_t slots[1 << MAX_HASH_BITS];
+	uint32_t mult = MNEMONIC_HASH_MULT;
+	int bits = MNEMONIC_HASH_BITS;
+
+	if (!is_perfect(mult, bits, slots)) {
+		int found = 0;
+		for (bits = 1; (1 << bits) < OP_COUNT; bits++)
+			;
+		for (; !found && bits <= MAX_HASH_BITS; bits += !found) {
+			uint32_t state = 0;
+			for (int i = 0; !found && i < SEARCH_TRIES; i++) {
+				mult = next_multiplier(&state);
+				found = is_perfect(mult, bits, slots);
+			}
+		}
+		if (!found) {
+			printf("No perfect multiplier found for %d mnemonics\n", OP_COUNT);
+			return 1;
+		}
+	}
+
+	char *header, *table;
+	size_t header_len, table_len;
+	FILE *Header = open_memstream(&header, &header_len);
+	FILE *Table = open_memstream(&table, &table_len);
+	if (Header == NULL || Table == NULL) {
+		printf("Out of memory\n");
+		return 1;
+	}
+	write_header(Header, mult, bits);
+	write_table(Table, slots, bits);
+	fclose(Header);
+	fclose(Table);
+
+	int status = emit(HEADER_PATH, header, header_len, check) | emit(TABLE_PATH, table, table_len, check);
+	if (status == 0 && !check)
+		printf("multiplier 0x%08x, %d slots for %d mnemonics\n", mult, 1 << bits, OP_COUNT);
+
+	free(header);
+	free(table);
+	return status;
+}
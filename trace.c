@@ -0,0 +1,132 @@
+/*
+ * trace.c
+ *
+ * Trace output and the ring buffer of recent messages.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include "trace.h"
+
+static const char *level_names[] = { "off", "error", "info", "debug" };
+
+// Start with tracing off
+void trace_init(trace_t *trace) {
+
+	trace->print_level = TRACE_OFF;
+	trace->ring_level = TRACE_OFF;
+	trace->level = TRACE_OFF;
+	trace->ring = NULL;
+	trace->ring_size = 0;
+	trace->ring_pos = 0;
+}
+
+/*
+ * Print messages up to print_level and keep the last ring_size bytes of
+ * messages up to ring_level. Returns -1 if the ring could not be allocated.
+ */
+int trace_enable(trace_t *trace, int print_level, int ring_level, size_t ring_size) {
+
+	trace_free(trace);
+
+	if (ring_level > TRACE_OFF && ring_size > 0) {
+		trace->ring = malloc(ring_size);
+		if (trace->ring == NULL)
+			return -1;
+		trace->ring_size = ring_size;
+	}
+	else
+		ring_level = TRACE_OFF;
+
+	trace->print_level = print_level;
+	trace->ring_level = ring_level;
+	trace->level = (print_level > ring_level) ? print_level : ring_level;
+	return 0;
+}
+
+// Forget the messages of the previous assembly
+void trace_clear(trace_t *trace) {
+
+	trace->ring_pos = 0;
+}
+
+void trace_free(trace_t *trace) {
+
+	free(trace->ring);
+	trace_init(trace);
+}
+
+// Copy len bytes to the ring, overwriting the oldest
+static void ring_append(trace_t *trace, const char *bytes, size_t len) {
+
+	if (len > trace->ring_size) {
+		bytes += len - trace->ring_size;
+		trace->ring_pos += len - trace->ring_size;
+		len = trace->ring_size;
+	}
+
+	size_t pos = trace->ring_pos % trace->ring_size;
+	size_t first = (len < trace->ring_size - pos) ? len : trace->ring_size - pos;
+	memcpy(trace->ring + pos, bytes, first);
+	memcpy(trace->ring, bytes + first, len - first);
+	trace->ring_pos += len;
+}
+
+// Print and keep one message; use TRACE() so disabled levels cost nothing
+void trace_write(trace_t *trace, int level, const char *format, ...) {
+
+	char message[TRACE_MESSAGE_LENGTH + 1];
+	va_list args;
+
+	va_start(args, format);
+	int len = vsnprintf(message, TRACE_MESSAGE_LENGTH, format, args);
+	va_end(args);
+
+	if (len < 0)
+		return;
+	if (len >= TRACE_MESSAGE_LENGTH)
+		len = TRACE_MESSAGE_LENGTH - 1;
+	message[len++] = '\n';
+
+	if (level <= trace->print_level)
+		fwrite(message, 1, len, stdout);
+	if (level <= trace->ring_level)
+		ring_append(trace, message, len);
+}
+
+// Write the messages in the ring, oldest first, skipping a partly overwritten one
+void trace_dump(const trace_t *trace, FILE *Out) {
+
+	if (trace->ring == NULL || trace->ring_pos == 0)
+		return;
+
+	if (trace->ring_pos <= trace->ring_size) {
+		fwrite(trace->ring, 1, trace->ring_pos, Out);
+		return;
+	}
+
+	size_t start = trace->ring_pos % trace->ring_size;
+	const char *newline = memchr(trace->ring + start, '\n', trace->ring_size - start);
+
+	if (newline != NULL) {
+		fwrite(newline + 1, 1, trace->ring + trace->ring_size - (newline + 1), Out);
+		fwrite(trace->ring, 1, start, Out);
+	}
+	else {
+		newline = memchr(trace->ring, '\n', start);
+		if (newline != NULL)
+			fwrite(newline + 1, 1, trace->ring + start - (newline + 1), Out);
+	}
+}
+
+// Parse a level name or number, returning -1 if it is neither
+int trace_parse_level(const char *name, int *level) {
+
+	for (int i = TRACE_OFF; i <= TRACE_DEBUG; i++)
+		if (strcmp(name, level_names[i]) == 0 || (name[0] == '0' + i && name[1] == '\0')) {
+			*level = i;
+			return 0;
+		}
+
+	return -1;
+}
@@ -0,0 +1,61 @@
+/*
+ * trace.h
+ *
+ * Debug tracing with levels that can be compiled out. TRACE() messages
+ * above TRACE_LEVEL are removed by the compiler, so their arguments cost
+ * nothing; messages at or below it are checked against the level the trace
+ * was enabled for at run time. The per-token messages of pass 1 are at
+ * TRACE_DEBUG, above the default TRACE_LEVEL; build with
+ * -DTRACE_LEVEL=TRACE_DEBUG to keep them.
+ *
+ * Enabled messages are printed to stdout, kept in a ring buffer of the most
+ * recent ones to dump when an assembly fails, or both.
+ */
+
+#ifndef TRACE_H_
+#define TRACE_H_
+
+#include <stdio.h>
+#include <stddef.h>
+
+#define TRACE_OFF 0
+#define TRACE_ERROR 1		// Errors, as they are recorded
+#define TRACE_INFO 2		// One message per pass
+#define TRACE_DEBUG 3		// Every token and line
+
+// Most detailed level compiled in
+#ifndef TRACE_LEVEL
+#define TRACE_LEVEL TRACE_INFO
+#endif
+
+// Largest ring buffer --trace-buffer may ask for
+#define TRACE_MAX_BUFFER (1ull << 30)
+
+// Longest message kept; longer ones are cut short
+#define TRACE_MESSAGE_LENGTH 256
+
+typedef struct {
+	int print_level;	// Messages up to this level are printed to stdout
+	int ring_level;		// Messages up to this level are kept in the ring
+	int level;			// The greater of the two
+	char *ring;			// Most recent messages, NULL when none are kept
+	size_t ring_size;
+	size_t ring_pos;	// Bytes ever written to the ring
+} trace_t;
+
+#define TRACE(trace, lvl, ...) \
+	do { \
+		if ((lvl) <= TRACE_LEVEL && (lvl) <= (trace)->level) \
+			trace_write((trace), (lvl), __VA_ARGS__); \
+	} while (0)
+
+void trace_init(trace_t *trace);
+int trace_enable(trace_t *trace, int print_level, int ring_level, size_t ring_size);
+void trace_clear(trace_t *trace);
+void trace_free(trace_t *trace);
+void trace_write(trace_t *trace, int level, const char *format, ...)
+	__attribute__((format(printf, 3, 4)));
+void trace_dump(const trace_t *trace, FILE *Out);
+int trace_parse_level(const char *name, int *level);
+
+#endif /* TRACE_H_ */